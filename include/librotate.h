@@ -0,0 +1,91 @@
+/* librotate: batch rotation of in-memory 8-bit grayscale images.
+ *
+ * Every job names its source pixels and a caller-owned destination buffer,
+ * sized with rotateOutputSize(); results are never returned in library
+ * memory.  The library's rotation backend does hold memory of its own: per
+ * slot, device buffers and page-locked host buffers that transfers are
+ * staged through.  They grow as needed and are reused across calls until
+ * rotateReleaseResources().
+ *
+ * No C++ exception leaves the library; failures are reported as a
+ * RotateStatus.
+ *
+ * Link with -lrotate (lib/librotate.a or lib/librotate.so).
+ */
+
+#ifndef LIBROTATE_H
+#define LIBROTATE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBROTATE_VERSION 1
+
+enum RotateStatus
+{
+    ROTATE_SUCCESS = 0,
+    ROTATE_ERROR_INVALID_ARGUMENT = 1,  /* null pointer, empty image or pitch < width */
+    ROTATE_ERROR_ROI_OUTSIDE = 2,       /* the ROI does not overlap the rotated image */
+    ROTATE_ERROR_BUFFER_TOO_SMALL = 3,  /* see RotateResult for the required size */
+    ROTATE_ERROR_DEVICE = 4,            /* CUDA or NPP failure */
+    ROTATE_ERROR_OUT_OF_MEMORY = 5      /* host or staging memory could not be allocated */
+};
+
+typedef struct
+{
+    const unsigned char *data;
+    int width;
+    int height;
+    int pitch;                  /* bytes from one row to the next */
+} RotateSource;
+
+typedef struct
+{
+    unsigned char *data;
+    int width;                  /* capacity, in pixels */
+    int height;
+    int pitch;
+} RotateBuffer;
+
+typedef struct
+{
+    RotateSource src;
+    double angle;               /* degrees, counter-clockwise */
+    int useROI;                 /* non-zero: only produce roi[] = x, y, width, height */
+    int roi[4];                 /* in the coordinates of the rotated bounding box */
+    RotateBuffer dst;
+} RotateJob;
+
+typedef struct
+{
+    int status;                 /* RotateStatus */
+    int width;                  /* size of the rotated output written to dst */
+    int height;
+} RotateResult;
+
+/* Selects the CUDA device for the calling thread.  Call it before the first
+ * rotateBatch(), which sets the library up on the current device. */
+int rotateInit(int deviceId);
+
+/* Size of the output a job with these parameters produces.  roi may be NULL. */
+int rotateOutputSize(int width, int height, double angle, const int *roi, int *pWidth, int *pHeight);
+
+/* Runs nJobs jobs on the calling thread and fills one result per job.  Small
+ * jobs without an ROI are packed together and rotated in one launch per
+ * image size and angle.  A failing job does not stop the batch.  Returns
+ * the number of jobs that succeeded. */
+size_t rotateBatch(const RotateJob *pJobs, RotateResult *pResults, size_t nJobs);
+
+/* Frees the device and staging buffers and the streams held by the library. */
+void rotateReleaseResources(void);
+
+const char *rotateStatusString(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBROTATE_H */
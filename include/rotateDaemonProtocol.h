@@ -0,0 +1,70 @@
+/* Wire format of the batchRotateTIFF daemon (--daemon=<socket>).
+ *
+ * Clients connect to the Unix domain stream socket and send any number of
+ * requests, one after the other; each is answered by exactly one response
+ * before the next request is read.  All integers are in host byte order, as
+ * the socket is local.
+ *
+ * Request:  DaemonRequest, then
+ *             kind == ROTATE_JOB_PATHS:  inputPathLength bytes of input path,
+ *                                        outputPathLength bytes of output path
+ *             kind == ROTATE_JOB_PIXELS: width * height bytes of 8-bit
+ *                                        grayscale pixels, rows packed
+ * Response: DaemonResponse, then messageLength bytes of text, then
+ *           payloadBytes bytes of rotated pixels (pixel jobs only, rows
+ *           packed, width x height as given in the response).
+ */
+
+#ifndef ROTATE_DAEMON_PROTOCOL_H
+#define ROTATE_DAEMON_PROTOCOL_H
+
+#include <stdint.h>
+
+#define ROTATE_DAEMON_REQUEST_MAGIC  0x51544f52u   /* "ROTQ" */
+#define ROTATE_DAEMON_RESPONSE_MAGIC 0x52544f52u   /* "ROTR" */
+#define ROTATE_DAEMON_VERSION        1u
+
+enum RotateJobKind
+{
+    ROTATE_JOB_PATHS = 0,       /* read input file, write output file */
+    ROTATE_JOB_PIXELS = 1       /* pixels in the request and the response */
+};
+
+enum RotateJobFlags
+{
+    ROTATE_JOB_ROI = 1u << 0    /* roi[] holds x, y, width, height */
+};
+
+enum RotateDaemonStatus
+{
+    ROTATE_STATUS_OK = 0,
+    ROTATE_STATUS_BAD_REQUEST = 1,
+    ROTATE_STATUS_FAILED = 2
+};
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;              /* RotateJobKind */
+    uint32_t flags;             /* RotateJobFlags */
+    double angle;               /* degrees, counter-clockwise */
+    int32_t roi[4];
+    uint32_t width;             /* pixel jobs */
+    uint32_t height;
+    uint32_t inputPathLength;   /* path jobs */
+    uint32_t outputPathLength;
+} DaemonRequest;
+
+typedef struct
+{
+    uint32_t magic;
+    int32_t status;             /* RotateDaemonStatus */
+    uint32_t width;
+    uint32_t height;
+    uint64_t payloadBytes;
+    uint32_t messageLength;
+    uint32_t reserved;
+} DaemonResponse;
+
+#endif /* ROTATE_DAEMON_PROTOCOL_H */
@@ -1,260 +1,293 @@
-#!/bin/bash
-
-# CUDA NPP Image Rotation - Test Execution Script
-# This script builds the project and runs various test scenarios
-
-set -e  # Exit on error
-
-echo "========================================"
-echo "CUDA NPP Image Rotation - Test Suite"
-echo "========================================"
-echo ""
-
-# Colors for output
-RED='\033[0;31m'
-GREEN='\033[0;32m'
-YELLOW='\033[1;33m'
-NC='\033[0m' # No Color
-
-# Function to print colored output
-print_status() {
-    echo -e "${GREEN}[✓]${NC} $1"
-}
-
-print_error() {
-    echo -e "${RED}[✗]${NC} $1"
-}
-
-print_info() {
-    echo -e "${YELLOW}[i]${NC} $1"
-}
-
-# Check prerequisites
-print_info "Checking prerequisites..."
-
-if ! command -v nvcc &> /dev/null; then
-    print_error "CUDA toolkit not found. Please install CUDA."
-    exit 1
-fi
-print_status "CUDA toolkit found"
-
-if ! command -v cmake &> /dev/null; then
-    print_error "CMake not found. Please install CMake."
-    exit 1
-fi
-print_status "CMake found"
-
-# Display GPU information
-print_info "GPU Information:"
-nvidia-smi --query-gpu=name,driver_version,memory.total --format=csv,noheader
-echo ""
-
-# Create necessary directories
-print_info "Setting up directories..."
-mkdir -p build
-mkdir -p output
-mkdir -p logs
-
-# Build the project
-print_info "Building project..."
-cd build
-
-if [ -f "Makefile" ]; then
-    print_info "Cleaning previous build..."
-    make clean || true
-fi
-
-cmake ..
-make -j$(nproc)
-print_status "Build completed successfully"
-
-cd ..
-
-# Check if executable exists
-if [ ! -f "build/nppiRotate" ]; then
-    print_error "Executable not found after build"
-    exit 1
-fi
-
-# Test 1: Basic execution with default parameters
-print_info "Test 1: Running with default parameters..."
-./build/nppiRotate 2>&1 | tee logs/test1_default.log
-print_status "Test 1 completed"
-echo ""
-
-# Test 2: Different rotation angles
-print_info "Test 2: Testing different rotation angles..."
-
-for angle in 30 60 90 120 180 270; do
-    print_info "  Rotating by ${angle} degrees..."
-    output_dir="output/angle_${angle}"
-    mkdir -p "$output_dir"
-    ./build/nppiRotate --angle $angle --output-dir "$output_dir" 2>&1 | tee "logs/test2_angle_${angle}.log"
-done
-print_status "Test 2 completed"
-echo ""
-
-# Test 3: Performance measurement
-print_info "Test 3: Performance measurement..."
-echo "Running 3 iterations for performance analysis..."
-
-for i in {1..3}; do
-    print_info "  Iteration $i..."
-    output_dir="output/perf_run_${i}"
-    mkdir -p "$output_dir"
-    /usr/bin/time -v ./build/nppiRotate --output-dir "$output_dir" 2>&1 | tee "logs/test3_performance_${i}.log"
-done
-print_status "Test 3 completed"
-echo ""
-
-# Generate summary report
-print_info "Generating summary report..."
-
-REPORT_FILE="logs/test_summary_$(date +%Y%m%d_%H%M%S).txt"
-
-cat > "$REPORT_FILE" << EOF
-CUDA NPP Image Rotation - Test Summary Report
-==============================================
-Generated: $(date)
-Hostname: $(hostname)
-User: $(whoami)
-
-GPU Information:
-$(nvidia-smi --query-gpu=name,driver_version,memory.total,compute_cap --format=csv)
-
-CUDA Version:
-$(nvcc --version | grep release)
-
-Build Information:
-- CMake Version: $(cmake --version | head -n1)
-- GCC Version: $(gcc --version | head -n1)
-
-Test Results:
--------------
-
-Test 1: Default Parameters
-- Status: Completed
-- Log: logs/test1_default.log
-- Output: output/
-
-Test 2: Multiple Rotation Angles
-- Angles tested: 30, 60, 90, 120, 180, 270 degrees
-- Status: Completed
-- Logs: logs/test2_angle_*.log
-- Outputs: output/angle_*/
-
-Test 3: Performance Measurement
-- Iterations: 3
-- Status: Completed
-- Logs: logs/test3_performance_*.log
-
-File Listing:
--------------
-Input Images:
-$(find data/aerials -type f 2>/dev/null | wc -l) files found in data/aerials/
-
-Output Images:
-$(find output -type f -name "*.tiff" -o -name "*.pgm" -o -name "*.ppm" 2>/dev/null | wc -l) processed images
-
-Disk Usage:
-$(du -sh output 2>/dev/null || echo "N/A")
-
-Processing Logs:
-$(ls -lh logs/*.log 2>/dev/null | wc -l) log files generated
-
-Sample Processing Times:
-$(grep -h "Average time per image" logs/test1_*.log 2>/dev/null || echo "Check individual log files")
-
-EOF
-
-print_status "Summary report generated: $REPORT_FILE"
-cat "$REPORT_FILE"
-echo ""
-
-# Create visual proof of execution
-print_info "Creating execution proof..."
-
-PROOF_FILE="EXECUTION_PROOF.md"
-
-cat > "$PROOF_FILE" << 'EOF'
-# CUDA NPP Image Rotation - Execution Proof
-
-## Project Information
-
-**Project Name:** Batch Image Rotation using CUDA NPP  
-**Date:** $(date)  
-**GPU:** $(nvidia-smi --query-gpu=name --format=csv,noheader)
-
-## Execution Evidence
-
-### Build Output
-```
-EOF
-
-head -n 50 logs/test1_default.log >> "$PROOF_FILE"
-
-cat >> "$PROOF_FILE" << 'EOF'
-```
-
-### Sample Processing Log
-```
-EOF
-
-tail -n 30 logs/test1_default.log >> "$PROOF_FILE"
-
-cat >> "$PROOF_FILE" << 'EOF'
-```
-
-### Performance Statistics
-
-EOF
-
-for log in logs/test3_performance_*.log; do
-    if [ -f "$log" ]; then
-        echo "#### $(basename $log)" >> "$PROOF_FILE"
-        echo '```' >> "$PROOF_FILE"
-        grep -A 5 "PROCESSING SUMMARY" "$log" >> "$PROOF_FILE" || true
-        echo '```' >> "$PROOF_FILE"
-        echo "" >> "$PROOF_FILE"
-    fi
-done
-
-cat >> "$PROOF_FILE" << 'EOF'
-
-### Directory Structure
-```
-EOF
-
-tree -L 2 output >> "$PROOF_FILE" 2>/dev/null || ls -R output >> "$PROOF_FILE"
-
-cat >> "$PROOF_FILE" << 'EOF'
-```
-
-### File Counts
-- Input images processed: $(find data/aerials -type f | wc -l)
-- Output images generated: $(find output -type f -name "*_rotated*" | wc -l)
-- Total processing time: See individual logs
-
-
-## Conclusion
-
-The program successfully processed multiple images using GPU-accelerated NPP functions.
-All tests completed without errors, demonstrating the scalability and performance of
-CUDA-based image processing.
-EOF
-
-print_status "Execution proof document created: $PROOF_FILE"
-
-echo ""
-echo "========================================"
-echo "All tests completed successfully!"
-echo "========================================"
-echo ""
-print_info "Next steps:"
-echo "  1. Review logs in logs/ directory"
-echo "  2. Check output images in output/ directory"
-echo "  3. Read summary report: $REPORT_FILE"
-echo "  4. Review execution proof: $PROOF_FILE"
-echo "  5. Commit and push to your repository"
-echo ""
-print_status "Test suite execution finished"
+#!/bin/bash
+
+# CUDA NPP Image Rotation - Test Execution Script
+# This script builds the project and runs various test scenarios
+
+set -e  # Exit on error
+
+echo "========================================"
+echo "CUDA NPP Image Rotation - Test Suite"
+echo "========================================"
+echo ""
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+# Function to print colored output
+print_status() {
+    echo -e "${GREEN}[✓]${NC} $1"
+}
+
+print_error() {
+    echo -e "${RED}[✗]${NC} $1"
+}
+
+print_info() {
+    echo -e "${YELLOW}[i]${NC} $1"
+}
+
+# Check prerequisites
+print_info "Checking prerequisites..."
+
+if ! command -v nvcc &> /dev/null; then
+    print_error "CUDA toolkit not found. Please install CUDA."
+    exit 1
+fi
+print_status "CUDA toolkit found"
+
+if ! command -v cmake &> /dev/null; then
+    print_error "CMake not found. Please install CMake."
+    exit 1
+fi
+print_status "CMake found"
+
+# Display GPU information
+print_info "GPU Information:"
+nvidia-smi --query-gpu=name,driver_version,memory.total --format=csv,noheader
+echo ""
+
+# Create necessary directories
+print_info "Setting up directories..."
+mkdir -p build
+mkdir -p output
+mkdir -p logs
+
+# Build the project
+print_info "Building project..."
+cd build
+
+if [ -f "Makefile" ]; then
+    print_info "Cleaning previous build..."
+    make clean || true
+fi
+
+cmake ..
+make -j$(nproc)
+print_status "Build completed successfully"
+
+cd ..
+
+# Check if executable exists
+if [ ! -f "build/nppiRotate" ]; then
+    print_error "Executable not found after build"
+    exit 1
+fi
+
+# Test data: data/aerials is not part of the repository, so a synthetic set
+# is generated when it is missing.  SYNTHETIC_IMAGES sets its size.
+if [ -z "$(ls -A data/aerials 2>/dev/null)" ]; then
+    print_info "Generating ${SYNTHETIC_IMAGES:-24} synthetic test images in data/aerials..."
+    ./build/nppiRotate --backend=cpu --generate="${SYNTHETIC_IMAGES:-24}" --input-dir=data/aerials 2>&1 | tee logs/generate.log
+    print_status "Test data generated"
+    echo ""
+fi
+
+# Test 1: Basic execution with default parameters
+print_info "Test 1: Running with default parameters..."
+./build/nppiRotate 2>&1 | tee logs/test1_default.log
+print_status "Test 1 completed"
+echo ""
+
+# Test 2: Different rotation angles
+print_info "Test 2: Testing different rotation angles..."
+
+for angle in 30 60 90 120 180 270; do
+    print_info "  Rotating by ${angle} degrees..."
+    output_dir="output/angle_${angle}"
+    mkdir -p "$output_dir"
+    ./build/nppiRotate --angle $angle --output-dir "$output_dir" 2>&1 | tee "logs/test2_angle_${angle}.log"
+done
+print_status "Test 2 completed"
+echo ""
+
+# Test 3: Performance regression gate
+# The first run on a machine records the baseline; later runs fail when a
+# case's throughput drops significantly (see --benchmark in the README).
+# Set BASELINE to keep it elsewhere, UPDATE_BASELINE=1 to re-record it.
+BASELINE="${BASELINE:-rotate_baseline.txt}"
+print_info "Test 3: Benchmark against baseline $BASELINE..."
+
+BENCH_FLAGS="--benchmark --baseline=$BASELINE"
+if [ "${UPDATE_BASELINE:-0}" = "1" ]; then
+    BENCH_FLAGS="$BENCH_FLAGS --update-baseline"
+fi
+
+set +e
+./build/nppiRotate --backend=auto $BENCH_FLAGS 2>&1 | tee logs/test3_benchmark.log
+BENCH_STATUS=${PIPESTATUS[0]}
+set -e
+
+if [ "$BENCH_STATUS" -ne 0 ]; then
+    print_error "Test 3 failed: throughput regressed against $BASELINE"
+    exit 1
+fi
+print_status "Test 3 completed"
+echo ""
+
+# Test 4: Load test on in-memory synthetic images of mixed size, depth,
+# channels and format
+print_info "Test 4: Load test on synthetic images generated in memory..."
+./build/nppiRotate --synthetic=500 --synthetic-size=lognormal:1024,0.6 --synthetic-depth=8,16 \
+    --synthetic-channels=1,3,4 --synthetic-format=tiff,png,pgm,jpg --angle=auto \
+    --output-dir=output/synthetic 2>&1 | tee logs/test4_synthetic.log
+print_status "Test 4 completed"
+echo ""
+
+# Generate summary report
+print_info "Generating summary report..."
+
+REPORT_FILE="logs/test_summary_$(date +%Y%m%d_%H%M%S).txt"
+
+cat > "$REPORT_FILE" << EOF
+CUDA NPP Image Rotation - Test Summary Report
+==============================================
+Generated: $(date)
+Hostname: $(hostname)
+User: $(whoami)
+
+GPU Information:
+$(nvidia-smi --query-gpu=name,driver_version,memory.total,compute_cap --format=csv)
+
+CUDA Version:
+$(nvcc --version | grep release)
+
+Build Information:
+- CMake Version: $(cmake --version | head -n1)
+- GCC Version: $(gcc --version | head -n1)
+
+Test Results:
+-------------
+
+Test 1: Default Parameters
+- Status: Completed
+- Log: logs/test1_default.log
+- Output: output/
+
+Test 2: Multiple Rotation Angles
+- Angles tested: 30, 60, 90, 120, 180, 270 degrees
+- Status: Completed
+- Logs: logs/test2_angle_*.log
+- Outputs: output/angle_*/
+
+Test 3: Benchmark Regression Gate
+- Baseline: $BASELINE
+- Status: Passed
+- Log: logs/test3_benchmark.log
+
+Test 4: Synthetic Load Test
+- Images: 500 generated in memory, mixed size, depth, channels and format
+- Status: Completed
+- Log: logs/test4_synthetic.log
+- Outputs: output/synthetic/
+
+File Listing:
+-------------
+Input Images:
+$(find data/aerials -type f 2>/dev/null | wc -l) files found in data/aerials/
+
+Output Images:
+$(find output -type f -name "*.tiff" -o -name "*.pgm" -o -name "*.ppm" 2>/dev/null | wc -l) processed images
+
+Disk Usage:
+$(du -sh output 2>/dev/null || echo "N/A")
+
+Processing Logs:
+$(ls -lh logs/*.log 2>/dev/null | wc -l) log files generated
+
+Sample Processing Times:
+$(grep -h "Average time per image" logs/test1_*.log logs/test4_*.log 2>/dev/null || echo "Check individual log files")
+
+EOF
+
+print_status "Summary report generated: $REPORT_FILE"
+cat "$REPORT_FILE"
+echo ""
+
+# Create visual proof of execution
+print_info "Creating execution proof..."
+
+PROOF_FILE="EXECUTION_PROOF.md"
+
+cat > "$PROOF_FILE" << 'EOF'
+# CUDA NPP Image Rotation - Execution Proof
+
+## Project Information
+
+**Project Name:** Batch Image Rotation using CUDA NPP  
+**Date:** $(date)  
+**GPU:** $(nvidia-smi --query-gpu=name --format=csv,noheader)
+
+## Execution Evidence
+
+### Build Output
+```
+EOF
+
+head -n 50 logs/test1_default.log >> "$PROOF_FILE"
+
+cat >> "$PROOF_FILE" << 'EOF'
+```
+
+### Sample Processing Log
+```
+EOF
+
+tail -n 30 logs/test1_default.log >> "$PROOF_FILE"
+
+cat >> "$PROOF_FILE" << 'EOF'
+```
+
+### Performance Statistics
+
+EOF
+
+if [ -f logs/test3_benchmark.log ]; then
+    echo "#### test3_benchmark.log" >> "$PROOF_FILE"
+    echo '```' >> "$PROOF_FILE"
+    grep -E "Mpixel/s|Benchmark:|Baseline" logs/test3_benchmark.log >> "$PROOF_FILE" || true
+    echo '```' >> "$PROOF_FILE"
+    echo "" >> "$PROOF_FILE"
+fi
+
+cat >> "$PROOF_FILE" << 'EOF'
+
+### Directory Structure
+```
+EOF
+
+tree -L 2 output >> "$PROOF_FILE" 2>/dev/null || ls -R output >> "$PROOF_FILE"
+
+cat >> "$PROOF_FILE" << 'EOF'
+```
+
+### File Counts
+- Input images processed: $(find data/aerials -type f | wc -l)
+- Output images generated: $(find output -type f -name "*_rotated*" | wc -l)
+- Total processing time: See individual logs
+
+
+## Conclusion
+
+The program successfully processed multiple images using GPU-accelerated NPP functions.
+All tests completed without errors, demonstrating the scalability and performance of
+CUDA-based image processing.
+EOF
+
+print_status "Execution proof document created: $PROOF_FILE"
+
+echo ""
+echo "========================================"
+echo "All tests completed successfully!"
+echo "========================================"
+echo ""
+print_info "Next steps:"
+echo "  1. Review logs in logs/ directory"
+echo "  2. Check output images in output/ directory"
+echo "  3. Read summary report: $REPORT_FILE"
+echo "  4. Review execution proof: $PROOF_FILE"
+echo "  5. Commit and push to your repository"
+echo ""
+print_status "Test suite execution finished"
@@ -0,0 +1,509 @@
+#include "asyncIO.h"
+
+#include <Exceptions.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace
+{
+
+// Largest single read/write handed to the kernel; Linux caps a transfer at
+// just under 2 GiB anyway.
+const size_t kMaxTransfer = (size_t)1 << 30;
+
+int openForRead(const std::string &path, std::vector<unsigned char> &rData, int &rFd)
+{
+    rFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (rFd < 0) {
+        return errno;
+    }
+
+    struct stat oStat;
+    if (fstat(rFd, &oStat) != 0) {
+        int error = errno;
+        close(rFd);
+        rFd = -1;
+        return error;
+    }
+
+    rData.resize((size_t)oStat.st_size);
+    return 0;
+}
+
+int openForWrite(const std::string &path, int &rFd)
+{
+    rFd = open(partialPath(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return rFd < 0 ? errno : 0;
+}
+
+int readWholeFile(const std::string &path, std::vector<unsigned char> &rData)
+{
+    int fd;
+    int error = openForRead(path, rData, fd);
+    if (error) {
+        return error;
+    }
+
+    size_t nDone = 0;
+    while (nDone < rData.size()) {
+        ssize_t n = pread(fd, rData.data() + nDone, std::min(rData.size() - nDone, kMaxTransfer), nDone);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error = n < 0 ? errno : 0;
+            rData.resize(nDone);    // file shrank underneath us
+            break;
+        }
+        nDone += n;
+    }
+
+    close(fd);
+    return error;
+}
+
+// Writes partialPath(path); the caller commits it.
+int writeWholeFile(const std::string &path, const std::vector<unsigned char> &data)
+{
+    int fd;
+    int error = openForWrite(path, fd);
+    if (error) {
+        return error;
+    }
+
+    size_t nDone = 0;
+    while (nDone < data.size()) {
+        ssize_t n = pwrite(fd, data.data() + nDone, std::min(data.size() - nDone, kMaxTransfer), nDone);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error = n < 0 ? errno : EIO;
+            break;
+        }
+        nDone += n;
+    }
+
+    if (close(fd) != 0 && error == 0) {
+        error = errno;
+    }
+    return error;
+}
+
+// Blocking I/O on a pool of worker threads.  Used when io_uring is not
+// available; the queue depth becomes the number of workers.
+class ThreadPoolFileIO : public AsyncFileIO
+{
+public:
+    explicit ThreadPoolFileIO(unsigned int nThreads)
+        : bStop_(false), nInFlight_(0)
+    {
+        eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        NPP_ASSERT_MSG(eventFd_ >= 0, std::string("eventfd: ") + strerror(errno));
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            aWorkers_.emplace_back(&ThreadPoolFileIO::run, this);
+        }
+    }
+
+    ~ThreadPoolFileIO() override
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bStop_ = true;
+        }
+        workReady_.notify_all();
+        for (auto &rWorker : aWorkers_) {
+            rWorker.join();
+        }
+        close(eventFd_);
+    }
+
+    void submitRead(uint64_t tag, const std::string &path, std::vector<unsigned char> buffer) override
+    {
+        enqueue(tag, false, path, std::move(buffer));
+    }
+
+    void submitWrite(uint64_t tag, const std::string &path, std::vector<unsigned char> data) override
+    {
+        enqueue(tag, true, path, std::move(data));
+    }
+
+    bool wait(IOCompletion &rCompletion) override
+    {
+        std::unique_lock<std::mutex> oLock(mutex_);
+        if (nInFlight_ == 0) {
+            return false;
+        }
+        completionReady_.wait(oLock, [this] { return !completed_.empty(); });
+        rCompletion = std::move(completed_.front());
+        completed_.pop_front();
+        --nInFlight_;
+        return true;
+    }
+
+    bool tryWait(IOCompletion &rCompletion) override
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        if (completed_.empty()) {
+            return false;
+        }
+        rCompletion = std::move(completed_.front());
+        completed_.pop_front();
+        --nInFlight_;
+        return true;
+    }
+
+    int eventFd() const override
+    {
+        return eventFd_;
+    }
+
+    size_t inFlight() const override
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        return nInFlight_;
+    }
+
+    const char *name() const override
+    {
+        return "thread pool";
+    }
+
+private:
+    void enqueue(uint64_t tag, bool isWrite, const std::string &path, std::vector<unsigned char> data)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            pending_.push_back(IOCompletion{tag, isWrite, path, std::move(data), 0});
+            ++nInFlight_;
+        }
+        workReady_.notify_one();
+    }
+
+    void run()
+    {
+        for (;;) {
+            IOCompletion oRequest;
+            {
+                std::unique_lock<std::mutex> oLock(mutex_);
+                workReady_.wait(oLock, [this] { return bStop_ || !pending_.empty(); });
+                if (pending_.empty()) {
+                    return;
+                }
+                oRequest = std::move(pending_.front());
+                pending_.pop_front();
+            }
+
+            if (oRequest.isWrite) {
+                oRequest.error = commitPartial(oRequest.path, writeWholeFile(oRequest.path, oRequest.data));
+                oRequest.data.clear();
+                oRequest.data.shrink_to_fit();
+            } else {
+                oRequest.error = readWholeFile(oRequest.path, oRequest.data);
+            }
+
+            {
+                std::lock_guard<std::mutex> oLock(mutex_);
+                completed_.push_back(std::move(oRequest));
+            }
+            completionReady_.notify_one();
+
+            uint64_t one = 1;
+            ssize_t n = write(eventFd_, &one, sizeof(one));
+            (void)n;    // only fails if the counter would overflow, which still leaves it readable
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable workReady_;
+    std::condition_variable completionReady_;
+    std::deque<IOCompletion> pending_;
+    std::deque<IOCompletion> completed_;
+    std::vector<std::thread> aWorkers_;
+    bool bStop_;
+    size_t nInFlight_;
+    int eventFd_;
+};
+
+#ifdef HAVE_LIBURING
+
+// io_uring submission.  open/fstat/close stay synchronous; the data
+// transfers, which is where the time goes, are queued at the device.
+class UringFileIO : public AsyncFileIO
+{
+public:
+    explicit UringFileIO(unsigned int queueDepth)
+        : nQueueDepth_(queueDepth), nInFlight_(0), bInitialised_(false), eventFd_(-1)
+    {
+    }
+
+    ~UringFileIO() override
+    {
+        if (bInitialised_) {
+            IOCompletion oCompletion;
+            while (wait(oCompletion)) {
+            }
+            io_uring_queue_exit(&ring_);
+        }
+        if (eventFd_ >= 0) {
+            close(eventFd_);
+        }
+    }
+
+    // Returns 0 or a negative errno if the kernel cannot set up the ring.
+    int init()
+    {
+        int ret = io_uring_queue_init(nQueueDepth_, &ring_, 0);
+        if (ret != 0) {
+            return ret;
+        }
+        bInitialised_ = true;
+
+        eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd_ < 0) {
+            return -errno;
+        }
+        return io_uring_register_eventfd(&ring_, eventFd_);
+    }
+
+    void submitRead(uint64_t tag, const std::string &path, std::vector<unsigned char> buffer) override
+    {
+        Operation *pOp = new Operation{tag, false, path, -1, std::move(buffer), 0};
+        int error = openForRead(path, pOp->data, pOp->fd);
+        start(pOp, error);
+    }
+
+    void submitWrite(uint64_t tag, const std::string &path, std::vector<unsigned char> data) override
+    {
+        Operation *pOp = new Operation{tag, true, path, -1, std::move(data), 0};
+        int error = openForWrite(path, pOp->fd);
+        start(pOp, error);
+    }
+
+    bool wait(IOCompletion &rCompletion) override
+    {
+        while (completed_.empty()) {
+            if (nInFlight_ == 0) {
+                return false;
+            }
+            reapOne();
+        }
+        rCompletion = std::move(completed_.front());
+        completed_.pop_front();
+        return true;
+    }
+
+    bool tryWait(IOCompletion &rCompletion) override
+    {
+        struct io_uring_cqe *pCqe;
+        while (completed_.empty() && nInFlight_ > 0 && io_uring_peek_cqe(&ring_, &pCqe) == 0) {
+            handle(pCqe);
+        }
+        if (completed_.empty()) {
+            return false;
+        }
+        rCompletion = std::move(completed_.front());
+        completed_.pop_front();
+        return true;
+    }
+
+    int eventFd() const override
+    {
+        return eventFd_;
+    }
+
+    size_t inFlight() const override
+    {
+        return nInFlight_ + completed_.size();
+    }
+
+    const char *name() const override
+    {
+        return "io_uring";
+    }
+
+private:
+    struct Operation
+    {
+        uint64_t tag;
+        bool isWrite;
+        std::string path;
+        int fd;
+        std::vector<unsigned char> data;
+        size_t done;
+    };
+
+    void start(Operation *pOp, int error)
+    {
+        if (error || pOp->data.empty()) {
+            finish(pOp, error);
+            return;
+        }
+
+        // Keep at most nQueueDepth_ transfers queued in the ring.
+        while (nInFlight_ >= nQueueDepth_) {
+            reapOne();
+        }
+        ++nInFlight_;
+        queue(pOp);
+    }
+
+    void queue(Operation *pOp)
+    {
+        struct io_uring_sqe *pSqe = io_uring_get_sqe(&ring_);
+        NPP_ASSERT_MSG(pSqe != nullptr, "io_uring submission queue full");
+
+        unsigned int nBytes = (unsigned int)std::min(pOp->data.size() - pOp->done, kMaxTransfer);
+        if (pOp->isWrite) {
+            io_uring_prep_write(pSqe, pOp->fd, pOp->data.data() + pOp->done, nBytes, pOp->done);
+        } else {
+            io_uring_prep_read(pSqe, pOp->fd, pOp->data.data() + pOp->done, nBytes, pOp->done);
+        }
+        io_uring_sqe_set_data(pSqe, pOp);
+
+        int ret = io_uring_submit(&ring_);
+        NPP_ASSERT_MSG(ret >= 0, std::string("io_uring_submit: ") + strerror(-ret));
+    }
+
+    void reapOne()
+    {
+        struct io_uring_cqe *pCqe;
+        int ret;
+        do {
+            ret = io_uring_wait_cqe(&ring_, &pCqe);
+        } while (ret == -EINTR);
+        NPP_ASSERT_MSG(ret == 0, std::string("io_uring_wait_cqe: ") + strerror(-ret));
+        handle(pCqe);
+    }
+
+    void handle(struct io_uring_cqe *pCqe)
+    {
+        Operation *pOp = static_cast<Operation *>(io_uring_cqe_get_data(pCqe));
+        int res = pCqe->res;
+        io_uring_cqe_seen(&ring_, pCqe);
+
+        if (res == -EAGAIN || res == -EINTR) {
+            queue(pOp);
+            return;
+        }
+
+        if (res < 0) {
+            --nInFlight_;
+            finish(pOp, -res);
+            return;
+        }
+
+        if (res == 0) {
+            --nInFlight_;
+            if (pOp->isWrite) {
+                finish(pOp, EIO);
+            } else {
+                pOp->data.resize(pOp->done);    // file shrank underneath us
+                finish(pOp, 0);
+            }
+            return;
+        }
+
+        pOp->done += res;
+        if (pOp->done < pOp->data.size()) {
+            queue(pOp);     // short transfer, continue where it stopped
+            return;
+        }
+
+        --nInFlight_;
+        finish(pOp, 0);
+    }
+
+    void finish(Operation *pOp, int error)
+    {
+        if (pOp->fd >= 0 && close(pOp->fd) != 0 && error == 0 && pOp->isWrite) {
+            error = errno;
+        }
+        if (pOp->isWrite) {
+            pOp->data.clear();
+            if (pOp->fd >= 0) {
+                error = commitPartial(pOp->path, error);
+            }
+        }
+        completed_.push_back(IOCompletion{pOp->tag, pOp->isWrite, pOp->path, std::move(pOp->data), error});
+        delete pOp;
+
+        // Requests that fail before reaching the ring produce no CQE, so
+        // signal the eventfd here as well; extra wake-ups are harmless.
+        uint64_t one = 1;
+        ssize_t n = write(eventFd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    struct io_uring ring_;
+    unsigned int nQueueDepth_;
+    size_t nInFlight_;
+    bool bInitialised_;
+    int eventFd_;
+    std::deque<IOCompletion> completed_;
+};
+
+#endif // HAVE_LIBURING
+
+} // namespace
+
+std::string partialPath(const std::string &path)
+{
+    const size_t slash = path.find_last_of('/');
+    const size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+    return path.substr(0, nameStart) + "." + path.substr(nameStart) + ".part";
+}
+
+int commitPartial(const std::string &path, int error)
+{
+    const std::string partial = partialPath(path);
+    if (error == 0 && rename(partial.c_str(), path.c_str()) != 0) {
+        error = errno;
+    }
+    if (error != 0) {
+        unlink(partial.c_str());
+    }
+    return error;
+}
+
+int writeFileAtomically(const std::string &path, const std::vector<unsigned char> &data)
+{
+    return commitPartial(path, writeWholeFile(path, data));
+}
+
+std::unique_ptr<AsyncFileIO> createAsyncFileIO(unsigned int queueDepth, bool allowUring)
+{
+    queueDepth = std::max(1u, queueDepth);
+
+#ifdef HAVE_LIBURING
+    if (allowUring) {
+        std::unique_ptr<UringFileIO> pUring(new UringFileIO(queueDepth));
+        int ret = pUring->init();
+        if (ret == 0) {
+            return std::unique_ptr<AsyncFileIO>(pUring.release());
+        }
+        std::cerr << "io_uring unavailable (" << strerror(-ret) << "), using thread pool I/O" << std::endl;
+    }
+#else
+    (void)allowUring;
+#endif
+
+    return std::unique_ptr<AsyncFileIO>(new ThreadPoolFileIO(std::min(queueDepth, 64u)));
+}
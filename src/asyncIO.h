@@ -0,0 +1,78 @@
+/* Asynchronous whole-file reads and writes for the batch loop.
+ *
+ * The preferred implementation submits through io_uring so that many reads
+ * and writes are queued at the device at once.  When the binary is built
+ * without liburing, or the kernel refuses to set up a ring, a small pool of
+ * blocking pread/pwrite workers provides the same interface.
+ *
+ * An AsyncFileIO object is driven from a single thread: submit requests,
+ * then call wait() to collect completions in whatever order they finish.
+ * A thread that also waits for other events can poll() eventFd() and then
+ * drain completions with tryWait().
+ *
+ * Writes never leave a partial file under the name they were asked for:
+ * the data goes to ".<name>.part" in the same directory, which is renamed
+ * over the target once it is complete.  A crash mid-write leaves only the
+ * .part file, which the next write of that output truncates.
+ */
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct IOCompletion
+{
+    uint64_t tag;                   // caller supplied
+    bool isWrite;
+    std::string path;
+    std::vector<unsigned char> data; // file contents for reads, empty for writes
+    int error;                      // 0 on success, errno otherwise
+};
+
+class AsyncFileIO
+{
+public:
+    virtual ~AsyncFileIO() {}
+
+    // Reads the whole file at path into buffer, whose storage is reused if
+    // it has the capacity.
+    virtual void submitRead(uint64_t tag, const std::string &path, std::vector<unsigned char> buffer) = 0;
+
+    // Writes data to partialPath(path) and renames it to path.
+    virtual void submitWrite(uint64_t tag, const std::string &path, std::vector<unsigned char> data) = 0;
+
+    // Blocks until a request completes.  Returns false if nothing is in flight.
+    virtual bool wait(IOCompletion &rCompletion) = 0;
+
+    // Non-blocking variant of wait().  Returns false if no completion is ready.
+    virtual bool tryWait(IOCompletion &rCompletion) = 0;
+
+    // eventfd that becomes readable whenever a completion is posted.  The
+    // caller reads it to clear the count and then drains with tryWait().
+    virtual int eventFd() const = 0;
+
+    virtual size_t inFlight() const = 0;
+    virtual const char *name() const = 0;
+};
+
+// ".<name>.part" next to path.  Files that are written in place first, like
+// the streamed outputs of the tiled path, go there as well.
+std::string partialPath(const std::string &path);
+
+// Renames the complete partialPath(path) to path, or removes it if error is
+// set.  Returns error, or the errno of a failed rename.
+int commitPartial(const std::string &path, int error);
+
+// Blocking whole-file write through partialPath().  Returns 0 or an errno.
+int writeFileAtomically(const std::string &path, const std::vector<unsigned char> &data);
+
+// Returns the io_uring implementation when available, the thread pool
+// otherwise.  queueDepth bounds the number of requests queued at the device.
+std::unique_ptr<AsyncFileIO> createAsyncFileIO(unsigned int queueDepth, bool allowUring = true);
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,793 @@
+#include "batchPipeline.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "asyncIO.h"
+#include "batchRotate.h"
+#include "deskew.h"
+#include "imageCodec.h"
+#include "logging.h"
+#include "memoryBudget.h"
+#include "numaTopology.h"
+#include "orientationTag.h"
+#include "perfCounters.h"
+#include "prefetch.h"
+#include "rotateBackend.h"
+#include "rotateEngine.h"
+#include "rotateGeometry.h"
+#include "syntheticImages.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct Job
+{
+    std::string inputPath;
+    std::string outputPath;
+    bool sized;                 // reservation computed
+    bool tiled;                 // over the memory limit
+    size_t reserved;            // bytes held in the budget
+    std::vector<unsigned char> encodedIn;
+    std::vector<unsigned char> encodedOut;
+    bool success;
+    bool packed;                // rotated in a packed launch
+    size_t node;                // worker group, one per NUMA node
+    const unsigned char *pPoolBuffer;   // read buffer taken from the node's pool
+    bool checksummed;           // outputSize and checksum are set, for the journal
+    uint64_t outputSize;
+    uint64_t checksum;
+};
+
+// Read buffers of one NUMA node.  They are first touched by the node's
+// workers, so file data read into them lands in the node's memory.
+struct BufferPool
+{
+    std::mutex mutex;
+    std::vector<std::vector<unsigned char>> aFree;
+    size_t capacity;
+};
+
+// Hands job indices to the worker threads and collects the finished ones.
+// Finished jobs are signalled on an eventfd so the scheduler can wait for
+// them together with the file I/O.  With NUMA nodes the threads are dealt
+// out over the nodes in proportion to their CPUs and pinned there; each
+// node's threads serve their own queue.
+class WorkerPool
+{
+public:
+    template <typename Work>
+    WorkerPool(unsigned int nThreads, int deviceId, const std::vector<NumaNode> &aNodes, Work work)
+        : aGroups_(std::max<size_t>(1, aNodes.size()))
+        , bStop_(false)
+    {
+        eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        NPP_ASSERT_MSG(eventFd_ >= 0, std::string("eventfd: ") + strerror(errno));
+
+        size_t nCpus = 0;
+        for (const NumaNode &rNode : aNodes) {
+            nCpus += rNode.aCpus.size();
+        }
+
+        size_t nAssigned = 0;
+        size_t nCpusBefore = 0;
+        for (size_t group = 0; group < aGroups_.size(); ++group) {
+            const NumaNode *pNode = aNodes.empty() ? nullptr : &aNodes[group];
+            unsigned int nGroupThreads = nThreads;
+            if (pNode) {
+                nCpusBefore += pNode->aCpus.size();
+                size_t nShare = (size_t)nThreads * nCpusBefore / nCpus;
+                nGroupThreads = (unsigned int)std::max<size_t>(1, nShare > nAssigned ? nShare - nAssigned : 0);
+                nAssigned += nGroupThreads;
+            }
+            aGroups_[group].nThreads = nGroupThreads;
+
+            for (unsigned int i = 0; i < nGroupThreads; ++i) {
+                aThreads_.emplace_back([this, deviceId, work, group, pNode] {
+                    // Pinned before anything is allocated, so that the
+                    // thread's buffers are first touched on its node.
+                    if (pNode) {
+                        bindThreadToNode(*pNode);
+                    }
+                    // The current device is per thread.
+                    cudaSetDevice(deviceId);
+                    size_t index;
+                    while (pop(group, index)) {
+                        work(index);
+                        finish(index);
+                    }
+                });
+            }
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bStop_ = true;
+        }
+        for (Group &rGroup : aGroups_) {
+            rGroup.workReady.notify_all();
+        }
+        for (auto &rThread : aThreads_) {
+            rThread.join();
+        }
+        close(eventFd_);
+    }
+
+    // Queues index for the threads of group.
+    void submit(size_t index, size_t group)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            aGroups_[group].pending.push_back(index);
+        }
+        aGroups_[group].workReady.notify_one();
+    }
+
+    size_t groups() const
+    {
+        return aGroups_.size();
+    }
+
+    unsigned int groupThreads(size_t group) const
+    {
+        return aGroups_[group].nThreads;
+    }
+
+    bool tryPop(size_t &rIndex)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        if (finished_.empty()) {
+            return false;
+        }
+        rIndex = finished_.front();
+        finished_.pop_front();
+        return true;
+    }
+
+    int eventFd() const
+    {
+        return eventFd_;
+    }
+
+private:
+    struct Group
+    {
+        std::deque<size_t> pending;
+        std::condition_variable workReady;
+        unsigned int nThreads;
+    };
+
+    bool pop(size_t group, size_t &rIndex)
+    {
+        std::deque<size_t> &rPending = aGroups_[group].pending;
+        std::unique_lock<std::mutex> oLock(mutex_);
+        aGroups_[group].workReady.wait(oLock, [this, &rPending] { return bStop_ || !rPending.empty(); });
+        if (rPending.empty()) {
+            return false;
+        }
+        rIndex = rPending.front();
+        rPending.pop_front();
+        return true;
+    }
+
+    void finish(size_t index)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            finished_.push_back(index);
+        }
+        uint64_t one = 1;
+        ssize_t n = write(eventFd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    std::mutex mutex_;
+    std::vector<Group> aGroups_;
+    std::deque<size_t> finished_;
+    std::vector<std::thread> aThreads_;
+    bool bStop_;
+    int eventFd_;
+};
+
+void drainEventFd(int fd)
+{
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+    }
+}
+
+std::string progress(size_t index, size_t count)
+{
+    std::ostringstream oPrefix;
+    oPrefix << "[" << (index + 1) << "/" << count << "] ";
+    return oPrefix.str();
+}
+
+// Estimated footprint of one job.  Returns false if the header cannot be
+// read, in which case the size is unknown.
+bool sizeJob(const std::string &inputPath, const BatchConfig &rConfig, size_t &rBytes)
+{
+    struct stat oStat;
+    size_t nFileBytes = stat(inputPath.c_str(), &oStat) == 0 ? (size_t)oStat.st_size : 0;
+
+    NppiSize oSrcSize;
+    if (!probeImageSize(inputPath, oSrcSize)) {
+        return false;
+    }
+    SyntheticImage oSynthetic;
+    if (describeSyntheticPath(inputPath, oSynthetic)) {
+        // Encoded in memory; uncompressed is the worst case
+        nFileBytes = (size_t)oSrcSize.width * oSrcSize.height * oSynthetic.channels * oSynthetic.bitDepth / 8;
+    }
+
+    NppiRect oSrcWindow = {0, 0, oSrcSize.width, oSrcSize.height};
+    // A deskewed image is sized for the largest skew it may get
+    const double angle = isAutoAngle(rConfig.angle) ? kMaxSkewAngle : rConfig.angle;
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, angle);
+    NppiRect oDstROI = oGeometry.bound;
+    if (rConfig.useROI) {
+        oDstROI = intersectRect(rConfig.roi, oGeometry.bound);
+        oSrcWindow = backProjectROI(oGeometry, oDstROI);
+        nFileBytes = 0;     // read through windows, not as a whole file
+    }
+
+    rBytes = estimateJobFootprint(oSrcWindow, oDstROI, nFileBytes).total();
+    return true;
+}
+
+void logJobException(const std::string &rPrefix, const std::string &inputPath, const npp::Exception &rException)
+{
+    std::ostringstream oMessage;
+    oMessage << rPrefix << "NPP Exception (" << inputPath << "): " << rException;
+    logError(oMessage.str());
+}
+
+// Rotates a group of already read jobs.  Images small enough are rotated
+// together by the backend's rotateBatch(); any others in the group one at a
+// time.  The read buffers are left to the caller.
+void processGroup(std::vector<Job> &aJobs, const std::vector<size_t> &aGroup, double angle)
+{
+    const size_t nJobs = aJobs.size();
+    std::vector<npp::ImageCPU_8u_C1> aSrc(aGroup.size());
+    std::vector<npp::ImageCPU_8u_C1> aDst(aGroup.size());
+    std::vector<BatchImage> aBatch;
+    std::vector<size_t> aBatched;
+    std::vector<bool> aLossless(aGroup.size(), false);     // already encoded
+
+    for (size_t i = 0; i < aGroup.size(); ++i) {
+        Job &rJob = aJobs[aGroup[i]];
+        logInfo(progress(aGroup[i], nJobs) + "Processing: " + rJob.inputPath);
+        try {
+            if (rotateLossless(rJob.inputPath, &rJob.encodedIn, rJob.outputPath, angle, rJob.encodedOut)) {
+                rJob.success = true;
+                aLossless[i] = true;
+                continue;
+            }
+            {
+                PerfScope oPerf(PERF_STAGE_DECODE);
+                decodeImage(rJob.encodedIn, aSrc[i]);
+                oPerf.setPixels((size_t)aSrc[i].width() * aSrc[i].height());
+            }
+            const double imageAngle = resolveAngle(rJob.inputPath, aSrc[i], angle);
+
+            NppiSize oSrcSize = {(int)aSrc[i].width(), (int)aSrc[i].height()};
+            if ((size_t)oSrcSize.width * oSrcSize.height > kSmallImagePixels) {
+                rotateImage(aSrc[i], imageAngle, nullptr, aDst[i]);
+                rJob.success = true;
+                continue;
+            }
+
+            NppiSize oDstSize = rotatedImageSize(oSrcSize, imageAngle, nullptr);
+            npp::ImageCPU_8u_C1 oDst(oDstSize.width, oDstSize.height);
+            oDst.swap(aDst[i]);
+            BatchImage oImage = {aSrc[i].data(), (int)aSrc[i].pitch(), oSrcSize, imageAngle, aDst[i].data(),
+                                 (int)aDst[i].pitch()};
+            aBatch.push_back(oImage);
+            aBatched.push_back(i);
+        }
+        catch (npp::Exception &rException) {
+            logJobException(progress(aGroup[i], nJobs), rJob.inputPath, rException);
+        }
+    }
+
+    if (!aBatch.empty()) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        try {
+            rotateBackend().rotateBatch(aBatch);
+            for (size_t i : aBatched) {
+                aJobs[aGroup[i]].success = true;
+                aJobs[aGroup[i]].packed = true;
+            }
+        }
+        catch (npp::Exception &rException) {
+            logJobException("", "packed batch", rException);
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - startTime);
+
+        std::ostringstream oMessage;
+        oMessage << "Packed " << aBatch.size() << " images into one batch: " << duration.count() << " ms";
+        logInfo(oMessage.str());
+    }
+
+    // Encode output images; the writer stage puts them on disk
+    for (size_t i = 0; i < aGroup.size(); ++i) {
+        Job &rJob = aJobs[aGroup[i]];
+        if (!rJob.success || aLossless[i]) {
+            continue;
+        }
+        try {
+            PerfScope oPerf(PERF_STAGE_ENCODE, (size_t)aDst[i].width() * aDst[i].height());
+            encodeImage(rJob.outputPath, aDst[i], rJob.encodedOut);
+        }
+        catch (npp::Exception &rException) {
+            logJobException(progress(aGroup[i], nJobs), rJob.inputPath, rException);
+            rJob.success = false;
+        }
+    }
+}
+
+// Writes the TIFF and JPEG files of imageFiles by changing their
+// orientation tag, on rConfig.workers threads, and leaves the others in
+// rPixelFiles.  Nothing is decoded, so there is no memory to budget.
+BatchStats orientFiles(const std::vector<std::string> &imageFiles, const BatchConfig &rConfig,
+                       std::vector<std::string> &rPixelFiles)
+{
+    BatchStats oStats = {0, 0, 0, 0, 0, 0, 0, ""};
+    const size_t nJobs = imageFiles.size();
+    std::vector<char> aHandled(nJobs, 0);
+    std::atomic<size_t> next(0);
+    std::atomic<int> nSucceeded(0), nFailed(0);
+
+    auto orient = [&]() {
+        for (size_t index = next++; index < nJobs; index = next++) {
+            const std::string &inputPath = imageFiles[index];
+            const std::string outputPath = rotatedOutputPath(inputPath, rConfig.outputDir);
+            try {
+                if (writeOrientedCopy(inputPath, partialPath(outputPath), rConfig.angle)) {
+                    const int error = commitPartial(outputPath, 0);
+                    NPP_ASSERT_MSG(error == 0, "Write failed on " + outputPath + ": " + strerror(error));
+                    aHandled[index] = 1;
+                    ++nSucceeded;
+                    logInfo(progress(index, nJobs) + "Saved: " + outputPath + " (orientation tag)");
+                    uint64_t size, checksum;
+                    if (rConfig.pJournal && fileChecksum(outputPath, size, checksum)) {
+                        rConfig.pJournal->record(inputPath, outputPath, rConfig.parameters, size, checksum);
+                    }
+                }
+            }
+            catch (npp::Exception &rException) {
+                aHandled[index] = 1;
+                ++nFailed;
+                logJobException(progress(index, nJobs), inputPath, rException);
+                unlink(partialPath(outputPath).c_str());
+            }
+        }
+    };
+
+    std::vector<std::thread> aThreads;
+    for (unsigned int i = 1; i < std::min<size_t>(std::max(1u, rConfig.workers), nJobs); ++i) {
+        aThreads.emplace_back(orient);
+    }
+    orient();
+    for (std::thread &rThread : aThreads) {
+        rThread.join();
+    }
+
+    for (size_t i = 0; i < nJobs; ++i) {
+        if (!aHandled[i]) {
+            rPixelFiles.push_back(imageFiles[i]);
+        }
+    }
+    oStats.successCount = nSucceeded;
+    oStats.failCount = nFailed;
+    oStats.orientedCount = nSucceeded;
+    return oStats;
+}
+
+} // namespace
+
+std::string rotatedOutputPath(const std::string &inputPath, const std::string &outputDir)
+{
+    fs::path inPath(inputPath);
+    std::string outputFilename = inPath.stem().string() + "_rotated" + inPath.extension().string();
+    return outputDir + "/" + outputFilename;
+}
+
+BatchStats runBatch(const std::vector<std::string> &allFiles, const BatchConfig &rConfig)
+{
+    // Outputs the journal vouches for are not made again
+    std::vector<std::string> aRemaining;
+    int nResumed = 0;
+    if (rConfig.pJournal) {
+        for (const std::string &inputPath : allFiles) {
+            if (rConfig.pJournal->completed(rotatedOutputPath(inputPath, rConfig.outputDir), rConfig.parameters,
+                                            rConfig.verifyResume)) {
+                ++nResumed;
+            } else {
+                aRemaining.push_back(inputPath);
+            }
+        }
+        if (nResumed > 0) {
+            std::ostringstream oMessage;
+            oMessage << "Resuming: " << nResumed << " of " << allFiles.size()
+                     << " file(s) already complete in the journal\n";
+            logInfo(oMessage.str());
+        }
+    }
+    const std::vector<std::string> &imageFiles = rConfig.pJournal ? aRemaining : allFiles;
+
+    if (rConfig.orientationOnly) {
+        std::vector<std::string> aPixelFiles;
+        BatchStats oStats = orientFiles(imageFiles, rConfig, aPixelFiles);
+        oStats.resumedCount = nResumed;
+        if (!aPixelFiles.empty()) {
+            std::ostringstream oMessage;
+            oMessage << aPixelFiles.size() << " file(s) without an orientation tag are rotated\n";
+            logInfo(oMessage.str());
+
+            BatchConfig oConfig(rConfig);
+            oConfig.orientationOnly = false;
+            BatchStats oPixelStats = runBatch(aPixelFiles, oConfig);
+            oStats.successCount += oPixelStats.successCount;
+            oStats.failCount += oPixelStats.failCount;
+            oStats.tiledCount = oPixelStats.tiledCount;
+            oStats.packedCount = oPixelStats.packedCount;
+            oStats.peakReserved = oPixelStats.peakReserved;
+            oStats.ioName = oPixelStats.ioName;
+        }
+        return oStats;
+    }
+
+    BatchStats oStats = {0, 0, 0, 0, 0, nResumed, 0, ""};
+    const size_t nJobs = imageFiles.size();
+    const NppiRect *pROI = rConfig.useROI ? &rConfig.roi : nullptr;
+
+    std::vector<Job> aJobs(nJobs);
+    for (size_t i = 0; i < nJobs; ++i) {
+        aJobs[i].inputPath = imageFiles[i];
+        aJobs[i].outputPath = rotatedOutputPath(imageFiles[i], rConfig.outputDir);
+        aJobs[i].sized = false;
+        aJobs[i].tiled = false;
+        aJobs[i].reserved = 0;
+        aJobs[i].success = false;
+        aJobs[i].packed = false;
+        aJobs[i].node = 0;
+        aJobs[i].pPoolBuffer = nullptr;
+        aJobs[i].checksummed = false;
+    }
+
+    MemoryBudget oBudget(rConfig.memoryLimit);
+
+    // ROI jobs read only their source window directly, so just their
+    // writes go through the queue, and whole-file read-ahead would defeat
+    // them.  Synthetic jobs are rendered by the workers and not read at all.
+    std::unique_ptr<AsyncFileIO> pIO = createAsyncFileIO(rConfig.ioDepth, rConfig.useUring);
+    oStats.ioName = pIO->name();
+
+    std::ostringstream oMessage;
+    oMessage << "File I/O: " << pIO->name() << ", queue depth " << rConfig.ioDepth << "\n";
+    logInfo(oMessage.str());
+
+    std::unique_ptr<ReadAheadPrefetcher> pPrefetcher;
+    const bool bFiles = imageFiles.empty() || !isSyntheticPath(imageFiles.front());
+    if (!rConfig.useROI && bFiles && rConfig.prefetchBytes > 0) {
+        pPrefetcher.reset(new ReadAheadPrefetcher(imageFiles, rConfig.prefetchBytes));
+    }
+
+    // Worker indices past the job list name packed groups.  There are at
+    // most as many groups as jobs, and sizing the list up front keeps it
+    // from moving while workers read it.
+    const bool bPacking = rConfig.packedBatch > 1 && !rConfig.useROI;
+    std::vector<std::vector<size_t>> aGroups(bPacking ? nJobs : 0);
+    size_t nGroups = 0;
+
+    // Read buffers are pooled per node so that they stay node-local.  With
+    // a memory limit they are not, as idle pooled buffers would sit outside
+    // the budget.
+    const size_t nNodes = std::max<size_t>(1, rConfig.numaNodes.size());
+    const bool bPooling = !rConfig.numaNodes.empty() && !oBudget.limited();
+    std::vector<BufferPool> aPools(bPooling ? nNodes : 0);
+
+    // Hands a job's read buffer back to its node's pool.  A buffer that was
+    // not taken from the pool, or that the read had to grow, lives wherever
+    // it was first touched; the worker swaps it for one it touches itself.
+    auto recycleReadBuffer = [&](Job &rJob) {
+        std::vector<unsigned char> buffer;
+        buffer.swap(rJob.encodedIn);
+        if (!bPooling || buffer.capacity() == 0) {
+            return;
+        }
+        BufferPool &rPool = aPools[rJob.node];
+        {
+            std::lock_guard<std::mutex> oLock(rPool.mutex);
+            if (rPool.aFree.size() >= rPool.capacity) {
+                return;
+            }
+        }
+        if (buffer.data() != rJob.pPoolBuffer) {
+            std::vector<unsigned char> oLocal(buffer.capacity());
+            buffer.swap(oLocal);
+        }
+        buffer.clear();
+        std::lock_guard<std::mutex> oLock(rPool.mutex);
+        rPool.aFree.push_back(std::move(buffer));
+    };
+
+    // Journal checksums are taken by the workers, off the scheduler thread.
+    // Tiled outputs are only on disk, so theirs are read back.
+    auto checksumOutput = [&](Job &rJob) {
+        if (!rConfig.pJournal || !rJob.success) {
+            return;
+        }
+        if (rJob.tiled) {
+            rJob.checksummed = fileChecksum(rJob.outputPath, rJob.outputSize, rJob.checksum);
+        } else {
+            rJob.outputSize = rJob.encodedOut.size();
+            rJob.checksum = checksum64(rJob.encodedOut.data(), rJob.encodedOut.size());
+            rJob.checksummed = true;
+        }
+    };
+
+    WorkerPool oWorkers(std::max(1u, rConfig.workers), rConfig.deviceId, rConfig.numaNodes, [&](size_t index) {
+        if (index >= nJobs) {
+            const std::vector<size_t> &rGroup = aGroups[index - nJobs];
+            processGroup(aJobs, rGroup, rConfig.angle);
+            for (size_t job : rGroup) {
+                recycleReadBuffer(aJobs[job]);
+                checksumOutput(aJobs[job]);
+            }
+            return;
+        }
+
+        Job &rJob = aJobs[index];
+        logInfo(progress(index, nJobs) + "Processing: " + rJob.inputPath);
+
+        auto imgStartTime = std::chrono::high_resolution_clock::now();
+        if (isSyntheticPath(rJob.inputPath)) {
+            // Rendered here rather than read
+            try {
+                loadSyntheticImage(rJob.inputPath, rJob.encodedIn);
+            }
+            catch (npp::Exception &rException) {
+                logJobException(progress(index, nJobs), rJob.inputPath, rException);
+                return;
+            }
+        }
+        if (rJob.tiled) {
+            rJob.success = processImageTiled(rJob.inputPath, rJob.outputPath, rConfig.angle, pROI,
+                                             oBudget.limit());
+        } else {
+            rJob.success = processImage(rJob.inputPath, pROI ? nullptr : &rJob.encodedIn, rJob.outputPath,
+                                        rConfig.angle, pROI, rJob.encodedOut);
+        }
+        recycleReadBuffer(rJob);
+        checksumOutput(rJob);
+        auto imgEndTime = std::chrono::high_resolution_clock::now();
+
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(imgEndTime - imgStartTime);
+        std::ostringstream oMessage;
+        oMessage << progress(index, nJobs) << "Time: " << duration.count() << " ms";
+        logInfo(oMessage.str());
+    });
+
+    if (!rConfig.numaNodes.empty()) {
+        std::ostringstream oPlacement;
+        oPlacement << "Workers:";
+        for (size_t node = 0; node < nNodes; ++node) {
+            oPlacement << (node ? "," : "") << " " << oWorkers.groupThreads(node) << " on node "
+                       << rConfig.numaNodes[node].id;
+        }
+        logInfo(oPlacement.str());
+    }
+    for (size_t node = 0; node < aPools.size(); ++node) {
+        aPools[node].capacity = (rConfig.ioDepth + nNodes - 1) / nNodes + oWorkers.groupThreads(node);
+    }
+
+    size_t nextAdmit = 0;
+    size_t nFinished = 0;
+    size_t readsInFlight = 0;
+
+    // Jobs assigned to each node and not yet through its workers.  A new
+    // job goes to the node with the fewest per worker thread.
+    std::vector<size_t> aNodeJobs(nNodes, 0);
+    auto assignNode = [&](Job &rJob) {
+        size_t best = 0;
+        for (size_t node = 1; node < nNodes; ++node) {
+            if (aNodeJobs[node] * oWorkers.groupThreads(best) < aNodeJobs[best] * oWorkers.groupThreads(node)) {
+                best = node;
+            }
+        }
+        rJob.node = best;
+        ++aNodeJobs[best];
+    };
+
+    // Packed groups are formed per node.
+    std::vector<std::vector<size_t>> aOpenGroups(nNodes);
+    auto submitGroup = [&](size_t node) {
+        aGroups[nGroups].swap(aOpenGroups[node]);
+        aOpenGroups[node].clear();
+        oWorkers.submit(nJobs + nGroups++, node);
+    };
+
+    auto finishJob = [&](size_t index, bool success) {
+        Job &rJob = aJobs[index];
+        oBudget.release(rJob.reserved);
+        rJob.reserved = 0;
+        if (success) {
+            if (rJob.checksummed) {
+                rConfig.pJournal->record(rJob.inputPath, rJob.outputPath, rConfig.parameters, rJob.outputSize,
+                                         rJob.checksum);
+            }
+            oStats.successCount++;
+        } else {
+            oStats.failCount++;
+        }
+        ++nFinished;
+    };
+
+    while (nFinished < nJobs) {
+        // Admit jobs in list order while their reservations fit.
+        while (nextAdmit < nJobs) {
+            Job &rJob = aJobs[nextAdmit];
+
+            if (oBudget.limited() && !rJob.sized) {
+                // Tiled jobs, and jobs of unknown size, hold the whole budget
+                // and so run alone.
+                size_t nBytes;
+                if (!sizeJob(rJob.inputPath, rConfig, nBytes)) {
+                    nBytes = oBudget.limit();
+                } else if (!oBudget.fits(nBytes)) {
+                    // A synthetic image only exists as a whole, so it runs
+                    // alone instead of tiled
+                    rJob.tiled = !isSyntheticPath(rJob.inputPath);
+                    nBytes = oBudget.limit();
+                }
+                rJob.reserved = nBytes;
+                rJob.sized = true;
+            }
+
+            const bool bSynthetic = isSyntheticPath(rJob.inputPath);
+            if (!rJob.tiled && !rConfig.useROI && !bSynthetic && readsInFlight >= rConfig.ioDepth) {
+                break;
+            }
+            // Synthetic jobs have no read to wait for; as many are let in
+            // as reads and workers would hold
+            if (bSynthetic && nextAdmit - nFinished >= rConfig.ioDepth + std::max(1u, rConfig.workers)) {
+                break;
+            }
+            if (!oBudget.tryAcquire(rJob.reserved)) {
+                break;
+            }
+
+            assignNode(rJob);
+            if (rJob.tiled) {
+                oStats.tiledCount++;
+                logInfo(progress(nextAdmit, nJobs) + "Over the memory limit, using the tiled path: " +
+                        rJob.inputPath);
+                oWorkers.submit(nextAdmit, rJob.node);
+            } else if (rConfig.useROI || bSynthetic) {
+                oWorkers.submit(nextAdmit, rJob.node);
+            } else {
+                std::vector<unsigned char> buffer;
+                if (bPooling) {
+                    BufferPool &rPool = aPools[rJob.node];
+                    std::lock_guard<std::mutex> oLock(rPool.mutex);
+                    if (!rPool.aFree.empty()) {
+                        buffer.swap(rPool.aFree.back());
+                        rPool.aFree.pop_back();
+                    }
+                }
+                rJob.pPoolBuffer = buffer.data();
+                pIO->submitRead(nextAdmit, rJob.inputPath, std::move(buffer));
+                ++readsInFlight;
+            }
+            ++nextAdmit;
+        }
+        if (pPrefetcher) {
+            pPrefetcher->advance(nextAdmit);
+        }
+
+        // With no reads in flight nothing can join the open groups before
+        // something finishes, so they go out as they are.
+        for (size_t node = 0; node < nNodes && readsInFlight == 0; ++node) {
+            if (!aOpenGroups[node].empty()) {
+                submitGroup(node);
+            }
+        }
+
+        struct pollfd aFds[2] = {{pIO->eventFd(), POLLIN, 0}, {oWorkers.eventFd(), POLLIN, 0}};
+        if (poll(aFds, 2, -1) < 0 && errno != EINTR) {
+            NPP_ASSERT_MSG(false, std::string("poll: ") + strerror(errno));
+        }
+        drainEventFd(pIO->eventFd());
+        drainEventFd(oWorkers.eventFd());
+
+        IOCompletion oCompletion;
+        while (pIO->tryWait(oCompletion)) {
+            size_t index = oCompletion.tag;
+            if (oCompletion.isWrite) {
+                if (oCompletion.error == 0) {
+                    logInfo(progress(index, nJobs) + "Saved: " + oCompletion.path);
+                } else {
+                    logError(progress(index, nJobs) + "Write failed: " + oCompletion.path + ": " +
+                             strerror(oCompletion.error));
+                }
+                finishJob(index, oCompletion.error == 0);
+            } else {
+                --readsInFlight;
+                if (oCompletion.error != 0) {
+                    logError(progress(index, nJobs) + "Read failed: " + oCompletion.path + ": " +
+                             strerror(oCompletion.error));
+                    --aNodeJobs[aJobs[index].node];
+                    finishJob(index, false);
+                } else {
+                    Job &rJob = aJobs[index];
+                    rJob.encodedIn = std::move(oCompletion.data);
+                    if (bPacking && rJob.encodedIn.size() <= kSmallImagePixels) {
+                        aOpenGroups[rJob.node].push_back(index);
+                        if (aOpenGroups[rJob.node].size() >= rConfig.packedBatch) {
+                            submitGroup(rJob.node);
+                        }
+                    } else {
+                        oWorkers.submit(index, rJob.node);
+                    }
+                }
+            }
+        }
+
+        size_t task;
+        std::vector<size_t> aFinished;
+        while (oWorkers.tryPop(task)) {
+            if (task >= nJobs) {
+                std::vector<size_t> &rGroup = aGroups[task - nJobs];
+                aFinished.insert(aFinished.end(), rGroup.begin(), rGroup.end());
+                std::vector<size_t>().swap(rGroup);
+            } else {
+                aFinished.push_back(task);
+            }
+        }
+        for (size_t index : aFinished) {
+            Job &rJob = aJobs[index];
+            --aNodeJobs[rJob.node];
+            if (rJob.packed) {
+                oStats.packedCount++;
+            }
+            if (rJob.tiled) {
+                if (rJob.success) {
+                    logInfo(progress(index, nJobs) + "Saved: " + rJob.outputPath);
+                }
+                finishJob(index, rJob.success);
+            } else if (rJob.success) {
+                pIO->submitWrite(index, rJob.outputPath, std::move(rJob.encodedOut));
+            } else {
+                finishJob(index, false);
+            }
+        }
+    }
+
+    oStats.peakReserved = oBudget.peak();
+    return oStats;
+}
@@ -0,0 +1,73 @@
+/* The batch scheduler: reads, rotations and writes for a list of files.
+ *
+ * Jobs are admitted in list order.  With a memory limit each job first
+ * reserves its estimated footprint; a job that does not fit waits until
+ * earlier jobs release theirs, and a job that could never fit runs alone on
+ * the tiled path.  Admitted jobs are read through the asynchronous I/O
+ * layer, rotated by a pool of worker threads and written back behind them.
+ * With packing enabled, small files are handed to the workers in groups so
+ * that their rotations share one packed launch.
+ *
+ * With NUMA nodes the workers are split into one group per node and pinned
+ * to it.  Each job is assigned a node when it is read and stays there from
+ * decode to encode: its read buffer comes from the node's pool, which the
+ * node's own workers first touched, and everything after it is allocated
+ * by those workers.
+ *
+ * With a progress journal, files whose output it records as complete are
+ * skipped, and every output written is recorded in it (see
+ * progressJournal.h).
+ */
+
+#ifndef BATCH_PIPELINE_H
+#define BATCH_PIPELINE_H
+
+#include <npp.h>
+
+#include <string>
+#include <vector>
+
+#include "numaTopology.h"
+#include "progressJournal.h"
+
+struct BatchConfig
+{
+    std::string outputDir;
+    double angle;
+    bool useROI;
+    NppiRect roi;
+    unsigned int ioDepth;       // reads in flight ahead, writes in flight behind
+    bool useUring;
+    size_t prefetchBytes;       // page cache read-ahead budget, 0 disables
+    size_t memoryLimit;         // host bytes for admitted jobs, 0 = unlimited
+    unsigned int workers;       // decode/rotate/encode threads
+    unsigned int packedBatch;   // small images per packed launch, 0 = off
+    int deviceId;               // CUDA device the workers run on
+    std::vector<NumaNode> numaNodes;    // one worker group per node, empty = unpinned
+    bool orientationOnly;       // TIFF/JPEG: rewrite the orientation tag, not the pixels
+    ProgressJournal *pJournal;  // completed outputs, null = no resuming
+    std::string parameters;     // everything the outputs depend on, as recorded in the journal
+    bool verifyResume;          // check journaled outputs by checksum, not only by size
+};
+
+struct BatchStats
+{
+    int successCount;
+    int failCount;
+    int tiledCount;             // jobs over the memory limit
+    int packedCount;            // jobs rotated in packed launches
+    int orientedCount;          // jobs written by changing the orientation tag
+    int resumedCount;           // jobs skipped as complete in the journal
+    size_t peakReserved;        // largest total reservation seen
+    std::string ioName;
+};
+
+// Output file for inputPath: "<stem>_rotated<ext>" in outputDir.
+std::string rotatedOutputPath(const std::string &inputPath, const std::string &outputDir);
+
+// With orientationOnly, TIFF and JPEG files are first copied with only
+// their orientation tag changed (see orientationTag.h), several at a time;
+// files of other formats then go through the pipeline.
+BatchStats runBatch(const std::vector<std::string> &imageFiles, const BatchConfig &rConfig);
+
+#endif // BATCH_PIPELINE_H
@@ -0,0 +1,154 @@
+#include "batchRotate.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <string.h>
+
+#include <cmath>
+#include <map>
+#include <tuple>
+
+#include "hugePages.h"
+#include "rotateGeometry.h"
+
+namespace
+{
+
+const size_t kAlignment = 256;
+
+size_t alignUp(size_t nBytes)
+{
+    return (nBytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Pinned staging memory and its device mirror, kept per thread and device
+// and only ever grown.  Both use the same layout:
+//
+//   [coefficients][descriptor table][sources][destinations]
+struct Arena
+{
+    unsigned char *host = nullptr;
+    unsigned char *device = nullptr;
+    size_t capacity = 0;
+
+    ~Arena()
+    {
+        freePinnedImageMemory(host);
+        cudaFree(device);
+    }
+};
+
+Arena &arena()
+{
+    thread_local std::map<int, Arena> s_arenas;
+    int deviceId = 0;
+    NPP_CHECK_CUDA(cudaGetDevice(&deviceId));
+    return s_arenas[deviceId];
+}
+
+void reserveArena(Arena &rArena, size_t nBytes)
+{
+    if (nBytes <= rArena.capacity) {
+        return;
+    }
+
+    freePinnedImageMemory(rArena.host);
+    cudaFree(rArena.device);
+    rArena.host = nullptr;
+    rArena.device = nullptr;
+    rArena.capacity = 0;
+
+    rArena.host = static_cast<unsigned char *>(allocatePinnedImageMemory(nBytes));
+    NPP_CHECK_CUDA(cudaMalloc((void **)&rArena.device, nBytes));
+    rArena.capacity = nBytes;
+}
+
+// Rotates images that all have the size and angle of rGeometry with a single
+// launch.
+void rotateGroup(const std::vector<BatchImage> &aImages, const std::vector<size_t> &aIndices,
+                 const RotationGeometry &rGeometry)
+{
+    const size_t nImages = aIndices.size();
+    const NppiSize oSrcSize = rGeometry.srcSize;
+    const NppiSize oDstSize = {rGeometry.bound.width, rGeometry.bound.height};
+    const size_t nSrcBytes = (size_t)oSrcSize.width * oSrcSize.height;
+    const size_t nDstBytes = (size_t)oDstSize.width * oDstSize.height;
+
+    const size_t nCoeffsOffset = 0;
+    const size_t nTableOffset = alignUp(nImages * 6 * sizeof(Npp64f));
+    const size_t nSrcOffset = alignUp(nTableOffset + nImages * sizeof(NppiWarpAffineBatchCXR));
+    const size_t nDstOffset = alignUp(nSrcOffset + nImages * nSrcBytes);
+
+    Arena &rArena = arena();
+    reserveArena(rArena, nDstOffset + nImages * nDstBytes);
+
+    // NPP maps source to destination with
+    //   x' = c00 * x + c01 * y + c02,  y' = c10 * x + c11 * y + c12
+    // which for a rotation is the transform documented in rotateGeometry.h.
+    const double kRadians = rGeometry.angle * M_PI / 180.0;
+    const double kCos = std::cos(kRadians);
+    const double kSin = std::sin(kRadians);
+    const Npp64f aCoeffs[6] = {kCos, kSin, rGeometry.shiftX, -kSin, kCos, rGeometry.shiftY};
+
+    Npp64f *pHostCoeffs = (Npp64f *)(rArena.host + nCoeffsOffset);
+    NppiWarpAffineBatchCXR *pHostTable = (NppiWarpAffineBatchCXR *)(rArena.host + nTableOffset);
+    for (size_t i = 0; i < nImages; ++i) {
+        const BatchImage &rImage = aImages[aIndices[i]];
+        memcpy(pHostCoeffs + 6 * i, aCoeffs, sizeof(aCoeffs));
+
+        NppiWarpAffineBatchCXR &rEntry = pHostTable[i];
+        memset(&rEntry, 0, sizeof(rEntry));
+        rEntry.pSrc = rArena.device + nSrcOffset + i * nSrcBytes;
+        rEntry.nSrcStep = oSrcSize.width;
+        rEntry.pDst = rArena.device + nDstOffset + i * nDstBytes;
+        rEntry.nDstStep = oDstSize.width;
+        rEntry.pCoeffs = (Npp64f *)(rArena.device + nCoeffsOffset) + 6 * i;
+
+        unsigned char *pPacked = rArena.host + nSrcOffset + i * nSrcBytes;
+        for (int y = 0; y < oSrcSize.height; ++y) {
+            memcpy(pPacked + (size_t)y * oSrcSize.width, rImage.pSrc + (size_t)y * rImage.srcStep, oSrcSize.width);
+        }
+    }
+
+    // One upload for coefficients, table and pixels; pixels that map
+    // outside the source are left at 0
+    NPP_CHECK_CUDA(cudaMemcpy(rArena.device, rArena.host, nDstOffset, cudaMemcpyHostToDevice));
+    NPP_CHECK_CUDA(cudaMemset(rArena.device + nDstOffset, 0, nImages * nDstBytes));
+
+    NppiWarpAffineBatchCXR *pDeviceTable = (NppiWarpAffineBatchCXR *)(rArena.device + nTableOffset);
+    NppiRect oSrcRect = {0, 0, oSrcSize.width, oSrcSize.height};
+    NppiRect oDstRect = {0, 0, oDstSize.width, oDstSize.height};
+    NPP_CHECK_NPP(nppiWarpAffineBatchInit(pDeviceTable, (unsigned int)nImages));
+    NPP_CHECK_NPP(nppiWarpAffineBatch_8u_C1R(oSrcSize, oSrcRect, oDstRect, NPPI_INTER_LINEAR, pDeviceTable,
+                                             (unsigned int)nImages));
+
+    // One download, then unpack into the callers' buffers
+    NPP_CHECK_CUDA(cudaMemcpy(rArena.host + nDstOffset, rArena.device + nDstOffset, nImages * nDstBytes,
+                              cudaMemcpyDeviceToHost));
+    for (size_t i = 0; i < nImages; ++i) {
+        const BatchImage &rImage = aImages[aIndices[i]];
+        const unsigned char *pPacked = rArena.host + nDstOffset + i * nDstBytes;
+        for (int y = 0; y < oDstSize.height; ++y) {
+            memcpy(rImage.pDst + (size_t)y * rImage.dstStep, pPacked + (size_t)y * oDstSize.width, oDstSize.width);
+        }
+    }
+}
+
+} // namespace
+
+void rotateImageBatch(const std::vector<BatchImage> &aImages)
+{
+    typedef std::tuple<int, int, double> GroupKey;
+    std::map<GroupKey, std::vector<size_t>> oGroups;
+    for (size_t i = 0; i < aImages.size(); ++i) {
+        const BatchImage &rImage = aImages[i];
+        NPP_ASSERT_MSG(rImage.srcSize.width > 0 && rImage.srcSize.height > 0, "Empty image in batch");
+        oGroups[GroupKey(rImage.srcSize.width, rImage.srcSize.height, rImage.angle)].push_back(i);
+    }
+
+    for (const auto &rGroup : oGroups) {
+        const BatchImage &rFirst = aImages[rGroup.second.front()];
+        rotateGroup(aImages, rGroup.second, makeRotationGeometry(rFirst.srcSize, rFirst.angle));
+    }
+}
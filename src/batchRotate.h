@@ -0,0 +1,35 @@
+/* Packed rotation of many small images.
+ *
+ * For thumbnails the fixed cost of one upload, launch and download per image
+ * dominates.  Here images that share a size and angle are copied into one
+ * contiguous arena together with a descriptor table and their affine
+ * coefficients, uploaded in one copy, rotated by a single
+ * nppiWarpAffineBatch_8u_C1R launch and downloaded in one copy.
+ */
+
+#ifndef BATCH_ROTATE_H
+#define BATCH_ROTATE_H
+
+#include <npp.h>
+
+#include <vector>
+
+// Images up to this many pixels are worth packing; larger ones amortise the
+// per-call overhead on their own.
+const size_t kSmallImagePixels = 512 * 512;
+
+struct BatchImage
+{
+    const Npp8u *pSrc;
+    int srcStep;
+    NppiSize srcSize;
+    double angle;
+    Npp8u *pDst;        // rotatedImageSize(srcSize, angle, nullptr) pixels
+    int dstStep;
+};
+
+// Rotates every image into its whole bounding box, exactly as rotateImage()
+// without an ROI would.  One launch is made per distinct size and angle.
+void rotateImageBatch(const std::vector<BatchImage> &aImages);
+
+#endif // BATCH_ROTATE_H
@@ -0,0 +1,310 @@
+#include "benchmark.h"
+
+#include <Exceptions.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "cpuRotate.h"
+#include "logging.h"
+#include "rotateGeometry.h"
+
+namespace
+{
+
+struct Size
+{
+    int width;
+    int height;
+};
+
+// The workload.  Sizes span per-request overhead to memory bound; the
+// angles a small deskew, a general angle and a quarter turn.
+const Size kSizes[] = {{256, 256}, {1024, 768}, {3000, 2000}};
+const double kAngles[] = {7.5, 30.0, 90.0};
+const CpuBorderMode kBorders[] = {CPU_BORDER_CONSTANT, CPU_BORDER_REPLICATE, CPU_BORDER_REFLECT};
+
+// Each sample repeats the rotation for at least this long.
+const double kMinSampleNs = 20e6;
+
+// Remap cache for the cached CPU cases.
+const size_t kCacheBytes = (size_t)256 << 20;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case
+{
+    std::string backend;
+    CpuBorderMode border;
+    bool cached;
+    Size size;
+    double angle;
+
+    std::string name() const
+    {
+        std::ostringstream oName;
+        oName << backend;
+        if (backend == "cpu") {
+            oName << "." << cpuBorderModeName(border) << (cached ? ".cached" : ".uncached");
+        }
+        oName << "." << size.width << "x" << size.height << ".a" << angle;
+        return oName.str();
+    }
+};
+
+struct Summary
+{
+    double n;
+    double mean;                // output Mpixel/s
+    double sd;
+};
+
+Summary summarize(const std::vector<double> &aSamples)
+{
+    Summary oSummary = {(double)aSamples.size(), 0.0, 0.0};
+    for (double sample : aSamples) {
+        oSummary.mean += sample;
+    }
+    oSummary.mean /= aSamples.size();
+    for (double sample : aSamples) {
+        oSummary.sd += (sample - oSummary.mean) * (sample - oSummary.mean);
+    }
+    oSummary.sd = aSamples.size() > 1 ? std::sqrt(oSummary.sd / (aSamples.size() - 1)) : 0.0;
+    return oSummary;
+}
+
+std::vector<double> timeCase(IRotateBackend &rBackend, const Case &rCase, int repetitions)
+{
+    std::vector<Npp8u> aSrc((size_t)rCase.size.width * rCase.size.height);
+    for (size_t i = 0; i < aSrc.size(); ++i) {
+        aSrc[i] = (Npp8u)(i * 2654435761u >> 24);
+    }
+    NppiSize oSrcSize = {rCase.size.width, rCase.size.height};
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, rCase.angle);
+    std::vector<Npp8u> aDst((size_t)oGeometry.bound.width * oGeometry.bound.height);
+
+    auto rotate = [&] {
+        RotateRequest oRequest;
+        oRequest.pSrc = aSrc.data();
+        oRequest.srcStep = rCase.size.width;
+        oRequest.srcWindow = {0, 0, rCase.size.width, rCase.size.height};
+        oRequest.geometry = oGeometry;
+        oRequest.dstROI = oGeometry.bound;
+        oRequest.pDst = aDst.data();
+        oRequest.dstStep = oGeometry.bound.width;
+        rotateSync(rBackend, std::move(oRequest));
+    };
+
+    // The warm-up also builds the remap table of the cached cases
+    rotate();
+    std::vector<double> aSamples;
+    for (int i = 0; i < repetitions; ++i) {
+        Clock::time_point start = Clock::now();
+        double ns = 0.0;
+        size_t count = 0;
+        do {
+            rotate();
+            ++count;
+            ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        } while (ns < kMinSampleNs);
+        aSamples.push_back((double)aDst.size() * count / ns * 1e3);
+    }
+    return aSamples;
+}
+
+bool loadBaseline(const std::string &path, std::map<std::string, Summary> &rBaseline)
+{
+    std::ifstream oFile(path);
+    if (!oFile) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(oFile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream oLine(line);
+        std::string name;
+        Summary oSummary;
+        if (oLine >> name >> oSummary.n >> oSummary.mean >> oSummary.sd) {
+            rBaseline[name] = oSummary;
+        }
+    }
+    return !rBaseline.empty();
+}
+
+bool saveBaseline(const std::string &path, const std::vector<std::pair<std::string, Summary>> &aResults)
+{
+    std::ofstream oFile(path, std::ios::trunc);
+    oFile << "# batchRotateTIFF benchmark baseline, written by --benchmark\n";
+    oFile << "# case samples mean_mpixel_per_s stddev\n";
+    for (const auto &rResult : aResults) {
+        oFile << rResult.first << " " << rResult.second.n << " " << std::setprecision(9) << rResult.second.mean << " "
+              << rResult.second.sd << "\n";
+    }
+    oFile.close();
+    return !oFile.fail();
+}
+
+// Continued fraction of the regularised incomplete beta function
+// (modified Lentz).
+double betaFraction(double a, double b, double x)
+{
+    const double kTiny = 1e-300;
+    double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0);
+    d = 1.0 / (std::fabs(d) < kTiny ? kTiny : d);
+    double h = d;
+    for (int m = 1; m <= 300; ++m) {
+        for (int k = 0; k < 2; ++k) {
+            const double aa = k == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                                     : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1.0 + aa * d;
+            d = 1.0 / (std::fabs(d) < kTiny ? kTiny : d);
+            c = 1.0 + aa / c;
+            c = std::fabs(c) < kTiny ? kTiny : c;
+            h *= c * d;
+            if (k == 1 && std::fabs(c * d - 1.0) < 1e-14) {
+                return h;
+            }
+        }
+    }
+    return h;
+}
+
+double incompleteBeta(double a, double b, double x)
+{
+    if (x <= 0.0) {
+        return 0.0;
+    }
+    if (x >= 1.0) {
+        return 1.0;
+    }
+    const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) +
+                                  b * std::log(1.0 - x));
+    if (x < (a + 1.0) / (a + b + 2.0)) {
+        return front * betaFraction(a, b, x) / a;
+    }
+    return 1.0 - front * betaFraction(b, a, 1.0 - x) / b;
+}
+
+} // namespace
+
+double welchPValue(double mean1, double sd1, double n1, double mean2, double sd2, double n2)
+{
+    const double v1 = n1 > 1 ? sd1 * sd1 / n1 : 0.0;
+    const double v2 = n2 > 1 ? sd2 * sd2 / n2 : 0.0;
+    if (v1 + v2 <= 0.0) {
+        return mean1 > mean2 ? 0.0 : 1.0;
+    }
+
+    const double t = (mean1 - mean2) / std::sqrt(v1 + v2);
+    const double df = (v1 + v2) * (v1 + v2) /
+                      ((n1 > 1 ? v1 * v1 / (n1 - 1) : 0.0) + (n2 > 1 ? v2 * v2 / (n2 - 1) : 0.0));
+
+    // Upper tail of Student's t with df degrees of freedom
+    const double tail = 0.5 * incompleteBeta(df / 2.0, 0.5, df / (df + t * t));
+    return t > 0.0 ? tail : 1.0 - tail;
+}
+
+int runBenchmark(const BenchmarkConfig &rConfig)
+{
+    std::vector<Case> aCases;
+    for (const std::string &backend : rConfig.backends) {
+        for (CpuBorderMode border : kBorders) {
+            for (int cached = 0; cached < 2; ++cached) {
+                if (backend != "cpu" && (border != CPU_BORDER_CONSTANT || cached)) {
+                    continue;
+                }
+                for (const Size &rSize : kSizes) {
+                    for (double angle : kAngles) {
+                        Case oCase = {backend, border, cached != 0, rSize, angle};
+                        aCases.push_back(oCase);
+                    }
+                }
+            }
+        }
+    }
+
+    std::ostringstream oMessage;
+    oMessage << "Benchmark: " << aCases.size() << " cases, " << rConfig.repetitions << " samples each";
+    logInfo(oMessage.str());
+
+    std::vector<std::pair<std::string, Summary>> aResults;
+    std::unique_ptr<IRotateBackend> pBackend;
+    for (size_t i = 0; i < aCases.size(); ++i) {
+        const Case &rCase = aCases[i];
+        if (i == 0 || rCase.backend != aCases[i - 1].backend || rCase.border != aCases[i - 1].border) {
+            BackendOptions oOptions = rConfig.backendOptions;
+            oOptions.border = rCase.border;
+            oOptions.transferMBps = 0.0;
+            pBackend.reset();       // one backend's threads at a time
+            pBackend = createRotateBackend(rCase.backend, oOptions);
+            NPP_ASSERT_MSG(pBackend != nullptr, "Unknown benchmark backend " + rCase.backend);
+        }
+        setRemapCacheLimit(rCase.cached ? kCacheBytes : 0);
+
+        Summary oSummary = summarize(timeCase(*pBackend, rCase, rConfig.repetitions));
+        aResults.push_back(std::make_pair(rCase.name(), oSummary));
+    }
+    pBackend.reset();
+
+    std::map<std::string, Summary> aBaseline;
+    const bool bHaveBaseline = !rConfig.updateBaseline && loadBaseline(rConfig.baselinePath, aBaseline);
+
+    size_t nCompared = 0;
+    for (const auto &rResult : aResults) {
+        nCompared += aBaseline.count(rResult.first);
+    }
+    const double alpha = kRegressionAlpha / std::max<size_t>(1, nCompared);
+
+    int nRegressed = 0;
+    for (const auto &rResult : aResults) {
+        std::ostringstream oLine;
+        oLine << std::fixed << std::setprecision(1) << "  " << std::left << std::setw(44) << rResult.first
+              << std::right << std::setw(9) << rResult.second.mean << " Mpixel/s +- " << std::setw(6)
+              << rResult.second.sd;
+
+        auto baseline = aBaseline.find(rResult.first);
+        if (bHaveBaseline && baseline != aBaseline.end()) {
+            const Summary &rBase = baseline->second;
+            const double change = (rResult.second.mean / rBase.mean - 1.0) * 100.0;
+            const double p = welchPValue(rBase.mean, rBase.sd, rBase.n, rResult.second.mean, rResult.second.sd,
+                                         rResult.second.n);
+            const bool bRegressed = change < -rConfig.thresholdPercent && p < alpha;
+            nRegressed += bRegressed;
+            oLine << "  vs " << std::setw(9) << rBase.mean << ": " << std::showpos << std::setw(6) << change
+                  << std::noshowpos << "%, p=" << std::setprecision(4) << p
+                  << (bRegressed ? "  REGRESSION" : "");
+        } else if (bHaveBaseline) {
+            oLine << "  (not in baseline)";
+        }
+        logInfo(oLine.str());
+    }
+
+    if (!bHaveBaseline) {
+        if (!saveBaseline(rConfig.baselinePath, aResults)) {
+            logError("Unable to write benchmark baseline " + rConfig.baselinePath);
+            return EXIT_FAILURE;
+        }
+        logInfo("Baseline written to " + rConfig.baselinePath);
+        return EXIT_SUCCESS;
+    }
+
+    std::ostringstream oVerdict;
+    oVerdict << "Benchmark: " << nRegressed << " regression(s) beyond " << rConfig.thresholdPercent
+             << "% at p < " << alpha << " per case against " << rConfig.baselinePath;
+    if (nRegressed > 0) {
+        logError(oVerdict.str());
+        return EXIT_FAILURE;
+    }
+    logInfo(oVerdict.str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/* Benchmark mode and regression gate (--benchmark).
+ *
+ * A fixed synthetic workload, every combination of image size, angle,
+ * backend and, on the CPU, sampling path (the border modes, and the remap
+ * cache on or off), is rotated a number of times.  Each repetition yields
+ * one throughput sample in output megapixels per second.  The mean,
+ * standard deviation and sample count of every case are kept in a baseline
+ * file.
+ *
+ * A later run compares its samples with the baseline case by case using
+ * Welch's t-test, which does not assume equal variances.  A case regresses
+ * when its mean throughput is more than the threshold below the baseline
+ * and the one-sided p-value is significant, so noise alone does not fail
+ * the gate and a real slowdown does.  With dozens of cases some would pass
+ * an ordinary significance level by chance, so each is tested at
+ * kRegressionAlpha divided by the number of cases (Bonferroni), which keeps
+ * the false alarm rate of the whole run at kRegressionAlpha.  The run fails
+ * if any case regresses.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "rotateBackend.h"
+
+// Significance level of the regression test over all cases.
+const double kRegressionAlpha = 0.01;
+
+struct BenchmarkConfig
+{
+    std::string baselinePath;
+    bool updateBaseline;        // write the baseline even if one exists
+    double thresholdPercent;    // throughput drop that counts as a regression
+    int repetitions;            // samples per case
+    std::vector<std::string> backends;  // "cpu" and/or "npp"
+    BackendOptions backendOptions;
+};
+
+// Runs the workload, then writes or checks the baseline.  Returns the exit
+// status: EXIT_FAILURE if any case regressed.
+int runBenchmark(const BenchmarkConfig &rConfig);
+
+// One-sided p-value of Welch's t-test that the mean of the first sample is
+// larger than that of the second, from their means, standard deviations
+// and sizes.
+double welchPValue(double mean1, double sd1, double n1, double mean2, double sd2, double n2);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,302 @@
+#include "costModel.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "cpuRotate.h"
+#include "logging.h"
+
+namespace
+{
+
+// Square image sizes timed by the calibration pass.
+const int kSmallSide = 128;
+const int kLargeSide = 1024;
+const double kCalibrationAngle = 30.0;
+const int kRepetitions = 3;
+const size_t kTransferBytes = 16 << 20;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(Clock::time_point start)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+struct Sample
+{
+    double pixels;      // rotated output
+    double bytes;       // source plus output
+    double ns;          // fastest repetition, after one warm-up
+};
+
+Sample timeRotation(IRotateBackend &rBackend, int side)
+{
+    std::vector<Npp8u> aSrc((size_t)side * side);
+    for (size_t i = 0; i < aSrc.size(); ++i) {
+        aSrc[i] = (Npp8u)(i * 2654435761u >> 24);
+    }
+
+    NppiSize oSrcSize = {side, side};
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, kCalibrationAngle);
+    std::vector<Npp8u> aDst((size_t)oGeometry.bound.width * oGeometry.bound.height);
+
+    Sample oSample;
+    oSample.pixels = (double)aDst.size();
+    oSample.bytes = (double)(aSrc.size() + aDst.size());
+    oSample.ns = HUGE_VAL;
+    for (int i = 0; i <= kRepetitions; ++i) {
+        RotateRequest oRequest;
+        oRequest.pSrc = aSrc.data();
+        oRequest.srcStep = side;
+        oRequest.srcWindow = {0, 0, side, side};
+        oRequest.geometry = oGeometry;
+        oRequest.dstROI = oGeometry.bound;
+        oRequest.pDst = aDst.data();
+        oRequest.dstStep = oGeometry.bound.width;
+
+        Clock::time_point start = Clock::now();
+        rotateSync(rBackend, std::move(oRequest));
+        if (i > 0) {
+            oSample.ns = std::min(oSample.ns, elapsedNs(start));
+        }
+    }
+    return oSample;
+}
+
+double timeTransfer()
+{
+    std::vector<unsigned char> aHost(kTransferBytes, 1);
+    void *pDevice = nullptr;
+    NPP_CHECK_CUDA(cudaMalloc(&pDevice, kTransferBytes));
+
+    double best = HUGE_VAL;
+    for (int i = 0; i <= kRepetitions; ++i) {
+        Clock::time_point start = Clock::now();
+        cudaMemcpy(pDevice, aHost.data(), kTransferBytes, cudaMemcpyHostToDevice);
+        cudaMemcpy(aHost.data(), pDevice, kTransferBytes, cudaMemcpyDeviceToHost);
+        if (i > 0) {
+            best = std::min(best, elapsedNs(start));
+        }
+    }
+    cudaFree(pDevice);
+    return best / (2.0 * kTransferBytes);
+}
+
+class AutoRotateBackend : public IRotateBackend
+{
+public:
+    AutoRotateBackend(std::unique_ptr<IRotateBackend> pCpu, std::unique_ptr<IRotateBackend> pDevice,
+                      const CostProfile &rProfile, unsigned int nCpuThreads)
+        : pCpu_(std::move(pCpu))
+        , pDevice_(std::move(pDevice))
+        , profile_(rProfile)
+        , nCpuThreads_(std::max(1u, nCpuThreads))
+        , cpuQueuedPixels_(0)
+        , deviceQueuedPixels_(0)
+        , nCpu_(0)
+        , nDevice_(0)
+    {
+    }
+
+    ~AutoRotateBackend()
+    {
+        // Finish outstanding work before the counts are reported.
+        pCpu_.reset();
+        pDevice_.reset();
+
+        std::ostringstream oMessage;
+        oMessage << "Auto backend: " << nCpu_ << " rotation(s) on cpu, " << nDevice_ << " on npp";
+        logInfo(oMessage.str());
+    }
+
+    void submit(RotateRequest oRequest) override
+    {
+        const double pixels = (double)oRequest.dstROI.width * oRequest.dstROI.height;
+        const double bytes = (double)oRequest.srcWindow.width * oRequest.srcWindow.height + pixels;
+
+        bool bDevice;
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bDevice = chooseDevice(pixels, bytes, 1);
+            (bDevice ? deviceQueuedPixels_ : cpuQueuedPixels_) += pixels;
+            ++(bDevice ? nDevice_ : nCpu_);
+        }
+
+        std::function<void(const RotateCompletion &)> onComplete = std::move(oRequest.onComplete);
+        oRequest.onComplete = [this, bDevice, pixels, onComplete](const RotateCompletion &rCompletion) {
+            {
+                std::lock_guard<std::mutex> oLock(mutex_);
+                (bDevice ? deviceQueuedPixels_ : cpuQueuedPixels_) -= pixels;
+            }
+            onComplete(rCompletion);
+        };
+        (bDevice ? pDevice_ : pCpu_)->submit(std::move(oRequest));
+    }
+
+    void rotateBatch(const std::vector<BatchImage> &aImages) override
+    {
+        double pixels = 0;
+        double bytes = 0;
+        for (const BatchImage &rImage : aImages) {
+            NppiRect oBound = makeRotationGeometry(rImage.srcSize, rImage.angle).bound;
+            double dstPixels = (double)oBound.width * oBound.height;
+            pixels += dstPixels;
+            bytes += (double)rImage.srcSize.width * rImage.srcSize.height + dstPixels;
+        }
+
+        bool bDevice;
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bDevice = chooseDevice(pixels, bytes, (unsigned int)aImages.size());
+            (bDevice ? nDevice_ : nCpu_) += aImages.size();
+        }
+        (bDevice ? pDevice_ : pCpu_)->rotateBatch(aImages);
+    }
+
+    const char *name() const override
+    {
+        return "auto";
+    }
+
+private:
+    // True if work of this size is expected to finish sooner on the device.
+    // A packed batch of nImages is one request on the device but nImages
+    // independent rotations spread over the CPU threads.
+    bool chooseDevice(double pixels, double bytes, unsigned int nImages) const
+    {
+        double cpuThreads = std::min<double>(nCpuThreads_, std::max(1u, nImages));
+        double cpuNs = (cpuQueuedPixels_ / nCpuThreads_ + pixels / cpuThreads) * profile_.cpuNsPerPixel;
+        double deviceNs = profile_.deviceLatencyNs + bytes * profile_.transferNsPerByte +
+                          (deviceQueuedPixels_ + pixels) * profile_.kernelNsPerPixel;
+        return deviceNs < cpuNs;
+    }
+
+    std::unique_ptr<IRotateBackend> pCpu_;
+    std::unique_ptr<IRotateBackend> pDevice_;
+    const CostProfile profile_;
+    const unsigned int nCpuThreads_;
+
+    std::mutex mutex_;
+    double cpuQueuedPixels_;
+    double deviceQueuedPixels_;
+    size_t nCpu_;
+    size_t nDevice_;
+};
+
+} // namespace
+
+bool loadCostProfile(const std::string &path, CostProfile &rProfile)
+{
+    std::ifstream oFile(path);
+    if (!oFile) {
+        return false;
+    }
+
+    int nFound = 0;
+    std::string line;
+    while (std::getline(oFile, line)) {
+        size_t nEquals = line.find('=');
+        if (line.empty() || line[0] == '#' || nEquals == std::string::npos) {
+            continue;
+        }
+
+        std::string key = line.substr(0, nEquals);
+        double value = atof(line.c_str() + nEquals + 1);
+        if (key == "cpu_ns_per_pixel") {
+            rProfile.cpuNsPerPixel = value;
+        } else if (key == "device_latency_ns") {
+            rProfile.deviceLatencyNs = value;
+        } else if (key == "transfer_ns_per_byte") {
+            rProfile.transferNsPerByte = value;
+        } else if (key == "kernel_ns_per_pixel") {
+            rProfile.kernelNsPerPixel = value;
+        } else {
+            continue;
+        }
+        ++nFound;
+    }
+    return nFound == 4;
+}
+
+bool saveCostProfile(const std::string &path, const CostProfile &rProfile)
+{
+    std::ofstream oFile(path, std::ios::trunc);
+    oFile << "# batchRotateTIFF cost model profile, written by the calibration pass\n";
+    oFile << "cpu_ns_per_pixel=" << rProfile.cpuNsPerPixel << "\n";
+    oFile << "device_latency_ns=" << rProfile.deviceLatencyNs << "\n";
+    oFile << "transfer_ns_per_byte=" << rProfile.transferNsPerByte << "\n";
+    oFile << "kernel_ns_per_pixel=" << rProfile.kernelNsPerPixel << "\n";
+    oFile.close();
+    return !oFile.fail();
+}
+
+CostProfile calibrateCostProfile(IRotateBackend &rCpu, IRotateBackend &rDevice)
+{
+    CostProfile oProfile;
+
+    // A straight line through a small and a large image separates the
+    // per-request cost from the per-pixel cost.  The repetitions would run
+    // from a cached remap table, which images of differing geometry never
+    // get, so the CPU is timed with the cache off.
+    const size_t cacheLimit = remapCacheLimit();
+    setRemapCacheLimit(0);
+    Sample oCpuSmall, oCpuLarge;
+    try {
+        oCpuSmall = timeRotation(rCpu, kSmallSide);
+        oCpuLarge = timeRotation(rCpu, kLargeSide);
+    }
+    catch (...) {
+        setRemapCacheLimit(cacheLimit);
+        throw;
+    }
+    setRemapCacheLimit(cacheLimit);
+    oProfile.cpuNsPerPixel = std::max(1e-3, (oCpuLarge.ns - oCpuSmall.ns) / (oCpuLarge.pixels - oCpuSmall.pixels));
+
+    oProfile.transferNsPerByte = timeTransfer();
+
+    Sample oDeviceSmall = timeRotation(rDevice, kSmallSide);
+    Sample oDeviceLarge = timeRotation(rDevice, kLargeSide);
+    double smallNs = oDeviceSmall.ns - oDeviceSmall.bytes * oProfile.transferNsPerByte;
+    double largeNs = oDeviceLarge.ns - oDeviceLarge.bytes * oProfile.transferNsPerByte;
+    oProfile.kernelNsPerPixel = std::max(1e-6, (largeNs - smallNs) / (oDeviceLarge.pixels - oDeviceSmall.pixels));
+    oProfile.deviceLatencyNs = std::max(0.0, smallNs - oProfile.kernelNsPerPixel * oDeviceSmall.pixels);
+
+    return oProfile;
+}
+
+std::unique_ptr<IRotateBackend> createAutoBackend(const BackendOptions &rOptions)
+{
+    BackendOptions oCpuOptions = rOptions;
+    oCpuOptions.transferMBps = 0.0;
+    std::unique_ptr<IRotateBackend> pCpu = createRotateBackend("cpu", oCpuOptions);
+    std::unique_ptr<IRotateBackend> pDevice = createRotateBackend("npp", rOptions);
+
+    CostProfile oProfile;
+    if (rOptions.recalibrate || !loadCostProfile(rOptions.profilePath, oProfile)) {
+        logInfo("Calibrating the cost model...");
+        oProfile = calibrateCostProfile(*pCpu, *pDevice);
+        if (!saveCostProfile(rOptions.profilePath, oProfile)) {
+            logError("Unable to write cost model profile " + rOptions.profilePath);
+        }
+    }
+
+    std::ostringstream oMessage;
+    oMessage << "Cost model: cpu " << oProfile.cpuNsPerPixel << " ns/pixel per thread, device latency "
+             << oProfile.deviceLatencyNs / 1000.0 << " us, transfer " << oProfile.transferNsPerByte
+             << " ns/byte, kernel " << oProfile.kernelNsPerPixel << " ns/pixel";
+    logInfo(oMessage.str());
+
+    return std::unique_ptr<IRotateBackend>(
+        new AutoRotateBackend(std::move(pCpu), std::move(pDevice), oProfile, rOptions.cpuThreads));
+}
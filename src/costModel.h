@@ -0,0 +1,45 @@
+/* Cost model behind --backend=auto.
+ *
+ * Each rotation is sent to whichever of the CPU and NPP backends is expected
+ * to finish it first.  The estimate for the device is a fixed per-request
+ * latency, plus the bytes crossing the bus, plus the kernel time for the
+ * pixels already queued there and for this request.  For the CPU it is the
+ * queued pixels and this request's pixels at the calibrated rate, shared
+ * across the compute threads.  Small images are dominated by the copies
+ * and the latency and stay on the CPU, while large ones go to the device.
+ *
+ * The constants come from a calibration pass that times both backends on
+ * synthetic images and are kept in a small profile file, so later runs
+ * start at once.
+ */
+
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include <memory>
+#include <string>
+
+#include "rotateBackend.h"
+
+struct CostProfile
+{
+    double cpuNsPerPixel;       // one compute thread
+    double deviceLatencyNs;     // per request, launch and synchronisation
+    double transferNsPerByte;   // host <-> device, either direction
+    double kernelNsPerPixel;
+};
+
+// Reads a profile written by saveCostProfile().  Returns false if the file is
+// missing or incomplete.
+bool loadCostProfile(const std::string &path, CostProfile &rProfile);
+bool saveCostProfile(const std::string &path, const CostProfile &rProfile);
+
+// Times both backends on synthetic images.
+CostProfile calibrateCostProfile(IRotateBackend &rCpu, IRotateBackend &rDevice);
+
+// Backend that routes every request to rCpu or rDevice by the cost model.
+// Loads rOptions.profilePath, calibrating and saving it first if needed or
+// if rOptions.recalibrate is set.
+std::unique_ptr<IRotateBackend> createAutoBackend(const BackendOptions &rOptions);
+
+#endif // COST_MODEL_H
@@ -0,0 +1,579 @@
+#include "cpuRotate.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "perfCounters.h"
+
+namespace
+{
+
+// Tolerance for source positions that land on the ROI edge after rounding.
+const double kEdgeEpsilon = 1e-9;
+
+// Distance kept between the interior span and the positions where bounds
+// checks start to matter; covers the drift of the incremental walk.
+const double kInteriorMargin = 1e-3;
+
+// Weights are fixed point with kWeightBits fractional bits; enough that the
+// integer blend rounds like a floating point one except near ties.
+const int kWeightBits = 24;
+const int64_t kWeightOne = (int64_t)1 << kWeightBits;
+
+// Source offsets and weights of destination pixels, kept as separate arrays
+// so the interior can be blended eight pixels at a time.  A zero weight means
+// the right or lower neighbour is not read, which is always the case on the
+// last source row and column.
+struct RemapRun
+{
+    std::vector<int32_t> aOffsets;
+    std::vector<uint32_t> aWx;
+    std::vector<uint32_t> aWy;
+
+    size_t size() const
+    {
+        return aOffsets.size();
+    }
+
+    void clear()
+    {
+        aOffsets.clear();
+        aWx.clear();
+        aWy.clear();
+    }
+
+    void shrink()
+    {
+        aOffsets.shrink_to_fit();
+        aWx.shrink_to_fit();
+        aWy.shrink_to_fit();
+    }
+};
+
+// The destination pixels of one row that are written are one run; entries
+// [interiorBegin, interiorEnd) of it are interior samples.
+struct RemapRow
+{
+    int begin;                  // first column, relative to the ROI
+    int count;
+    int interiorBegin;
+    int interiorEnd;
+    size_t first;               // index of its first entry
+};
+
+struct RemapTable
+{
+    std::vector<RemapRow> aRows;
+    RemapRun oRun;
+
+    size_t bytes() const
+    {
+        return aRows.size() * sizeof(RemapRow)
+             + oRun.size() * (sizeof(int32_t) + 2 * sizeof(uint32_t));
+    }
+
+    // Upper bound on bytes() for a table over oDstROI, every pixel mapped.
+    static size_t maxBytes(const NppiRect &oDstROI)
+    {
+        return (size_t)oDstROI.height * sizeof(RemapRow)
+             + (size_t)oDstROI.width * oDstROI.height * (sizeof(int32_t) + 2 * sizeof(uint32_t));
+    }
+};
+
+inline Npp8u blend(const Npp8u *pSrc, int64_t offset, uint32_t nWx, uint32_t nWy, int nSrcStep)
+{
+    const Npp8u *p00 = pSrc + offset;
+    const Npp8u *p01 = p00 + (nWx != 0);
+    const Npp8u *p10 = p00 + (nWy != 0 ? nSrcStep : 0);
+    const Npp8u *p11 = p10 + (nWx != 0);
+
+    const int64_t wx = nWx;
+    const int64_t wy = nWy;
+    int64_t top = *p00 * (kWeightOne - wx) + *p01 * wx;
+    int64_t bottom = *p10 * (kWeightOne - wx) + *p11 * wx;
+    int64_t value = top * (kWeightOne - wy) + bottom * wy;
+    return (Npp8u)((value + ((int64_t)1 << (2 * kWeightBits - 1))) >> (2 * kWeightBits));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Blends the leading multiple of eight entries with AVX2 and returns how many
+// it wrote.  Every entry must be an interior sample: both neighbours are
+// read unconditionally, four bytes at a time.
+__attribute__((target("avx2")))
+int blendRunAVX2(const Npp8u *pSrc, int nSrcStep, const int32_t *pOffsets, const uint32_t *pWx,
+                 const uint32_t *pWy, int count, Npp8u *pDst)
+{
+    const __m256i kLowByte = _mm256_set1_epi32(0xFF);
+    const __m256i kOne = _mm256_set1_epi32((int)kWeightOne);
+    const __m256i kRound = _mm256_set1_epi64x((int64_t)1 << (2 * kWeightBits - 1));
+    const __m256i kStep = _mm256_set1_epi32(nSrcStep);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i offset = _mm256_loadu_si256((const __m256i *)(pOffsets + i));
+        __m256i wx = _mm256_loadu_si256((const __m256i *)(pWx + i));
+        __m256i wy = _mm256_loadu_si256((const __m256i *)(pWy + i));
+        __m256i upper = _mm256_i32gather_epi32((const int *)pSrc, offset, 1);
+        __m256i lower = _mm256_i32gather_epi32((const int *)pSrc, _mm256_add_epi32(offset, kStep), 1);
+
+        // Rows fit 32 bits unsigned (255 << 24), their blend needs 64
+        __m256i ix = _mm256_sub_epi32(kOne, wx);
+        __m256i top = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(upper, kLowByte), ix),
+                                       _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(upper, 8), kLowByte), wx));
+        __m256i bottom = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(lower, kLowByte), ix),
+                                          _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(lower, 8), kLowByte), wx));
+        __m256i iy = _mm256_sub_epi32(kOne, wy);
+
+        __m256i even = _mm256_add_epi64(_mm256_mul_epu32(top, iy), _mm256_mul_epu32(bottom, wy));
+        __m256i odd = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(top, 32), _mm256_srli_epi64(iy, 32)),
+                                       _mm256_mul_epu32(_mm256_srli_epi64(bottom, 32), _mm256_srli_epi64(wy, 32)));
+        even = _mm256_srli_epi64(_mm256_add_epi64(even, kRound), 2 * kWeightBits);
+        odd = _mm256_srli_epi64(_mm256_add_epi64(odd, kRound), 2 * kWeightBits);
+
+        __m256i value = _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+        value = _mm256_packus_epi32(value, value);
+        value = _mm256_packus_epi16(value, value);
+        uint32_t aBytes[2] = {(uint32_t)_mm256_extract_epi32(value, 0), (uint32_t)_mm256_extract_epi32(value, 4)};
+        memcpy(pDst + i, aBytes, sizeof(aBytes));
+    }
+    return i;
+}
+
+const bool kHaveAVX2 = __builtin_cpu_supports("avx2");
+
+#endif
+
+// Blends count interior entries.
+void blendInterior(const Npp8u *pSrc, int nSrcStep, const int32_t *pOffsets, const uint32_t *pWx,
+                   const uint32_t *pWy, int count, Npp8u *pDst)
+{
+    int i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (kHaveAVX2) {
+        i = blendRunAVX2(pSrc, nSrcStep, pOffsets, pWx, pWy, count, pDst);
+    }
+#endif
+    for (; i < count; ++i) {
+        pDst[i] = blend(pSrc, pOffsets[i], pWx[i], pWy[i], nSrcStep);
+    }
+}
+
+// Writes the run of rRow to pRow, which points at the row's first ROI column.
+void blendRow(const Npp8u *pSrc, int nSrcStep, const RemapRun &rRun, const RemapRow &rRow, Npp8u *pRow)
+{
+    const int32_t *pOffsets = rRun.aOffsets.data() + rRow.first;
+    const uint32_t *pWx = rRun.aWx.data() + rRow.first;
+    const uint32_t *pWy = rRun.aWy.data() + rRow.first;
+    pRow += rRow.begin;
+
+    for (int i = 0; i < rRow.interiorBegin; ++i) {
+        pRow[i] = blend(pSrc, pOffsets[i], pWx[i], pWy[i], nSrcStep);
+    }
+    const int i0 = rRow.interiorBegin;
+    blendInterior(pSrc, nSrcStep, pOffsets + i0, pWx + i0, pWy + i0, rRow.interiorEnd - i0, pRow + i0);
+    for (int i = rRow.interiorEnd; i < rRow.count; ++i) {
+        pRow[i] = blend(pSrc, pOffsets[i], pWx[i], pWy[i], nSrcStep);
+    }
+}
+
+// Position of tap i on an axis whose pixels run from lo to hi.
+int borderIndex(int i, int lo, int hi, CpuBorderMode eBorder)
+{
+    if (eBorder == CPU_BORDER_REPLICATE) {
+        return std::min(std::max(i, lo), hi);
+    }
+    const int n = hi - lo + 1;
+    int k = (i - lo) % (2 * n);
+    if (k < 0) {
+        k += 2 * n;
+    }
+    return lo + (k < n ? k : 2 * n - 1 - k);
+}
+
+// Samples one axis outside the source: the left tap and the weight of its
+// right neighbour, after both taps went through the border mode.
+void borderTaps(double x, int lo, int hi, CpuBorderMode eBorder, int &rTap, uint32_t &rWeight)
+{
+    double base = std::floor(x);
+    int64_t weight = std::lround((x - base) * kWeightOne);
+    int i = (int)std::max(std::min(base, (double)INT32_MAX - 1), (double)INT32_MIN + 1);
+    if (weight == kWeightOne) {
+        ++i;
+        weight = 0;
+    }
+
+    const int a = borderIndex(i, lo, hi, eBorder);
+    const int b = borderIndex(i + 1, lo, hi, eBorder);
+    rTap = a;
+    if (weight == 0 || a == b) {
+        rWeight = 0;
+    } else if (b == a + 1) {
+        rWeight = (uint32_t)weight;
+    } else {
+        // Mirrored: blend the same two pixels from the other side
+        rTap = b;
+        rWeight = (uint32_t)(kWeightOne - weight);
+    }
+}
+
+// Walks destination rows and produces the sample of every pixel that gets
+// written.  Each row is split analytically into an interior span, whose
+// samples and their neighbours lie inside the source with room for a four
+// byte read, and border spans on either side that go through the checks.
+class RowSampler
+{
+public:
+    RowSampler(NppiSize oSrcSize, int nSrcStep, NppiRect oSrcROI, NppiRect oDstROI, double nAngle,
+               double nShiftX, double nShiftY, CpuBorderMode eBorder)
+        : nSrcStep_(nSrcStep)
+        , oSrcROI_(oSrcROI)
+        , oDstROI_(oDstROI)
+        , nShiftX_(nShiftX)
+        , nShiftY_(nShiftY)
+        , eBorder_(eBorder)
+    {
+        const double kRadians = nAngle * M_PI / 180.0;
+        c_ = std::cos(kRadians);
+        s_ = std::sin(kRadians);
+
+        maxX_ = std::min(oSrcROI.x + oSrcROI.width, oSrcSize.width) - 1;
+        maxY_ = std::min(oSrcROI.y + oSrcROI.height, oSrcSize.height) - 1;
+    }
+
+    // Calls emit(u, offset, wx, wy, bInterior) for the written pixels of
+    // row v, left to right.
+    template <typename Emit>
+    void sampleRow(int v, Emit emit) const
+    {
+        // Inverse mapping, see rotateGeometry.h; x and y advance by (c, s)
+        // per destination column.
+        const double du = oDstROI_.x - nShiftX_;
+        const double dv = v - nShiftY_;
+        double x = c_ * du - s_ * dv;
+        double y = s_ * du + c_ * dv;
+
+        int interiorBegin, interiorEnd;
+        interiorSpan(x, y, interiorBegin, interiorEnd);
+
+        int k = 0;
+        for (; k < interiorBegin; ++k, x += c_, y += s_) {
+            sampleBorder(oDstROI_.x + k, x, y, emit);
+        }
+        for (; k < interiorEnd; ++k, x += c_, y += s_) {
+            const int x0 = (int)(x + kEdgeEpsilon);
+            const int y0 = (int)(y + kEdgeEpsilon);
+            emit(oDstROI_.x + k, (int64_t)y0 * nSrcStep_ + x0, (uint32_t)std::lround(std::max(0.0, x - x0) * kWeightOne),
+                 (uint32_t)std::lround(std::max(0.0, y - y0) * kWeightOne), true);
+        }
+        for (; k < oDstROI_.width; ++k, x += c_, y += s_) {
+            sampleBorder(oDstROI_.x + k, x, y, emit);
+        }
+    }
+
+private:
+    // Narrows [rLo, rHi] to the steps k for which lo <= start + step * k <= hi.
+    static void clip(double start, double step, double lo, double hi, double &rLo, double &rHi)
+    {
+        if (std::fabs(step) < 1e-12) {
+            if (start < lo || start > hi) {
+                rHi = -1.0;
+            }
+            return;
+        }
+        double a = (lo - start) / step;
+        double b = (hi - start) / step;
+        rLo = std::max(rLo, std::min(a, b));
+        rHi = std::min(rHi, std::max(a, b));
+    }
+
+    // Columns [rBegin, rEnd) of the row starting at (x, y) are interior.
+    void interiorSpan(double x, double y, int &rBegin, int &rEnd) const
+    {
+        double lo = 0.0;
+        double hi = oDstROI_.width - 1.0;
+        clip(x, c_, oSrcROI_.x + kInteriorMargin, maxX_ - 2 - kInteriorMargin, lo, hi);
+        clip(y, s_, oSrcROI_.y + kInteriorMargin, maxY_ - 1 - kInteriorMargin, lo, hi);
+        if (lo > hi) {
+            rBegin = rEnd = oDstROI_.width;
+            return;
+        }
+        rBegin = (int)std::ceil(lo);
+        rEnd = std::max(rBegin, (int)std::floor(hi) + 1);
+    }
+
+    template <typename Emit>
+    void sampleBorder(int u, double x, double y, Emit &emit) const
+    {
+        const bool bInside = x >= oSrcROI_.x - kEdgeEpsilon && y >= oSrcROI_.y - kEdgeEpsilon
+                          && x <= maxX_ + kEdgeEpsilon && y <= maxY_ + kEdgeEpsilon;
+        if (bInside) {
+            int x0 = std::min((int)std::floor(x + kEdgeEpsilon), maxX_);
+            int y0 = std::min((int)std::floor(y + kEdgeEpsilon), maxY_);
+            double fx = x0 < maxX_ ? std::max(0.0, x - x0) : 0.0;
+            double fy = y0 < maxY_ ? std::max(0.0, y - y0) : 0.0;
+            emit(u, (int64_t)y0 * nSrcStep_ + x0, (uint32_t)std::lround(fx * kWeightOne),
+                 (uint32_t)std::lround(fy * kWeightOne), false);
+        } else if (eBorder_ != CPU_BORDER_CONSTANT) {
+            int x0, y0;
+            uint32_t wx, wy;
+            borderTaps(x, oSrcROI_.x, maxX_, eBorder_, x0, wx);
+            borderTaps(y, oSrcROI_.y, maxY_, eBorder_, y0, wy);
+            emit(u, (int64_t)y0 * nSrcStep_ + x0, wx, wy, false);
+        }
+    }
+
+    int nSrcStep_;
+    NppiRect oSrcROI_;
+    NppiRect oDstROI_;
+    double nShiftX_;
+    double nShiftY_;
+    CpuBorderMode eBorder_;
+    double c_;
+    double s_;
+    int maxX_;
+    int maxY_;
+};
+
+// Samples row v onto the end of rRun and describes it in rRow.
+void appendRow(const RowSampler &rSampler, int v, int dstX, RemapRun &rRun, RemapRow &rRow)
+{
+    rRow = RemapRow{0, 0, 0, 0, rRun.size()};
+    rSampler.sampleRow(v, [&](int u, int64_t offset, uint32_t wx, uint32_t wy, bool bInterior) {
+        if (rRow.count == 0) {
+            rRow.begin = u - dstX;
+        }
+        if (bInterior) {
+            if (rRow.interiorEnd == 0) {
+                rRow.interiorBegin = rRow.count;
+            }
+            rRow.interiorEnd = rRow.count + 1;
+        }
+        ++rRow.count;
+        rRun.aOffsets.push_back((int32_t)offset);
+        rRun.aWx.push_back(wx);
+        rRun.aWy.push_back(wy);
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Remap table cache
+
+typedef std::tuple<int, int, int, int, int, int, int, int, int, int, int, double, double, double, int, int> RemapKey;
+
+class RemapCache
+{
+public:
+    RemapCache()
+        : nLimit_((size_t)256 << 20)
+        , nBytes_(0)
+        , oStats_{0, 0, 0}
+    {
+    }
+
+    void setLimit(size_t nBytes)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        nLimit_ = nBytes;
+        evict();
+    }
+
+    size_t limit()
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        return nLimit_;
+    }
+
+    // The cached table for oKey.  A geometry seen for the first time is
+    // only remembered: tiles and ROI windows rarely repeat, and building a
+    // table costs more than one direct rotation.  Nor is a table built
+    // whose worst case over oDstROI would not fit the limit, as it could
+    // never be kept.
+    std::shared_ptr<const RemapTable> find(const RemapKey &oKey, const NppiRect &oDstROI, bool &rBuild)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        rBuild = false;
+        auto it = tables_.find(oKey);
+        if (it != tables_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            ++oStats_.reused;
+            return it->second.pTable;
+        }
+        if (RemapTable::maxBytes(oDstROI) <= nLimit_) {
+            if (seen_.size() > 4096) {
+                seen_.clear();
+            }
+            rBuild = !seen_.insert(oKey).second;
+        }
+        return nullptr;
+    }
+
+    void insert(const RemapKey &oKey, std::shared_ptr<const RemapTable> pTable)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        seen_.erase(oKey);
+        if (pTable->bytes() > nLimit_ || tables_.count(oKey)) {
+            return;
+        }
+        lru_.push_front(oKey);
+        tables_[oKey] = Entry{pTable, lru_.begin()};
+        nBytes_ += pTable->bytes();
+        ++oStats_.built;
+        evict();
+    }
+
+    RemapCacheStats stats()
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        return oStats_;
+    }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const RemapTable> pTable;
+        std::list<RemapKey>::iterator position;
+    };
+
+    // Drops least recently used tables until the cache fits its limit.
+    // Tables still in use live on in their users' shared_ptr.
+    void evict()
+    {
+        while (nBytes_ > nLimit_ && !lru_.empty()) {
+            auto it = tables_.find(lru_.back());
+            nBytes_ -= it->second.pTable->bytes();
+            tables_.erase(it);
+            lru_.pop_back();
+            ++oStats_.evicted;
+        }
+    }
+
+    std::mutex mutex_;
+    size_t nLimit_;
+    size_t nBytes_;
+    std::list<RemapKey> lru_;
+    std::map<RemapKey, Entry> tables_;
+    std::set<RemapKey> seen_;
+    RemapCacheStats oStats_;
+};
+
+RemapCache &remapCache()
+{
+    static RemapCache s_cache;
+    return s_cache;
+}
+
+std::shared_ptr<const RemapTable> buildRemapTable(const RowSampler &rSampler, NppiRect oDstROI)
+{
+    std::shared_ptr<RemapTable> pTable(new RemapTable());
+    pTable->aRows.resize(oDstROI.height);
+    for (int r = 0; r < oDstROI.height; ++r) {
+        appendRow(rSampler, oDstROI.y + r, oDstROI.x, pTable->oRun, pTable->aRows[r]);
+    }
+    pTable->oRun.shrink();
+    return pTable;
+}
+
+} // namespace
+
+bool parseCpuBorderMode(const std::string &name, CpuBorderMode &rMode)
+{
+    if (name == "constant") {
+        rMode = CPU_BORDER_CONSTANT;
+    } else if (name == "replicate") {
+        rMode = CPU_BORDER_REPLICATE;
+    } else if (name == "reflect") {
+        rMode = CPU_BORDER_REFLECT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *cpuBorderModeName(CpuBorderMode mode)
+{
+    switch (mode) {
+    case CPU_BORDER_REPLICATE:
+        return "replicate";
+    case CPU_BORDER_REFLECT:
+        return "reflect";
+    default:
+        return "constant";
+    }
+}
+
+void cpuRotate_8u_C1R(const Npp8u *pSrc, NppiSize oSrcSize, int nSrcStep, NppiRect oSrcROI,
+                      Npp8u *pDst, int nDstStep, NppiRect oDstROI,
+                      double nAngle, double nShiftX, double nShiftY, CpuBorderMode eBorder)
+{
+    PerfScope oPerf(PERF_STAGE_ROTATE, (size_t)oDstROI.width * oDstROI.height);
+    const RowSampler oSampler(oSrcSize, nSrcStep, oSrcROI, oDstROI, nAngle, nShiftX, nShiftY, eBorder);
+
+    // Offsets in a run are 32 bit; larger sources are blended straight from
+    // the sampler.
+    if ((int64_t)nSrcStep * oSrcSize.height >= INT32_MAX) {
+        for (int v = oDstROI.y; v < oDstROI.y + oDstROI.height; ++v) {
+            oSampler.sampleRow(v, [&](int u, int64_t offset, uint32_t wx, uint32_t wy, bool) {
+                pDst[(size_t)v * nDstStep + u] = blend(pSrc, offset, wx, wy, nSrcStep);
+            });
+        }
+        return;
+    }
+
+    std::shared_ptr<const RemapTable> pTable;
+    RemapKey oKey(oSrcSize.width, oSrcSize.height, nSrcStep, oSrcROI.x, oSrcROI.y, oSrcROI.width,
+                  oSrcROI.height, oDstROI.x, oDstROI.y, oDstROI.width, oDstROI.height, nAngle, nShiftX,
+                  nShiftY, NPPI_INTER_LINEAR, eBorder);
+    bool bBuild;
+    pTable = remapCache().find(oKey, oDstROI, bBuild);
+    if (!pTable && bBuild) {
+        pTable = buildRemapTable(oSampler, oDstROI);
+        remapCache().insert(oKey, pTable);
+    }
+
+    if (pTable) {
+        for (int r = 0; r < oDstROI.height; ++r) {
+            Npp8u *pRow = pDst + (size_t)(oDstROI.y + r) * nDstStep + oDstROI.x;
+            blendRow(pSrc, nSrcStep, pTable->oRun, pTable->aRows[r], pRow);
+        }
+        return;
+    }
+
+    // One row at a time through a scratch run
+    thread_local RemapRun s_run;
+    for (int v = oDstROI.y; v < oDstROI.y + oDstROI.height; ++v) {
+        RemapRow oRow;
+        s_run.clear();
+        appendRow(oSampler, v, oDstROI.x, s_run, oRow);
+        blendRow(pSrc, nSrcStep, s_run, oRow, pDst + (size_t)v * nDstStep + oDstROI.x);
+    }
+}
+
+void setRemapCacheLimit(size_t nBytes)
+{
+    remapCache().setLimit(nBytes);
+}
+
+size_t remapCacheLimit()
+{
+    return remapCache().limit();
+}
+
+RemapCacheStats remapCacheStats()
+{
+    return remapCache().stats();
+}
@@ -0,0 +1,62 @@
+/* Host implementation of the rotation kernel, used by the CPU backend.
+ *
+ * Same contract as nppiRotate_8u_C1R with NPPI_INTER_LINEAR: every
+ * destination pixel of oDstROI whose source position falls inside oSrcROI
+ * is bilinearly interpolated; the others are left untouched.  Weights are
+ * quantised to 24 bits and blended in integer arithmetic, so a value close
+ * to a rounding tie can come out one level away from NPP's.
+ *
+ * Each destination row is split analytically into border spans and an
+ * interior span whose samples and right/lower neighbours are all inside
+ * the source.  The interior is sampled without bounds checks and blended
+ * with AVX2 gathers where the CPU has them; only the edges go through the
+ * clamped path, which also implements the border modes.
+ *
+ * Datasets of equally sized images rotated by one angle repeat the same
+ * coordinate transform for every image.  The second time a geometry is
+ * seen, its remap table (source offset and quantised weights of every
+ * destination pixel) is built and kept in an LRU cache, and from then on
+ * the rotation is a table-driven gather and blend.  Both paths produce
+ * identical pixels.
+ */
+
+#ifndef CPU_ROTATE_H
+#define CPU_ROTATE_H
+
+#include <npp.h>
+
+#include <stddef.h>
+
+#include <string>
+
+// What destination pixels that map outside the source receive.
+enum CpuBorderMode
+{
+    CPU_BORDER_CONSTANT,        // left untouched (background), as NPP does
+    CPU_BORDER_REPLICATE,       // nearest edge pixel
+    CPU_BORDER_REFLECT          // source mirrored at its edges: cba|abc|cba
+};
+
+// Parses "constant", "replicate" or "reflect".
+bool parseCpuBorderMode(const std::string &name, CpuBorderMode &rMode);
+const char *cpuBorderModeName(CpuBorderMode mode);
+
+void cpuRotate_8u_C1R(const Npp8u *pSrc, NppiSize oSrcSize, int nSrcStep, NppiRect oSrcROI,
+                      Npp8u *pDst, int nDstStep, NppiRect oDstROI,
+                      double nAngle, double nShiftX, double nShiftY,
+                      CpuBorderMode eBorder = CPU_BORDER_CONSTANT);
+
+// Bytes of remap tables kept; 0 disables the cache.
+void setRemapCacheLimit(size_t nBytes);
+size_t remapCacheLimit();
+
+struct RemapCacheStats
+{
+    size_t built;
+    size_t reused;              // rotations run from a cached table
+    size_t evicted;
+};
+
+RemapCacheStats remapCacheStats();
+
+#endif // CPU_ROTATE_H
@@ -0,0 +1,369 @@
+#include "daemon.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <rotateDaemonProtocol.h>
+
+#include "asyncIO.h"
+#include "logging.h"
+#include "rotateEngine.h"
+#include "rotateGeometry.h"
+
+namespace
+{
+
+volatile sig_atomic_t g_stop = 0;
+
+void onSignal(int)
+{
+    g_stop = 1;
+}
+
+const uint32_t kMaxPathLength = 4096;
+// Largest pixel job, source and rotated output alike.  UtilNPP sizes its
+// host buffers with 32-bit arithmetic, so this stays well below 2^32.
+const uint64_t kMaxPixels = (uint64_t)1 << 30;
+
+bool readFully(int fd, void *pData, size_t nBytes)
+{
+    char *p = static_cast<char *>(pData);
+    while (nBytes > 0) {
+        ssize_t n = read(fd, p, nBytes);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        nBytes -= n;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const void *pData, size_t nBytes)
+{
+    const char *p = static_cast<const char *>(pData);
+    while (nBytes > 0) {
+        ssize_t n = send(fd, p, nBytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        nBytes -= n;
+    }
+    return true;
+}
+
+bool sendResponse(int fd, int status, const std::string &message, const npp::ImageCPU_8u_C1 *pImage = nullptr)
+{
+    DaemonResponse oResponse;
+    memset(&oResponse, 0, sizeof(oResponse));
+    oResponse.magic = ROTATE_DAEMON_RESPONSE_MAGIC;
+    oResponse.status = status;
+    oResponse.messageLength = (uint32_t)message.size();
+    if (pImage) {
+        oResponse.width = pImage->width();
+        oResponse.height = pImage->height();
+        oResponse.payloadBytes = (uint64_t)pImage->width() * pImage->height();
+    }
+
+    if (!writeFully(fd, &oResponse, sizeof(oResponse)) || !writeFully(fd, message.data(), message.size())) {
+        return false;
+    }
+    if (pImage) {
+        for (unsigned int y = 0; y < pImage->height(); ++y) {
+            if (!writeFully(fd, pImage->data(0, y), pImage->width())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Serves one request.  Returns false when the connection should be closed,
+// either because the client hung up or because the stream cannot be trusted
+// any more.
+bool serveRequest(int fd)
+{
+    DaemonRequest oRequest;
+    if (!readFully(fd, &oRequest, sizeof(oRequest))) {
+        return false;
+    }
+
+    if (oRequest.magic != ROTATE_DAEMON_REQUEST_MAGIC || oRequest.version != ROTATE_DAEMON_VERSION) {
+        sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "unsupported protocol");
+        return false;
+    }
+
+    NppiRect oROI = {oRequest.roi[0], oRequest.roi[1], oRequest.roi[2], oRequest.roi[3]};
+    const NppiRect *pROI = nullptr;
+    if (oRequest.flags & ROTATE_JOB_ROI) {
+        if (isEmptyRect(oROI)) {
+            sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "empty ROI");
+            return false;
+        }
+        pROI = &oROI;
+    }
+
+    if (oRequest.kind == ROTATE_JOB_PATHS) {
+        if (oRequest.inputPathLength == 0 || oRequest.inputPathLength > kMaxPathLength ||
+            oRequest.outputPathLength == 0 || oRequest.outputPathLength > kMaxPathLength) {
+            sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "bad path length");
+            return false;
+        }
+
+        std::string inputPath(oRequest.inputPathLength, '\0');
+        std::string outputPath(oRequest.outputPathLength, '\0');
+        if (!readFully(fd, &inputPath[0], inputPath.size()) || !readFully(fd, &outputPath[0], outputPath.size())) {
+            return false;
+        }
+
+        std::vector<unsigned char> encoded;
+        if (!processImage(inputPath, nullptr, outputPath, oRequest.angle, pROI, encoded)) {
+            return sendResponse(fd, ROTATE_STATUS_FAILED, "rotation failed, see the daemon log");
+        }
+        if (writeFileAtomically(outputPath, encoded) != 0) {
+            return sendResponse(fd, ROTATE_STATUS_FAILED, "unable to write " + outputPath);
+        }
+        return sendResponse(fd, ROTATE_STATUS_OK, "");
+    }
+
+    if (oRequest.kind == ROTATE_JOB_PIXELS) {
+        uint64_t nPixels = (uint64_t)oRequest.width * oRequest.height;
+        if (oRequest.width == 0 || oRequest.height == 0 || nPixels > kMaxPixels ||
+            oRequest.width > 0x7fffffff || oRequest.height > 0x7fffffff) {
+            sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "bad image size");
+            return false;
+        }
+        if (rotatedPixelBound(oRequest.width, oRequest.height, oRequest.angle, pROI) > kMaxPixels) {
+            sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "rotated image too large");
+            return false;
+        }
+
+        // The pixels are left unread if the buffer cannot be had, so the
+        // connection is closed
+        npp::ImageCPU_8u_C1 oSrc;
+        try {
+            npp::ImageCPU_8u_C1 oBuffer(oRequest.width, oRequest.height);
+            oSrc.swap(oBuffer);
+        }
+        catch (...) {
+            sendResponse(fd, ROTATE_STATUS_FAILED, "out of memory");
+            return false;
+        }
+        for (unsigned int y = 0; y < oRequest.height; ++y) {
+            if (!readFully(fd, oSrc.data(0, y), oRequest.width)) {
+                return false;
+            }
+        }
+
+        npp::ImageCPU_8u_C1 oDst;
+        try {
+            rotateImage(oSrc, oRequest.angle, pROI, oDst);
+        }
+        catch (npp::Exception &rException) {
+            std::ostringstream oMessage;
+            oMessage << rException;
+            return sendResponse(fd, ROTATE_STATUS_FAILED, oMessage.str());
+        }
+        catch (std::bad_alloc &) {
+            return sendResponse(fd, ROTATE_STATUS_FAILED, "out of memory");
+        }
+        catch (...) {
+            return sendResponse(fd, ROTATE_STATUS_FAILED, "rotation failed, see the daemon log");
+        }
+        return sendResponse(fd, ROTATE_STATUS_OK, "", &oDst);
+    }
+
+    sendResponse(fd, ROTATE_STATUS_BAD_REQUEST, "unknown job kind");
+    return false;
+}
+
+// Fixed set of connection threads.  Each one selects the device once and
+// keeps its device buffers for as long as the daemon runs.
+class ConnectionPool
+{
+public:
+    ConnectionPool(unsigned int nThreads, int deviceId)
+        : bStop_(false)
+    {
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            aThreads_.emplace_back([this, deviceId] {
+                cudaSetDevice(deviceId);
+                int fd;
+                while (pop(fd)) {
+                    while (serveRequest(fd)) {
+                    }
+                    release(fd);
+                }
+            });
+        }
+    }
+
+    ~ConnectionPool()
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bStop_ = true;
+            // Wake threads blocked on idle clients.
+            for (int fd : active_) {
+                shutdown(fd, SHUT_RDWR);
+            }
+            for (int fd : pending_) {
+                close(fd);
+            }
+            pending_.clear();
+        }
+        ready_.notify_all();
+        for (auto &rThread : aThreads_) {
+            rThread.join();
+        }
+    }
+
+    void submit(int fd)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            pending_.push_back(fd);
+        }
+        ready_.notify_one();
+    }
+
+private:
+    bool pop(int &rFd)
+    {
+        std::unique_lock<std::mutex> oLock(mutex_);
+        ready_.wait(oLock, [this] { return bStop_ || !pending_.empty(); });
+        if (bStop_) {
+            return false;
+        }
+        rFd = pending_.front();
+        pending_.pop_front();
+        active_.insert(rFd);
+        return true;
+    }
+
+    void release(int fd)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        active_.erase(fd);
+        close(fd);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<int> pending_;
+    std::set<int> active_;
+    std::vector<std::thread> aThreads_;
+    bool bStop_;
+};
+
+} // namespace
+
+int runDaemon(const DaemonConfig &rConfig)
+{
+    struct sockaddr_un oAddress;
+    memset(&oAddress, 0, sizeof(oAddress));
+    oAddress.sun_family = AF_UNIX;
+    if (rConfig.socketPath.empty() || rConfig.socketPath.size() >= sizeof(oAddress.sun_path)) {
+        logError("Invalid socket path: " + rConfig.socketPath);
+        return EXIT_FAILURE;
+    }
+    strncpy(oAddress.sun_path, rConfig.socketPath.c_str(), sizeof(oAddress.sun_path) - 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        logError(std::string("socket: ") + strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Only a stale socket is replaced; any other file at the path is left
+    // alone.
+    struct stat oStat;
+    if (lstat(rConfig.socketPath.c_str(), &oStat) == 0) {
+        if (!S_ISSOCK(oStat.st_mode)) {
+            logError("Not a socket, refusing to replace: " + rConfig.socketPath);
+            close(listenFd);
+            return EXIT_FAILURE;
+        }
+        unlink(rConfig.socketPath.c_str());
+    }
+
+    // Path jobs read and write files as the daemon's user, so only that
+    // user may connect.  The mode is set before listen(), until which no
+    // connection is accepted.
+    if (bind(listenFd, (struct sockaddr *)&oAddress, sizeof(oAddress)) != 0 ||
+        chmod(rConfig.socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        logError("Unable to listen on " + rConfig.socketPath + ": " + strerror(errno));
+        close(listenFd);
+        return EXIT_FAILURE;
+    }
+
+    // No SA_RESTART, so that poll() returns when a signal arrives.
+    struct sigaction oAction;
+    memset(&oAction, 0, sizeof(oAction));
+    oAction.sa_handler = onSignal;
+    sigaction(SIGINT, &oAction, nullptr);
+    sigaction(SIGTERM, &oAction, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::ostringstream oMessage;
+    oMessage << "Daemon listening on " << rConfig.socketPath << " with " << rConfig.workers << " worker(s)";
+    logInfo(oMessage.str());
+
+    {
+        ConnectionPool oPool(std::max(1u, rConfig.workers), rConfig.deviceId);
+
+        while (!g_stop) {
+            struct pollfd oPoll = {listenFd, POLLIN, 0};
+            int nReady = poll(&oPoll, 1, 500);
+            if (nReady < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                logError(std::string("poll: ") + strerror(errno));
+                break;
+            }
+            if (nReady == 0) {
+                continue;   // only to look at g_stop again
+            }
+
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                oPool.submit(fd);
+            } else if (errno != EINTR && errno != ECONNABORTED) {
+                logError(std::string("accept: ") + strerror(errno));
+            }
+        }
+
+        logInfo("Daemon shutting down");
+    }
+
+    close(listenFd);
+    unlink(rConfig.socketPath.c_str());
+    return EXIT_SUCCESS;
+}
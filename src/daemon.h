@@ -0,0 +1,21 @@
+/* Long-lived server mode: rotate jobs arrive over a Unix domain socket and
+ * are handled by a fixed pool of threads that keep their device context and
+ * device buffers between requests.  See include/rotateDaemonProtocol.h.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+
+struct DaemonConfig
+{
+    std::string socketPath;
+    unsigned int workers;       // connections served concurrently
+    int deviceId;
+};
+
+// Serves until SIGINT or SIGTERM.  Returns the process exit code.
+int runDaemon(const DaemonConfig &rConfig);
+
+#endif // DAEMON_H
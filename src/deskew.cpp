@@ -0,0 +1,227 @@
+#include "deskew.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+// The pyramid stops at the first level no larger than this.
+const int kCoarseSide = 512;
+
+// Step of the full-range scan and of the refinement on the smallest level;
+// the finer levels halve it once each.
+const double kCoarseStep = 0.5;
+const double kCoarseResolution = 0.125;
+
+// With fewer foreground pixels the profile carries no orientation.
+const size_t kMinForeground = 64;
+
+// Rows sampled per level.  The precision of an angle comes from the width
+// of the image; text lines span many rows, so every k-th row profiles them
+// just as well.
+const int kProfileRows = 512;
+
+struct Level
+{
+    const Npp8u *pPixels;
+    int step;
+    NppiSize size;
+    std::vector<Npp8u> aStorage;
+};
+
+// Foreground pixel columns of the sampled rows.
+struct Foreground
+{
+    std::vector<int32_t> aX;
+    std::vector<int> aY;                // sampled rows
+    std::vector<size_t> aRowStart;      // aY.size() + 1 entries
+};
+
+// rCoarse is rFine halved with a 2x2 box filter.
+void reduce(const Level &rFine, Level &rCoarse)
+{
+    rCoarse.size.width = (rFine.size.width + 1) / 2;
+    rCoarse.size.height = (rFine.size.height + 1) / 2;
+    rCoarse.step = rCoarse.size.width;
+    rCoarse.aStorage.resize((size_t)rCoarse.size.width * rCoarse.size.height);
+    rCoarse.pPixels = rCoarse.aStorage.data();
+
+    for (int y = 0; y < rCoarse.size.height; ++y) {
+        const Npp8u *pRow0 = rFine.pPixels + (size_t)(2 * y) * rFine.step;
+        const Npp8u *pRow1 = 2 * y + 1 < rFine.size.height ? pRow0 + rFine.step : pRow0;
+        Npp8u *pOut = rCoarse.aStorage.data() + (size_t)y * rCoarse.step;
+        for (int x = 0; x < rCoarse.size.width; ++x) {
+            const int x0 = 2 * x;
+            const int x1 = std::min(x0 + 1, rFine.size.width - 1);
+            pOut[x] = (Npp8u)((pRow0[x0] + pRow0[x1] + pRow1[x0] + pRow1[x1] + 2) / 4);
+        }
+    }
+}
+
+// Otsu threshold of rLevel.  Foreground is the smaller of the two classes:
+// the pixels <= threshold if rDark, the others otherwise.
+int otsuThreshold(const Level &rLevel, bool &rDark)
+{
+    std::vector<size_t> aHistogram(256, 0);
+    for (int y = 0; y < rLevel.size.height; ++y) {
+        const Npp8u *pRow = rLevel.pPixels + (size_t)y * rLevel.step;
+        for (int x = 0; x < rLevel.size.width; ++x) {
+            ++aHistogram[pRow[x]];
+        }
+    }
+
+    const double total = (double)rLevel.size.width * rLevel.size.height;
+    double sumAll = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        sumAll += (double)i * aHistogram[i];
+    }
+
+    int threshold = 127;
+    double best = -1.0, count0 = 0.0, sum0 = 0.0, bestCount0 = 0.0;
+    for (int t = 0; t < 255; ++t) {
+        count0 += aHistogram[t];
+        sum0 += (double)t * aHistogram[t];
+        const double count1 = total - count0;
+        if (count0 == 0.0 || count1 == 0.0) {
+            continue;
+        }
+        const double mean0 = sum0 / count0;
+        const double mean1 = (sumAll - sum0) / count1;
+        const double between = count0 * count1 * (mean0 - mean1) * (mean0 - mean1);
+        if (between > best) {
+            best = between;
+            threshold = t;
+            bestCount0 = count0;
+        }
+    }
+    rDark = bestCount0 <= total - bestCount0;
+    return threshold;
+}
+
+void collectForeground(const Level &rLevel, int threshold, bool bDark, Foreground &rForeground)
+{
+    const int rowStep = std::max(1, rLevel.size.height / kProfileRows);
+    rForeground.aX.clear();
+    rForeground.aY.clear();
+    rForeground.aRowStart.assign(1, 0);
+    size_t count = 0;
+    for (int y = 0; y < rLevel.size.height; y += rowStep) {
+        const Npp8u *pRow = rLevel.pPixels + (size_t)y * rLevel.step;
+        rForeground.aX.resize(count + rLevel.size.width);
+
+        // Branch free: every column is stored, only foreground ones are kept
+        int32_t *pX = rForeground.aX.data();
+        for (int x = 0; x < rLevel.size.width; ++x) {
+            pX[count] = x;
+            count += (pRow[x] <= threshold) == bDark;
+        }
+        rForeground.aY.push_back(y);
+        rForeground.aRowStart.push_back(count);
+    }
+    rForeground.aX.resize(count);
+}
+
+// Sum of squared bins of the foreground projected across lines at angle;
+// the total is fixed, so this orders angles like the profile's variance.
+double profileScore(const Foreground &rForeground, NppiSize oSize, double angle, std::vector<int> &aBins)
+{
+    const double kRadians = angle * M_PI / 180.0;
+    const double c = std::cos(kRadians);
+    const double s = std::sin(kRadians);
+
+    // v = c*y - s*x is the row a pixel lands on after rotating by angle
+    const double offset = oSize.width * std::fabs(s) + 1.0;
+    aBins.assign((size_t)(oSize.height * c + 2.0 * offset) + 2, 0);
+
+    for (size_t r = 0; r < rForeground.aY.size(); ++r) {
+        const double base = rForeground.aY[r] * c + offset;
+        for (size_t i = rForeground.aRowStart[r]; i < rForeground.aRowStart[r + 1]; ++i) {
+            ++aBins[(size_t)(base - rForeground.aX[i] * s)];
+        }
+    }
+
+    double score = 0.0;
+    for (int count : aBins) {
+        score += (double)count * count;
+    }
+    return score;
+}
+
+// Best of the angles center + k * step, |k| <= n, placed between its
+// neighbours with a parabola.
+double searchAngles(const Foreground &rForeground, NppiSize oSize, double center, double step, int n)
+{
+    std::vector<int> aBins;
+    std::vector<double> aScores(2 * n + 1);
+    int best = n;
+    for (int k = 0; k <= 2 * n; ++k) {
+        aScores[k] = profileScore(rForeground, oSize, center + (k - n) * step, aBins);
+        if (aScores[k] > aScores[best]) {
+            best = k;
+        }
+    }
+
+    double angle = center + (best - n) * step;
+    if (best > 0 && best < 2 * n) {
+        const double curvature = aScores[best - 1] - 2.0 * aScores[best] + aScores[best + 1];
+        if (curvature < 0.0) {
+            angle += 0.5 * (aScores[best - 1] - aScores[best + 1]) / curvature * step;
+        }
+    }
+    return std::min(std::max(angle, -kMaxSkewAngle), kMaxSkewAngle);
+}
+
+} // namespace
+
+double estimateSkewAngle(const Npp8u *pSrc, int srcStep, NppiSize oSize)
+{
+    if (oSize.width < 2 || oSize.height < 2) {
+        return 0.0;
+    }
+
+    // Level 0 is the source itself; levels never move once built
+    std::vector<Level> aLevels(1);
+    aLevels.reserve(32);
+    aLevels[0].pPixels = pSrc;
+    aLevels[0].step = srcStep;
+    aLevels[0].size = oSize;
+    while (std::max(aLevels.back().size.width, aLevels.back().size.height) > kCoarseSide) {
+        aLevels.emplace_back();
+        reduce(aLevels[aLevels.size() - 2], aLevels.back());
+    }
+
+    bool bDark;
+    const int threshold = otsuThreshold(aLevels.back(), bDark);
+
+    Foreground oForeground;
+    double angle = 0.0;
+    double step = kCoarseStep;
+    for (int i = (int)aLevels.size() - 1; i >= 0; --i) {
+        const Level &rLevel = aLevels[i];
+        collectForeground(rLevel, threshold, bDark, oForeground);
+        if (oForeground.aX.size() < kMinForeground) {
+            break;
+        }
+
+        if (i + 1 == (int)aLevels.size()) {
+            angle = searchAngles(oForeground, rLevel.size, 0.0, step, (int)(kMaxSkewAngle / step));
+            while (step > kCoarseResolution) {
+                step /= 2;
+                angle = searchAngles(oForeground, rLevel.size, angle, step, 2);
+            }
+        } else {
+            step /= 2;
+            angle = searchAngles(oForeground, rLevel.size, angle, step, 2);
+        }
+    }
+    return angle;
+}
+
+double estimateSkewAngle(const npp::ImageCPU_8u_C1 &rImage)
+{
+    NppiSize oSize = {(int)rImage.width(), (int)rImage.height()};
+    return estimateSkewAngle(rImage.data(), rImage.pitch(), oSize);
+}
@@ -0,0 +1,44 @@
+/* Skew estimation for --angle=auto.
+ *
+ * Scanned pages and aerial strips are usually a few degrees off level.  The
+ * estimate uses projection profiles: the dark (minority) pixels are summed
+ * along lines at a candidate angle, and the angle at which text lines or
+ * other long horizontal structure line up gives the profile with the
+ * largest variance.
+ *
+ * The search runs coarse to fine on a pyramid of 2x2 box reductions.  The
+ * whole +-kMaxSkewAngle range is scanned on the smallest level, no larger
+ * than 512 pixels a side; every finer level, up to the full resolution,
+ * only evaluates a few angles around the previous best, at half the step,
+ * and a parabola through the best three gives the final angle.  Only the
+ * foreground pixels take part in the sums, so the estimate costs a small
+ * part of the rotation itself.
+ */
+
+#ifndef DESKEW_H
+#define DESKEW_H
+
+#include <ImagesCPU.h>
+#include <npp.h>
+
+#include <cmath>
+#include <limits>
+
+// Largest skew searched for, in degrees either way.
+const double kMaxSkewAngle = 15.0;
+
+// Angle that asks for the skew of each image to be estimated.
+const double kAutoAngle = std::numeric_limits<double>::quiet_NaN();
+
+inline bool isAutoAngle(double angle)
+{
+    return std::isnan(angle);
+}
+
+// Angle that straightens the image, in the convention of rotateImage(): the
+// dominant horizontal structure ends up level.  Returns 0 for images without
+// a usable foreground.
+double estimateSkewAngle(const Npp8u *pSrc, int srcStep, NppiSize oSize);
+double estimateSkewAngle(const npp::ImageCPU_8u_C1 &rImage);
+
+#endif // DESKEW_H
@@ -0,0 +1,214 @@
+#include "hugePages.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace
+{
+
+const size_t k2M = (size_t)2 << 20;
+const size_t k1G = (size_t)1 << 30;
+
+const char *const kModeNames[] = {"off", "2m", "1g"};
+
+std::atomic<int> g_mode(HUGE_PAGES_OFF);
+std::atomic<size_t> g_hugetlb(0);
+std::atomic<size_t> g_transparent(0);
+std::atomic<size_t> g_regular(0);
+
+// Mappings made here, so that frees know their length and whether they
+// were registered with CUDA.
+struct Mapping
+{
+    size_t bytes;
+    bool pinned;
+};
+
+std::mutex g_mappingMutex;
+std::map<void *, Mapping> g_mappings;
+
+size_t roundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+void *mapHugeTLB(size_t nBytes, size_t pageSize, int sizeFlag)
+{
+    void *p = mmap(nullptr, roundUp(nBytes, pageSize), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+// A 2 MiB aligned anonymous mapping, so that the kernel can back all of it
+// with transparent huge pages.
+void *mapAligned(size_t nBytes, bool &rTransparent)
+{
+    const size_t nLength = roundUp(nBytes, k2M);
+    char *p = static_cast<char *>(mmap(nullptr, nLength + k2M, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+
+    char *pAligned = reinterpret_cast<char *>(roundUp(reinterpret_cast<size_t>(p), k2M));
+    if (pAligned > p) {
+        munmap(p, pAligned - p);
+    }
+    munmap(pAligned + nLength, p + k2M - pAligned);
+
+    rTransparent = madvise(pAligned, nLength, MADV_HUGEPAGE) == 0;
+    return pAligned;
+}
+
+// Maps nBytes with the largest pages available, or returns nullptr if the
+// buffer is too small to be worth it or huge pages are off.
+void *mapImageMemory(size_t nBytes, size_t &rLength)
+{
+    const HugePageMode mode = (HugePageMode)g_mode.load();
+    if (mode == HUGE_PAGES_OFF || nBytes < kHugePageMinBytes) {
+        return nullptr;
+    }
+
+    if (mode == HUGE_PAGES_1G && nBytes >= k1G / 2) {
+        if (void *p = mapHugeTLB(nBytes, k1G, MAP_HUGE_1GB)) {
+            rLength = roundUp(nBytes, k1G);
+            ++g_hugetlb;
+            return p;
+        }
+    }
+    if (void *p = mapHugeTLB(nBytes, k2M, MAP_HUGE_2MB)) {
+        rLength = roundUp(nBytes, k2M);
+        ++g_hugetlb;
+        return p;
+    }
+
+    bool bTransparent = false;
+    void *p = mapAligned(nBytes, bTransparent);
+    if (p) {
+        rLength = roundUp(nBytes, k2M);
+        ++(bTransparent ? g_transparent : g_regular);
+    }
+    return p;
+}
+
+void recordMapping(void *p, size_t nLength, bool pinned)
+{
+    std::lock_guard<std::mutex> oLock(g_mappingMutex);
+    g_mappings[p] = Mapping{nLength, pinned};
+}
+
+// Unmaps p if it was mapped here.  Returns false for heap memory.
+bool unmapImageMemory(void *p)
+{
+    Mapping oMapping;
+    {
+        std::lock_guard<std::mutex> oLock(g_mappingMutex);
+        auto it = g_mappings.find(p);
+        if (it == g_mappings.end()) {
+            return false;
+        }
+        oMapping = it->second;
+        g_mappings.erase(it);
+    }
+    if (oMapping.pinned) {
+        cudaHostUnregister(p);
+    }
+    munmap(p, oMapping.bytes);
+    return true;
+}
+
+} // namespace
+
+bool parseHugePageMode(const std::string &name, HugePageMode &rMode)
+{
+    for (int i = 0; i < 3; ++i) {
+        if (name == kModeNames[i]) {
+            rMode = (HugePageMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *hugePageModeName(HugePageMode mode)
+{
+    return kModeNames[mode];
+}
+
+void setHugePageMode(HugePageMode mode)
+{
+    g_mode = mode;
+}
+
+HugePageMode hugePageMode()
+{
+    return (HugePageMode)g_mode.load();
+}
+
+HugePageStats hugePageStats()
+{
+    HugePageStats oStats = {g_hugetlb, g_transparent, g_regular};
+    return oStats;
+}
+
+void *allocateImageMemory(size_t nBytes)
+{
+    size_t nLength;
+    if (void *p = mapImageMemory(nBytes, nLength)) {
+        recordMapping(p, nLength, false);
+        return p;
+    }
+
+    void *p = malloc(nBytes ? nBytes : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void freeImageMemory(void *pData)
+{
+    if (pData && !unmapImageMemory(pData)) {
+        free(pData);
+    }
+}
+
+void *allocatePinnedImageMemory(size_t nBytes)
+{
+    size_t nLength;
+    if (void *p = mapImageMemory(nBytes, nLength)) {
+        if (cudaHostRegister(p, nLength, cudaHostRegisterDefault) == cudaSuccess) {
+            recordMapping(p, nLength, true);
+            return p;
+        }
+        munmap(p, nLength);
+    }
+
+    void *p = nullptr;
+    NPP_CHECK_CUDA(cudaHostAlloc(&p, nBytes, cudaHostAllocDefault));
+    return p;
+}
+
+void freePinnedImageMemory(void *pData)
+{
+    if (pData && !unmapImageMemory(pData)) {
+        cudaFreeHost(pData);
+    }
+}
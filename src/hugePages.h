@@ -0,0 +1,95 @@
+/* Huge-page backed host memory for image buffers.
+ *
+ * A rotation at an arbitrary angle gathers source pixels along slanted
+ * lines, so on a large image nearly every output row touches a different
+ * set of 4 KiB pages and the TLB misses dominate.  With huge pages enabled,
+ * buffers of at least kHugePageMinBytes are mapped with 2 MiB (or, for
+ * buffers of 512 MiB and more, 1 GiB) pages: first from the hugetlbfs pool
+ * (MAP_HUGETLB), then as transparent huge pages (madvise(MADV_HUGEPAGE) on
+ * a 2 MiB aligned mapping), and finally as ordinary pages.  Smaller
+ * buffers, and all buffers with huge pages off, come from the heap.
+ *
+ * The mode is process wide and is set before any work starts.
+ */
+
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <stddef.h>
+
+#include <new>
+#include <string>
+#include <vector>
+
+enum HugePageMode
+{
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_2M,
+    HUGE_PAGES_1G               // 1 GiB pages for the largest buffers, 2 MiB otherwise
+};
+
+const size_t kHugePageMinBytes = (size_t)1 << 20;
+
+// Parses "off", "2m" or "1g".
+bool parseHugePageMode(const std::string &name, HugePageMode &rMode);
+const char *hugePageModeName(HugePageMode mode);
+
+void setHugePageMode(HugePageMode mode);
+HugePageMode hugePageMode();
+
+// How the buffers allocated so far were backed.
+struct HugePageStats
+{
+    size_t hugetlb;             // hugetlbfs pages
+    size_t transparent;         // madvise(MADV_HUGEPAGE)
+    size_t regular;             // ordinary pages or heap
+};
+
+HugePageStats hugePageStats();
+
+// Host memory for image pixels.  Throws std::bad_alloc.
+void *allocateImageMemory(size_t nBytes);
+void freeImageMemory(void *pData);
+
+// As above, and page-locked for asynchronous CUDA copies.  Without huge
+// pages this is cudaHostAlloc().  Throws npp::Exception.
+void *allocatePinnedImageMemory(size_t nBytes);
+void freePinnedImageMemory(void *pData);
+
+// Lets std::vector hold image pixels in huge pages.
+template <typename T>
+struct HugePageAllocator
+{
+    typedef T value_type;
+
+    HugePageAllocator() {}
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(allocateImageMemory(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t)
+    {
+        freeImageMemory(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+{
+    return false;
+}
+
+typedef std::vector<unsigned char, HugePageAllocator<unsigned char>> ImageBytes;
+
+#endif // HUGE_PAGES_H
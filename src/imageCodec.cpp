@@ -0,0 +1,423 @@
+#include "imageCodec.h"
+
+#include <Exceptions.h>
+#include <ImageIO.h>
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmath>
+
+#include "syntheticImages.h"
+#include "tiffPyramid.h"
+
+namespace
+{
+
+struct PNMHeader
+{
+    char type;          // '2', '3', '5' or '6'
+    int width;
+    int height;
+    int maxValue;
+    off_t dataOffset;   // first byte of the raster
+};
+
+// Parses the next decimal field of a PNM header, skipping whitespace and
+// '#' comments.  Returns false if the header is truncated or malformed.
+bool readPNMField(const char *pData, size_t nSize, size_t &rPos, int &rValue)
+{
+    while (rPos < nSize) {
+        if (pData[rPos] == '#') {
+            while (rPos < nSize && pData[rPos] != '\n') {
+                ++rPos;
+            }
+        } else if (isspace((unsigned char)pData[rPos])) {
+            ++rPos;
+        } else {
+            break;
+        }
+    }
+
+    if (rPos >= nSize || !isdigit((unsigned char)pData[rPos])) {
+        return false;
+    }
+
+    long value = 0;
+    while (rPos < nSize && isdigit((unsigned char)pData[rPos])) {
+        value = value * 10 + (pData[rPos] - '0');
+        if (value > 0x7fffffff) {
+            return false;
+        }
+        ++rPos;
+    }
+    rValue = (int)value;
+    return true;
+}
+
+bool readPNMHeader(int fd, PNMHeader &rHeader)
+{
+    char aBuffer[1024];
+    ssize_t nRead = pread(fd, aBuffer, sizeof(aBuffer), 0);
+    if (nRead < 3 || aBuffer[0] != 'P' || !strchr("2356", aBuffer[1])) {
+        return false;
+    }
+
+    size_t nPos = 2;
+    rHeader.type = aBuffer[1];
+    if (!readPNMField(aBuffer, nRead, nPos, rHeader.width) ||
+        !readPNMField(aBuffer, nRead, nPos, rHeader.height) ||
+        !readPNMField(aBuffer, nRead, nPos, rHeader.maxValue)) {
+        return false;
+    }
+
+    // Exactly one whitespace character separates maxval from the raster.
+    if (nPos >= (size_t)nRead || !isspace((unsigned char)aBuffer[nPos])) {
+        return false;
+    }
+    rHeader.dataOffset = nPos + 1;
+    return rHeader.width > 0 && rHeader.height > 0;
+}
+
+void cropImage(const npp::ImageCPU_8u_C1 &rSource, const NppiRect &window, npp::ImageCPU_8u_C1 &rImage)
+{
+    npp::ImageCPU_8u_C1 oImage(window.width, window.height);
+    for (int y = 0; y < window.height; ++y) {
+        memcpy(oImage.data(0, y), rSource.data(window.x, window.y + y), window.width);
+    }
+    oImage.swap(rImage);
+}
+
+// Reduces a decoded bitmap, which is consumed, to 8-bit grayscale: 16-bit
+// samples keep their high byte and colour becomes luminance.
+FIBITMAP *convertToGray8(FIBITMAP *pBitmap)
+{
+    FIBITMAP *pGray = 0;
+    switch (FreeImage_GetImageType(pBitmap)) {
+    case FIT_BITMAP:
+        if (FreeImage_GetColorType(pBitmap) == FIC_MINISBLACK && FreeImage_GetBPP(pBitmap) == 8) {
+            return pBitmap;
+        }
+        pGray = FreeImage_ConvertToGreyscale(pBitmap);
+        break;
+    case FIT_UINT16:
+        pGray = FreeImage_ConvertTo8Bits(pBitmap);
+        break;
+    case FIT_RGB16:
+    case FIT_RGBA16: {
+        FIBITMAP *pColour = FreeImage_ConvertTo32Bits(pBitmap);
+        if (pColour) {
+            pGray = FreeImage_ConvertToGreyscale(pColour);
+            FreeImage_Unload(pColour);
+        }
+        break;
+    }
+    default:
+        // Float and other sample types are scaled linearly into 8 bits
+        pGray = FreeImage_ConvertToStandardType(pBitmap, TRUE);
+        if (pGray && (FreeImage_GetColorType(pGray) != FIC_MINISBLACK || FreeImage_GetBPP(pGray) != 8)) {
+            FIBITMAP *pStandard = pGray;
+            pGray = FreeImage_ConvertToGreyscale(pStandard);
+            FreeImage_Unload(pStandard);
+        }
+        break;
+    }
+    FreeImage_Unload(pBitmap);
+    NPP_ASSERT_MSG(pGray != 0, "Unsupported pixel format");
+    return pGray;
+}
+
+// Copies an 8-bit grayscale bitmap, which is consumed, into rImage.
+void copyGrayBitmap(FIBITMAP *pBitmap, npp::ImageCPU_8u_C1 &rImage)
+{
+    // FreeImage stores scan lines bottom-up
+    npp::ImageCPU_8u_C1 oImage(FreeImage_GetWidth(pBitmap), FreeImage_GetHeight(pBitmap));
+    unsigned int nSrcPitch = FreeImage_GetPitch(pBitmap);
+    const Npp8u *pSrcLine = FreeImage_GetBits(pBitmap) + nSrcPitch * (FreeImage_GetHeight(pBitmap) - 1);
+    for (unsigned int y = 0; y < oImage.height(); ++y) {
+        memcpy(oImage.data(0, y), pSrcLine, oImage.width());
+        pSrcLine -= nSrcPitch;
+    }
+    FreeImage_Unload(pBitmap);
+
+    oImage.swap(rImage);
+}
+
+} // namespace
+
+bool probeImageSize(const std::string &rFileName, NppiSize &rSize, bool bHeaderOnly)
+{
+    SyntheticImage oSynthetic;
+    if (isSyntheticPath(rFileName)) {
+        bool bKnown = describeSyntheticPath(rFileName, oSynthetic);
+        rSize = oSynthetic.size;
+        return bKnown;
+    }
+
+    int fd = open(rFileName.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        PNMHeader oHeader;
+        bool bPNM = readPNMHeader(fd, oHeader);
+        close(fd);
+        if (bPNM) {
+            rSize.width = oHeader.width;
+            rSize.height = oHeader.height;
+            return true;
+        }
+    }
+
+    FREE_IMAGE_FORMAT eFormat = FreeImage_GetFileType(rFileName.c_str());
+    if (eFormat == FIF_UNKNOWN) {
+        eFormat = FreeImage_GetFIFFromFilename(rFileName.c_str());
+    }
+    if (eFormat == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(eFormat)) {
+        return false;
+    }
+    // Plugins without header-only loading ignore the flag and decode
+    const bool bNoPixels = FreeImage_FIFSupportsNoPixels(eFormat) != 0;
+    if (!bNoPixels && bHeaderOnly) {
+        return false;
+    }
+
+    FIBITMAP *pBitmap = FreeImage_Load(eFormat, rFileName.c_str(), bNoPixels ? FIF_LOAD_NOPIXELS : 0);
+    if (pBitmap == 0) {
+        return false;
+    }
+    rSize.width = (int)FreeImage_GetWidth(pBitmap);
+    rSize.height = (int)FreeImage_GetHeight(pBitmap);
+    FreeImage_Unload(pBitmap);
+    return true;
+}
+
+ImageWindowReader::ImageWindowReader(const std::string &rFileName)
+    : fileName_(rFileName), fd_(-1), dataOffset_(0)
+{
+    fd_ = open(rFileName.c_str(), O_RDONLY | O_CLOEXEC);
+    NPP_ASSERT_MSG(fd_ >= 0, "Unable to open " + rFileName);
+
+    PNMHeader oHeader;
+    if (readPNMHeader(fd_, oHeader) && oHeader.type == '5' && oHeader.maxValue < 256) {
+        oSize_.width = oHeader.width;
+        oSize_.height = oHeader.height;
+        dataOffset_ = oHeader.dataOffset;
+        return;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+    loadImageFile(rFileName, oDecoded_);
+    oSize_.width = (int)oDecoded_.width();
+    oSize_.height = (int)oDecoded_.height();
+}
+
+ImageWindowReader::~ImageWindowReader()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void ImageWindowReader::read(const NppiRect &window, npp::ImageCPU_8u_C1 &rImage)
+{
+    NPP_ASSERT_MSG(!(window.width <= 0 || window.height <= 0), "Empty source window");
+    NPP_ASSERT_MSG(window.x >= 0 && window.y >= 0 &&
+                   window.x + window.width <= oSize_.width &&
+                   window.y + window.height <= oSize_.height,
+                   "Source window outside of " + fileName_);
+
+    if (fd_ < 0) {
+        cropImage(oDecoded_, window, rImage);
+        return;
+    }
+
+    npp::ImageCPU_8u_C1 oImage(window.width, window.height);
+    bool bOk = true;
+
+    if (window.width == oSize_.width && oImage.pitch() == (unsigned int)oSize_.width) {
+        // Full-width window: the rows are contiguous on disk.
+        size_t nBytes = (size_t)window.width * window.height;
+        off_t nOffset = dataOffset_ + (off_t)window.y * oSize_.width;
+        bOk = pread(fd_, oImage.data(), nBytes, nOffset) == (ssize_t)nBytes;
+    } else {
+        for (int y = 0; y < window.height && bOk; ++y) {
+            off_t nOffset = dataOffset_ + (off_t)(window.y + y) * oSize_.width + window.x;
+            bOk = pread(fd_, oImage.data(0, y), window.width, nOffset) == (ssize_t)window.width;
+        }
+    }
+
+    NPP_ASSERT_MSG(bOk, "Short read from " + fileName_);
+    oImage.swap(rImage);
+}
+
+void loadImageWindow(const std::string &rFileName, const NppiRect &window, npp::ImageCPU_8u_C1 &rImage)
+{
+    ImageWindowReader oReader(rFileName);
+    oReader.read(window, rImage);
+}
+
+PGMStreamWriter::PGMStreamWriter(const std::string &rFileName, int width, int height)
+    : fileName_(rFileName), pFile_(0), width_(width), rowsLeft_(height)
+{
+    pFile_ = fopen(rFileName.c_str(), "wb");
+    NPP_ASSERT_MSG(pFile_ != 0, "Unable to create " + rFileName);
+    fprintf(pFile_, "P5\n%d %d\n255\n", width, height);
+}
+
+PGMStreamWriter::~PGMStreamWriter()
+{
+    if (pFile_) {
+        fclose(pFile_);
+    }
+}
+
+void PGMStreamWriter::writeRows(const npp::ImageCPU_8u_C1 &rRows, int nRows)
+{
+    NPP_ASSERT(pFile_ != 0 && (int)rRows.width() == width_ && nRows <= rowsLeft_);
+    for (int y = 0; y < nRows; ++y) {
+        NPP_ASSERT_MSG(fwrite(rRows.data(0, y), 1, width_, pFile_) == (size_t)width_,
+                       "Write failed on " + fileName_);
+    }
+    rowsLeft_ -= nRows;
+}
+
+void PGMStreamWriter::close()
+{
+    NPP_ASSERT_MSG(rowsLeft_ == 0, "Incomplete image written to " + fileName_);
+    int nResult = fclose(pFile_);
+    pFile_ = 0;
+    NPP_ASSERT_MSG(nResult == 0, "Write failed on " + fileName_);
+}
+
+bool isPGMFileName(const std::string &rFileName)
+{
+    size_t nDot = rFileName.find_last_of('.');
+    if (nDot == std::string::npos) {
+        return false;
+    }
+    std::string extension = rFileName.substr(nDot);
+    for (char &c : extension) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return extension == ".pgm";
+}
+
+bool isJPEGFileName(const std::string &rFileName)
+{
+    size_t nDot = rFileName.find_last_of('.');
+    if (nDot == std::string::npos) {
+        return false;
+    }
+    std::string extension = rFileName.substr(nDot);
+    for (char &c : extension) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return extension == ".jpg" || extension == ".jpeg";
+}
+
+bool rotateJPEGLossless(const std::vector<unsigned char> &rEncoded, double angle,
+                        std::vector<unsigned char> &rRotated)
+{
+    const double turns = angle / 90.0;
+    if (!(std::fabs(turns - std::round(turns)) < 1e-9) || rEncoded.empty()) {
+        return false;
+    }
+
+    // jpegtran turns clockwise
+    static const FREE_IMAGE_JPEG_OPERATION s_aOperations[4] = {FIJPEG_OP_NONE, FIJPEG_OP_ROTATE_270,
+                                                               FIJPEG_OP_ROTATE_180, FIJPEG_OP_ROTATE_90};
+    const int quarter = (int)(((long long)std::round(turns) % 4 + 4) % 4);
+
+    FIMEMORY *pSource = FreeImage_OpenMemory(const_cast<BYTE *>(rEncoded.data()), (DWORD)rEncoded.size());
+    NPP_ASSERT(pSource != 0);
+    if (FreeImage_GetFileTypeFromMemory(pSource, 0) != FIF_JPEG) {
+        FreeImage_CloseMemory(pSource);
+        return false;
+    }
+
+    // perfect = TRUE: fail rather than leave partial edge blocks untouched
+    FIMEMORY *pTarget = FreeImage_OpenMemory();
+    bool bRotated = FreeImage_JPEGTransformCombinedFromMemory(pSource, pTarget, s_aOperations[quarter],
+                                                               0, 0, 0, 0, TRUE) != 0;
+    FreeImage_CloseMemory(pSource);
+
+    BYTE *pData = 0;
+    DWORD nSize = 0;
+    if (bRotated && FreeImage_AcquireMemory(pTarget, &pData, &nSize) && nSize > 0) {
+        rRotated.assign(pData, pData + nSize);
+    } else {
+        bRotated = false;
+    }
+    FreeImage_CloseMemory(pTarget);
+    return bRotated;
+}
+
+void decodeImage(const std::vector<unsigned char> &rEncoded, npp::ImageCPU_8u_C1 &rImage)
+{
+    NPP_ASSERT_MSG(!rEncoded.empty(), "Empty image file");
+
+    FIMEMORY *pMemory = FreeImage_OpenMemory(const_cast<BYTE *>(rEncoded.data()), (DWORD)rEncoded.size());
+    NPP_ASSERT(pMemory != 0);
+
+    FREE_IMAGE_FORMAT eFormat = FreeImage_GetFileTypeFromMemory(pMemory, 0);
+    FIBITMAP *pBitmap = 0;
+    if (eFormat != FIF_UNKNOWN && FreeImage_FIFSupportsReading(eFormat)) {
+        pBitmap = FreeImage_LoadFromMemory(eFormat, pMemory, 0);
+    }
+    FreeImage_CloseMemory(pMemory);
+
+    NPP_ASSERT(pBitmap != 0);
+    copyGrayBitmap(convertToGray8(pBitmap), rImage);
+}
+
+void loadImageFile(const std::string &rFileName, npp::ImageCPU_8u_C1 &rImage)
+{
+    FREE_IMAGE_FORMAT eFormat = FreeImage_GetFileType(rFileName.c_str());
+    if (eFormat == FIF_UNKNOWN) {
+        eFormat = FreeImage_GetFIFFromFilename(rFileName.c_str());
+    }
+    NPP_ASSERT_MSG(eFormat != FIF_UNKNOWN && FreeImage_FIFSupportsReading(eFormat),
+                   "Unsupported image format: " + rFileName);
+
+    FIBITMAP *pBitmap = FreeImage_Load(eFormat, rFileName.c_str());
+    NPP_ASSERT_MSG(pBitmap != 0, "Unable to load " + rFileName);
+    copyGrayBitmap(convertToGray8(pBitmap), rImage);
+}
+
+void encodeImage(const std::string &rFileName, const npp::ImageCPU_8u_C1 &rImage,
+                 std::vector<unsigned char> &rEncoded)
+{
+    if (overviewLevels() > 0 && isTIFFFileName(rFileName)) {
+        encodeTIFFPyramid(rImage, rEncoded);
+        return;
+    }
+
+    FREE_IMAGE_FORMAT eFormat = FreeImage_GetFIFFromFilename(rFileName.c_str());
+    NPP_ASSERT_MSG(eFormat != FIF_UNKNOWN && FreeImage_FIFSupportsWriting(eFormat),
+                   "Unsupported output format for " + rFileName);
+
+    FIBITMAP *pBitmap = FreeImage_Allocate(rImage.width(), rImage.height(), 8 /* bits per pixel */);
+    NPP_ASSERT(pBitmap != 0);
+
+    unsigned int nDstPitch = FreeImage_GetPitch(pBitmap);
+    Npp8u *pDstLine = FreeImage_GetBits(pBitmap) + nDstPitch * (rImage.height() - 1);
+    for (unsigned int y = 0; y < rImage.height(); ++y) {
+        memcpy(pDstLine, rImage.data(0, y), rImage.width());
+        pDstLine -= nDstPitch;
+    }
+
+    FIMEMORY *pMemory = FreeImage_OpenMemory();
+    bool bSaved = FreeImage_SaveToMemory(eFormat, pBitmap, pMemory, 0) != 0;
+    FreeImage_Unload(pBitmap);
+
+    BYTE *pData = 0;
+    DWORD nSize = 0;
+    if (bSaved) {
+        FreeImage_AcquireMemory(pMemory, &pData, &nSize);
+        rEncoded.assign(pData, pData + nSize);
+    }
+    FreeImage_CloseMemory(pMemory);
+
+    NPP_ASSERT_MSG(bSaved, "Unable to encode " + rFileName);
+}
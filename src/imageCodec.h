@@ -0,0 +1,115 @@
+/* Image file helpers that go beyond npp::loadImage / npp::saveImage:
+ * reading dimensions from the header only, decoding a sub-window, and
+ * decoding/encoding files that are already in memory.
+ */
+
+#ifndef IMAGE_CODEC_H
+#define IMAGE_CODEC_H
+
+#include <ImagesCPU.h>
+#include <npp.h>
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+// Reads the image dimensions.  PNM headers are parsed directly, everything
+// else goes through FreeImage's FIF_LOAD_NOPIXELS mode.  Formats whose
+// plugin cannot skip the pixels are decoded in full, unless bHeaderOnly is
+// set, in which case they return false.  synthetic:// paths are answered
+// from their description, see syntheticImages.h.
+bool probeImageSize(const std::string &rFileName, NppiSize &rSize, bool bHeaderOnly = false);
+
+// Random access to rectangular windows of one image.  Binary 8-bit PGM files
+// are read straight from disk row by row, so only the rows of a window are
+// touched; other formats are decoded once on first use and cropped.
+class ImageWindowReader
+{
+public:
+    explicit ImageWindowReader(const std::string &rFileName);
+    ~ImageWindowReader();
+
+    NppiSize size() const
+    {
+        return oSize_;
+    }
+
+    // True if windows come from disk rather than a full decode in memory.
+    bool streaming() const
+    {
+        return fd_ >= 0;
+    }
+
+    void read(const NppiRect &window, npp::ImageCPU_8u_C1 &rImage);
+
+private:
+    ImageWindowReader(const ImageWindowReader &);
+    ImageWindowReader &operator=(const ImageWindowReader &);
+
+    std::string fileName_;
+    int fd_;
+    off_t dataOffset_;
+    NppiSize oSize_;
+    npp::ImageCPU_8u_C1 oDecoded_;
+};
+
+// Loads only the pixels inside window into rImage, see ImageWindowReader.
+void loadImageWindow(const std::string &rFileName, const NppiRect &window, npp::ImageCPU_8u_C1 &rImage);
+
+// Writes a binary PGM file top to bottom, a band of rows at a time, so that an
+// output larger than memory never has to exist in one piece.
+class PGMStreamWriter
+{
+public:
+    PGMStreamWriter(const std::string &rFileName, int width, int height);
+    ~PGMStreamWriter();
+
+    // Appends the first nRows rows of rRows.
+    void writeRows(const npp::ImageCPU_8u_C1 &rRows, int nRows);
+
+    // Flushes and closes the file; throws if anything went wrong.
+    void close();
+
+private:
+    PGMStreamWriter(const PGMStreamWriter &);
+    PGMStreamWriter &operator=(const PGMStreamWriter &);
+
+    std::string fileName_;
+    FILE *pFile_;
+    int width_;
+    int rowsLeft_;
+};
+
+// True if rFileName's extension selects binary PGM output.
+bool isPGMFileName(const std::string &rFileName);
+
+// True if rFileName's extension is .jpg or .jpeg.
+bool isJPEGFileName(const std::string &rFileName);
+
+// Rotates a JPEG file by a multiple of 90 degrees, counter-clockwise like
+// rotateImage(), without decoding it: the quantised DCT coefficient blocks
+// are transposed and flipped as jpegtran does, so there is no IDCT/FDCT and
+// no loss.  Returns false if angle is not a quarter turn or the turn cannot
+// be done exactly, which is when the image size is not a multiple of the
+// MCU and partial edge blocks would have to move.  Colour components and
+// metadata segments are carried over, so unlike the pixel path, which
+// writes 8-bit gray, a colour JPEG stays in colour.
+bool rotateJPEGLossless(const std::vector<unsigned char> &rEncoded, double angle,
+                        std::vector<unsigned char> &rRotated);
+
+// In-memory counterparts of npp::loadImage / npp::saveImage, used when the
+// file contents are read and written by the asynchronous I/O layer.  The
+// output format is taken from the extension of rFileName; TIFF outputs get
+// overviews when they are enabled, see tiffPyramid.h.  Unlike
+// npp::loadImage, decoding accepts 16-bit and colour images and reduces
+// them to 8-bit grayscale.
+void decodeImage(const std::vector<unsigned char> &rEncoded, npp::ImageCPU_8u_C1 &rImage);
+void encodeImage(const std::string &rFileName, const npp::ImageCPU_8u_C1 &rImage,
+                 std::vector<unsigned char> &rEncoded);
+
+// decodeImage() for a file on disk.
+void loadImageFile(const std::string &rFileName, npp::ImageCPU_8u_C1 &rImage);
+
+#endif // IMAGE_CODEC_H
@@ -38,11 +38,17 @@
 #include <ImagesNPP.h>
 
 #include <string.h>
+#include <unistd.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <filesystem>
 #include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
 
 #include <cuda_runtime.h>
 #include <npp.h>
@@ -50,6 +56,23 @@
 #include <helper_cuda.h>
 #include <helper_string.h>
 
+#include "batchPipeline.h"
+#include "benchmark.h"
+#include "cpuRotate.h"
+#include "daemon.h"
+#include "deskew.h"
+#include "hugePages.h"
+#include "jobOrder.h"
+#include "numaTopology.h"
+#include "orientationTag.h"
+#include "perfCounters.h"
+#include "progressJournal.h"
+#include "rotateBackend.h"
+#include "rotateGeometry.h"
+#include "streamMode.h"
+#include "syntheticImages.h"
+#include "tiffPyramid.h"
+
 namespace fs = std::filesystem;
 
 bool printfNPPinfo(int argc, char *argv[])
@@ -100,73 +123,134 @@ std::vector<std::string> getImageFiles(const std::string& directory, const std::
     return imageFiles;
 }
 
-bool processImage(const std::string& inputPath, const std::string& outputPath, double angle)
+// The value of exactly --name=value.  getCmdLineArgument*() match by
+// prefix, so they would also take --synthetic-size=... for --synthetic.
+bool getExactCmdLineArgument(int argc, char *argv[], const std::string &name, std::string &value)
 {
-    try {
-        std::cout << "Processing: " << inputPath << std::endl;
-        
-        // Load image (NPP supports PGM, PPM, and with proper libraries, TIFF)
-        npp::ImageCPU_8u_C1 oHostSrc;
-        npp::loadImage(inputPath, oHostSrc);
-        
-        // Upload to device
-        npp::ImageNPP_8u_C1 oDeviceSrc(oHostSrc);
-
-        // Create ROI structures
-        NppiSize oSrcSize = {(int)oDeviceSrc.width(), (int)oDeviceSrc.height()};
-        NppiPoint oSrcOffset = {0, 0};
-
-        // Calculate bounding box for rotated image
-        NppiRect oBoundingBox;
-        NPP_CHECK_NPP(nppiGetRotateBound(oSrcSize, angle, &oBoundingBox));
-
-        // Allocate device memory for output
-        npp::ImageNPP_8u_C1 oDeviceDst(oBoundingBox.width, oBoundingBox.height);
-
-        // Set rotation center (center of image)
-        NppiPoint oRotationCenter = {(int)(oSrcSize.width / 2), (int)(oSrcSize.height / 2)};
-
-        // Perform rotation
-        NPP_CHECK_NPP(nppiRotate_8u_C1R(
-            oDeviceSrc.data(), oSrcSize, oDeviceSrc.pitch(), oSrcOffset,
-            oDeviceDst.data(), oDeviceDst.pitch(), oBoundingBox, angle, 
-            oRotationCenter, NPPI_INTER_LINEAR));
-
-        // Copy result back to host
-        npp::ImageCPU_8u_C1 oHostDst(oDeviceDst.size());
-        oDeviceDst.copyTo(oHostDst.data(), oHostDst.pitch());
-
-        // Save output image
-        saveImage(outputPath, oHostDst);
-        std::cout << "  Saved: " << outputPath << std::endl;
-
-        // Cleanup
-        nppiFree(oDeviceSrc.data());
-        nppiFree(oDeviceDst.data());
-
-        return true;
+    bool found = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t start = arg.find_first_not_of('-');
+        if (start != std::string::npos && arg.compare(start, name.size() + 1, name + "=") == 0) {
+            value = arg.substr(start + name.size() + 1);
+            found = true;
+        }
     }
-    catch (npp::Exception &rException) {
-        std::cerr << "  NPP Exception: " << rException << std::endl;
-        return false;
+    return found;
+}
+
+// Parses "all" or a comma separated list of device ordinals.
+bool parseDeviceList(const std::string &text, std::vector<int> &devices)
+{
+    int deviceCount = 0;
+    cudaGetDeviceCount(&deviceCount);
+
+    devices.clear();
+    if (text == "all") {
+        for (int i = 0; i < deviceCount; ++i) {
+            devices.push_back(i);
+        }
+        return !devices.empty();
+    }
+
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        char *end;
+        long device = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || device < 0 || device >= deviceCount) {
+            return false;
+        }
+        devices.push_back((int)device);
     }
-    catch (...) {
-        std::cerr << "  Unknown exception occurred" << std::endl;
-        return false;
+    return !devices.empty();
+}
+
+// One backend per device, or per CPU shard for the CPU backend, combined
+// into a sharded backend when there is more than one.  With NUMA nodes the
+// CPU shards are dealt out over the nodes and use only their CPUs.
+std::unique_ptr<IRotateBackend> createBackends(const std::string &backendName, BackendOptions options,
+                                               const std::vector<int> &devices, unsigned int cpuShards,
+                                               const std::vector<NumaNode> &numaNodes)
+{
+    size_t shardCount = backendName == "cpu" ? cpuShards : devices.size();
+    const unsigned int cpuThreads = options.cpuThreads;
+    options.cpuThreads = std::max<unsigned int>(1, cpuThreads / shardCount);
+
+    std::vector<RotateShard> shards;
+    for (size_t i = 0; i < shardCount; ++i) {
+        RotateShard shard;
+        shard.numaNode = -1;
+        if (backendName != "cpu") {
+            options.deviceId = devices[i];
+        } else if (!numaNodes.empty()) {
+            const NumaNode &node = numaNodes[i % numaNodes.size()];
+            size_t nodeShards = (shardCount - i % numaNodes.size() + numaNodes.size() - 1) / numaNodes.size();
+            options.cpuThreads = std::max<unsigned int>(1, node.aCpus.size() / nodeShards);
+            options.numaNode = node.id;
+            shard.numaNode = node.id;
+        }
+        shard.label = backendName + ":" + std::to_string(backendName == "cpu" ? i : devices[i]);
+        shard.pBackend = createRotateBackend(backendName, options);
+        shards.push_back(std::move(shard));
     }
+    return createShardedBackend(std::move(shards));
 }
 
 int main(int argc, char *argv[])
 {
+    // In stream mode stdout carries the rotated frames, so everything the
+    // program prints goes to stderr instead.
+    int streamOutputFd = -1;
+    if (checkCmdLineFlag(argc, (const char **)argv, "stream"))
+    {
+        streamOutputFd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
     printf("%s Starting...\n\n", argv[0]);
 
     try
     {
-        findCudaDevice(argc, (const char **)argv);
+        // The CPU backend runs without a CUDA device, so device setup is
+        // skipped for it; "auto" uses both.
+        std::string backendName = "npp";
+        if (checkCmdLineFlag(argc, (const char **)argv, "backend"))
+        {
+            char *name;
+            getCmdLineArgumentString(argc, (const char **)argv, "backend", &name);
+            backendName = name;
+        }
+        if (backendName != "npp" && backendName != "cpu" && backendName != "auto")
+        {
+            std::cerr << "Invalid --backend, expected --backend=npp, cpu or auto" << std::endl;
+            exit(EXIT_FAILURE);
+        }
 
-        if (printfNPPinfo(argc, argv) == false)
+        // Set before any image buffer is allocated
+        if (checkCmdLineFlag(argc, (const char **)argv, "huge-pages"))
         {
-            exit(EXIT_SUCCESS);
+            char *modeName;
+            getCmdLineArgumentString(argc, (const char **)argv, "huge-pages", &modeName);
+            HugePageMode mode;
+            if (!parseHugePageMode(modeName, mode)) {
+                std::cerr << "Invalid --huge-pages, expected --huge-pages=off, 2m or 1g" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            setHugePageMode(mode);
+        }
+
+        setPerfCounters(checkCmdLineFlag(argc, (const char **)argv, "perf-counters"));
+
+        int deviceId = 0;
+        if (backendName != "cpu")
+        {
+            deviceId = findCudaDevice(argc, (const char **)argv);
+
+            if (printfNPPinfo(argc, argv) == false)
+            {
+                exit(EXIT_SUCCESS);
+            }
         }
 
         // Configuration
@@ -174,6 +258,14 @@ int main(int argc, char *argv[])
         std::string outputDir = "output";
         std::string extension = ".tiff";
         double angle = 45.0;
+        unsigned int ioDepth = 16;
+        size_t prefetchMB = 256;
+        size_t memoryLimitMB = 0;
+        unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+        unsigned int packedBatch = 0;
+        JobOrder order = ORDER_LARGEST_FIRST;
+        bool useROI = false;
+        NppiRect roi = {0, 0, 0, 0};
 
         // Parse command line arguments
         if (checkCmdLineFlag(argc, (const char **)argv, "input-dir"))
@@ -192,7 +284,78 @@ int main(int argc, char *argv[])
 
         if (checkCmdLineFlag(argc, (const char **)argv, "angle"))
         {
-            angle = getCmdLineArgumentFloat(argc, (const char **)argv, "angle");
+            char *angleText;
+            getCmdLineArgumentString(argc, (const char **)argv, "angle", &angleText);
+            angle = std::string(angleText) == "auto" ? kAutoAngle
+                                                     : getCmdLineArgumentFloat(argc, (const char **)argv, "angle");
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "roi"))
+        {
+            char *roiText;
+            getCmdLineArgumentString(argc, (const char **)argv, "roi", &roiText);
+            if (!parseROI(roiText, roi)) {
+                std::cerr << "Invalid --roi, expected --roi=x,y,w,h" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            useROI = true;
+        }
+
+        // The ROI is given in the rotated image and stream frames have no
+        // time for an estimate, so both need a fixed angle
+        if (isAutoAngle(angle) && (useROI || streamOutputFd >= 0))
+        {
+            std::cerr << "--angle=auto cannot be combined with --roi or --stream" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // The tag can only express quarter turns of the whole image
+        const bool orientationOnly = checkCmdLineFlag(argc, (const char **)argv, "orientation-only");
+        if (orientationOnly && (isAutoAngle(angle) || !isQuarterTurn(angle) || useROI || streamOutputFd >= 0))
+        {
+            std::cerr << "--orientation-only needs an --angle that is a multiple of 90 and cannot be combined with "
+                         "--roi or --stream" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "io-depth"))
+        {
+            int depth = getCmdLineArgumentInt(argc, (const char **)argv, "io-depth");
+            ioDepth = depth > 0 ? depth : 1;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "prefetch-mb"))
+        {
+            int megabytes = getCmdLineArgumentInt(argc, (const char **)argv, "prefetch-mb");
+            prefetchMB = megabytes > 0 ? megabytes : 0;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "memory-limit"))
+        {
+            int megabytes = getCmdLineArgumentInt(argc, (const char **)argv, "memory-limit");
+            memoryLimitMB = megabytes > 0 ? megabytes : 0;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "workers"))
+        {
+            int count = getCmdLineArgumentInt(argc, (const char **)argv, "workers");
+            workers = count > 0 ? count : 1;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "batch-small"))
+        {
+            int count = getCmdLineArgumentInt(argc, (const char **)argv, "batch-small");
+            packedBatch = count > 0 ? count : 0;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "order"))
+        {
+            char *orderName;
+            getCmdLineArgumentString(argc, (const char **)argv, "order", &orderName);
+            if (!parseJobOrder(orderName, order)) {
+                std::cerr << "Invalid --order, expected largest-first, smallest-first, fs or random" << std::endl;
+                exit(EXIT_FAILURE);
+            }
         }
 
         if (checkCmdLineFlag(argc, (const char **)argv, "extension"))
@@ -205,68 +368,361 @@ int main(int argc, char *argv[])
             }
         }
 
+        // Synthetic workload.  Its format defaults to the extension filter,
+        // so that a later run finds the generated files.
+        SyntheticSpec synthetic = defaultSyntheticSpec();
+        parseSyntheticFormats(extension, synthetic);
+        if (checkCmdLineFlag(argc, (const char **)argv, "seed"))
+        {
+            char *seedText, *end;
+            getCmdLineArgumentString(argc, (const char **)argv, "seed", &seedText);
+            synthetic.seed = strtoull(seedText, &end, 0);
+            if (*seedText == '\0' || *end != '\0') {
+                std::cerr << "Invalid --seed, expected an unsigned integer" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (checkCmdLineFlag(argc, (const char **)argv, "synthetic-size"))
+        {
+            char *sizeText;
+            getCmdLineArgumentString(argc, (const char **)argv, "synthetic-size", &sizeText);
+            if (!parseSyntheticSize(sizeText, synthetic)) {
+                std::cerr << "Invalid --synthetic-size, expected fixed:WxH, uniform:MIN-MAX or lognormal:MEDIAN,SIGMA"
+                          << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (checkCmdLineFlag(argc, (const char **)argv, "synthetic-depth"))
+        {
+            char *depths;
+            getCmdLineArgumentString(argc, (const char **)argv, "synthetic-depth", &depths);
+            if (!parseSyntheticDepths(depths, synthetic)) {
+                std::cerr << "Invalid --synthetic-depth, expected a list of 8 and 16" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (checkCmdLineFlag(argc, (const char **)argv, "synthetic-channels"))
+        {
+            char *channels;
+            getCmdLineArgumentString(argc, (const char **)argv, "synthetic-channels", &channels);
+            if (!parseSyntheticChannels(channels, synthetic)) {
+                std::cerr << "Invalid --synthetic-channels, expected a list of 1, 3 and 4" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (checkCmdLineFlag(argc, (const char **)argv, "synthetic-format"))
+        {
+            char *formats;
+            getCmdLineArgumentString(argc, (const char **)argv, "synthetic-format", &formats);
+            if (!parseSyntheticFormats(formats, synthetic)) {
+                std::cerr << "Invalid --synthetic-format, expected a list of tiff, png, pgm, jpg and bmp" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        setSyntheticSpec(synthetic);
+
+        // In-memory images have no file to read windows or tags from, and
+        // stream and daemon jobs come from their clients
+        size_t syntheticCount = 0;
+        if (checkCmdLineFlag(argc, (const char **)argv, "synthetic"))
+        {
+            std::string countText;
+            getExactCmdLineArgument(argc, argv, "synthetic", countText);
+            syntheticCount = (size_t)std::max(0, atoi(countText.c_str()));
+            if (useROI || orientationOnly || streamOutputFd >= 0 ||
+                checkCmdLineFlag(argc, (const char **)argv, "daemon")) {
+                std::cerr << "--synthetic cannot be combined with --roi, --orientation-only, --stream or --daemon"
+                          << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        BackendOptions backendOptions;
+        backendOptions.deviceId = deviceId;
+        backendOptions.slots = std::max(3u, workers);    // at least triple buffered
+        backendOptions.cpuThreads = std::max(1u, std::thread::hardware_concurrency());
+        backendOptions.transferMBps = 0.0;
+        backendOptions.profilePath = "rotate_profile.txt";
+        backendOptions.recalibrate = checkCmdLineFlag(argc, (const char **)argv, "calibrate");
+        backendOptions.numaNode = -1;
+        backendOptions.border = CPU_BORDER_CONSTANT;
+        if (checkCmdLineFlag(argc, (const char **)argv, "profile"))
+        {
+            char *profilePath;
+            getCmdLineArgumentString(argc, (const char **)argv, "profile", &profilePath);
+            backendOptions.profilePath = profilePath;
+        }
+        if (checkCmdLineFlag(argc, (const char **)argv, "transfer-mbps"))
+        {
+            backendOptions.transferMBps = std::max(0.0f, getCmdLineArgumentFloat(argc, (const char **)argv, "transfer-mbps"));
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "border"))
+        {
+            char *borderName;
+            getCmdLineArgumentString(argc, (const char **)argv, "border", &borderName);
+            if (!parseCpuBorderMode(borderName, backendOptions.border)) {
+                std::cerr << "Invalid --border, expected constant, replicate or reflect" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            // nppiRotate only leaves the background untouched, and the edge
+            // pixels a border repeats are not in every source window
+            if (backendOptions.border != CPU_BORDER_CONSTANT && backendName != "cpu") {
+                std::cerr << "--border=" << borderName << " needs --backend=cpu" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if (backendOptions.border != CPU_BORDER_CONSTANT && (useROI || memoryLimitMB > 0)) {
+                std::cerr << "--border=" << borderName << " cannot be combined with --roi or --memory-limit" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // NUMA placement only matters with more than one node
+        std::vector<NumaNode> numaNodes;
+        if (!checkCmdLineFlag(argc, (const char **)argv, "no-numa"))
+        {
+            numaNodes = detectNumaNodes();
+            if (numaNodes.size() < 2) {
+                numaNodes.clear();
+            }
+        }
+        if (!numaNodes.empty())
+        {
+            std::cout << "NUMA nodes: " << numaNodes.size() << ", workers and CPU shards are placed per node" << std::endl;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "overviews"))
+        {
+            int levels = getCmdLineArgumentInt(argc, (const char **)argv, "overviews");
+            setOverviewLevels(levels);
+            if (overviewLevels() > 0) {
+                std::cout << "Overviews: " << overviewLevels() << " level(s), 2x to " << (1 << overviewLevels())
+                          << "x, written into TIFF outputs" << std::endl;
+            }
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "remap-cache-mb"))
+        {
+            int megabytes = getCmdLineArgumentInt(argc, (const char **)argv, "remap-cache-mb");
+            setRemapCacheLimit((size_t)std::max(0, megabytes) << 20);
+        }
+
+        // Writing a synthetic data set needs no backend either
+        if (checkCmdLineFlag(argc, (const char **)argv, "generate"))
+        {
+            int count = std::max(0, getCmdLineArgumentInt(argc, (const char **)argv, "generate"));
+            fs::create_directories(inputDir);
+            std::cout << "Generating " << count << " synthetic image(s) in " << inputDir << ": "
+                      << describeSyntheticSpec(synthetic) << "\n" << std::endl;
+            size_t failed = writeSyntheticImages(synthetic, count, inputDir, workers);
+            exit(failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        // The benchmark brings its own backends and synthetic images
+        if (checkCmdLineFlag(argc, (const char **)argv, "benchmark"))
+        {
+            BenchmarkConfig benchConfig;
+            benchConfig.baselinePath = "rotate_baseline.txt";
+            if (checkCmdLineFlag(argc, (const char **)argv, "baseline")) {
+                char *path;
+                getCmdLineArgumentString(argc, (const char **)argv, "baseline", &path);
+                benchConfig.baselinePath = path;
+            }
+            benchConfig.updateBaseline = checkCmdLineFlag(argc, (const char **)argv, "update-baseline");
+            benchConfig.thresholdPercent = 5.0;
+            if (checkCmdLineFlag(argc, (const char **)argv, "regression-threshold")) {
+                benchConfig.thresholdPercent =
+                    std::max(0.0f, getCmdLineArgumentFloat(argc, (const char **)argv, "regression-threshold"));
+            }
+            benchConfig.repetitions = 10;
+            if (checkCmdLineFlag(argc, (const char **)argv, "bench-samples")) {
+                benchConfig.repetitions =
+                    std::max(2, getCmdLineArgumentInt(argc, (const char **)argv, "bench-samples"));
+            }
+            if (backendName != "npp") {
+                benchConfig.backends.push_back("cpu");
+            }
+            if (backendName != "cpu") {
+                benchConfig.backends.push_back("npp");
+            }
+            benchConfig.backendOptions = backendOptions;
+            exit(runBenchmark(benchConfig));
+        }
+
+        // Sharding: one backend per listed device, or several CPU backends
+        std::vector<int> devices(1, deviceId);
+        if (backendName != "cpu" && checkCmdLineFlag(argc, (const char **)argv, "devices"))
+        {
+            char *deviceList;
+            getCmdLineArgumentString(argc, (const char **)argv, "devices", &deviceList);
+            if (!parseDeviceList(deviceList, devices)) {
+                std::cerr << "Invalid --devices, expected --devices=all or --devices=0,1,..." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        unsigned int cpuShards = numaNodes.empty() ? 1 : numaNodes.size();
+        if (checkCmdLineFlag(argc, (const char **)argv, "cpu-shards"))
+        {
+            int count = getCmdLineArgumentInt(argc, (const char **)argv, "cpu-shards");
+            cpuShards = count > 0 ? count : 1;
+        }
+
+        setRotateBackend(createBackends(backendName, backendOptions, devices, cpuShards, numaNodes));
+        std::cout << "Rotation backend: " << backendName << " x "
+                  << (backendName == "cpu" ? cpuShards : devices.size()) << std::endl;
+        if (backendOptions.border != CPU_BORDER_CONSTANT)
+        {
+            std::cout << "Border: " << cpuBorderModeName(backendOptions.border) << std::endl;
+        }
+
+        if (checkCmdLineFlag(argc, (const char **)argv, "daemon"))
+        {
+            char *socketPath;
+            getCmdLineArgumentString(argc, (const char **)argv, "daemon", &socketPath);
+
+            DaemonConfig daemonConfig;
+            daemonConfig.socketPath = socketPath;
+            daemonConfig.workers = workers;
+            daemonConfig.deviceId = deviceId;
+            int exitCode = runDaemon(daemonConfig);
+            releaseRotateBackend();
+            exit(exitCode);
+        }
+
+        if (streamOutputFd >= 0)
+        {
+            StreamConfig streamConfig;
+            streamConfig.angle = angle;
+            streamConfig.useROI = useROI;
+            streamConfig.roi = roi;
+            streamConfig.workers = workers;
+            streamConfig.deviceId = deviceId;
+            int exitCode = runStream(STDIN_FILENO, streamOutputFd, streamConfig);
+            releaseRotateBackend();
+            exit(exitCode);
+        }
+
         // Create output directory if it doesn't exist
         fs::create_directories(outputDir);
 
-        // Get all image files
-        std::cout << "Scanning directory: " << inputDir << std::endl;
-        std::cout << "Looking for files with extension: " << extension << std::endl;
-        std::vector<std::string> imageFiles = getImageFiles(inputDir, extension);
-
-        if (imageFiles.empty()) {
-            std::cout << "No images found with extension " << extension << " in " << inputDir << std::endl;
-            std::cout << "\nTrying alternative extensions..." << std::endl;
-            
-            // Try common image extensions
-            std::vector<std::string> extensions = {".pgm", ".ppm", ".jpg", ".png", ".bmp"};
-            for (const auto& ext : extensions) {
-                imageFiles = getImageFiles(inputDir, ext);
-                if (!imageFiles.empty()) {
-                    extension = ext;
-                    std::cout << "Found " << imageFiles.size() << " images with " << ext << " extension" << std::endl;
-                    break;
-                }
-            }
-            
+        // Get all image files, or the synthetic ones
+        std::vector<std::string> imageFiles;
+        if (syntheticCount > 0) {
+            std::cout << "Synthetic images: " << describeSyntheticSpec(synthetic) << ", generated in memory"
+                      << std::endl;
+            imageFiles = syntheticImagePaths(syntheticCount);
+        } else {
+            std::cout << "Scanning directory: " << inputDir << std::endl;
+            std::cout << "Looking for files with extension: " << extension << std::endl;
+            imageFiles = getImageFiles(inputDir, extension);
+
             if (imageFiles.empty()) {
-                std::cerr << "No supported image files found!" << std::endl;
-                exit(EXIT_FAILURE);
+                std::cout << "No images found with extension " << extension << " in " << inputDir << std::endl;
+                std::cout << "\nTrying alternative extensions..." << std::endl;
+
+                // Try common image extensions
+                std::vector<std::string> extensions = {".pgm", ".ppm", ".jpg", ".png", ".bmp"};
+                for (const auto& ext : extensions) {
+                    imageFiles = getImageFiles(inputDir, ext);
+                    if (!imageFiles.empty()) {
+                        extension = ext;
+                        std::cout << "Found " << imageFiles.size() << " images with " << ext << " extension" << std::endl;
+                        break;
+                    }
+                }
+
+                if (imageFiles.empty()) {
+                    std::cerr << "No supported image files found!" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
             }
         }
 
         std::cout << "\nFound " << imageFiles.size() << " image(s) to process\n" << std::endl;
-        std::cout << "Rotation angle: " << angle << " degrees\n" << std::endl;
+        orderJobs(imageFiles, order, isAutoAngle(angle) ? kMaxSkewAngle : angle, useROI ? &roi : nullptr);
+        std::cout << "Job order: " << jobOrderName(order) << "\n" << std::endl;
+        if (isAutoAngle(angle)) {
+            std::cout << "Rotation angle: auto, estimated skew up to " << kMaxSkewAngle << " degrees\n" << std::endl;
+        } else {
+            std::cout << "Rotation angle: " << angle << " degrees\n" << std::endl;
+        }
+        if (useROI) {
+            std::cout << "Output ROI: " << roi.x << "," << roi.y << " " << roi.width << "x" << roi.height << "\n" << std::endl;
+        }
 
-        // Process statistics
-        int successCount = 0;
-        int failCount = 0;
-        auto startTime = std::chrono::high_resolution_clock::now();
+        BatchConfig config;
+        config.outputDir = outputDir;
+        config.angle = angle;
+        config.useROI = useROI;
+        config.roi = roi;
+        config.ioDepth = ioDepth;
+        config.useUring = !checkCmdLineFlag(argc, (const char **)argv, "no-io-uring");
+        config.prefetchBytes = prefetchMB << 20;
+        config.memoryLimit = memoryLimitMB << 20;
+        config.workers = workers;
+        config.packedBatch = packedBatch;
+        config.deviceId = deviceId;
+        config.numaNodes = numaNodes;
+        config.orientationOnly = orientationOnly;
+        config.pJournal = nullptr;
+        config.verifyResume = checkCmdLineFlag(argc, (const char **)argv, "verify-resume");
+
+        // A journaled output is only reused if it was made the same way
+        std::ostringstream parameters;
+        parameters << std::setprecision(10) << "angle=";
+        if (isAutoAngle(angle)) {
+            parameters << "auto";
+        } else {
+            parameters << angle;
+        }
+        if (useROI) {
+            parameters << " roi=" << roi.x << "," << roi.y << "," << roi.width << "," << roi.height;
+        }
+        parameters << " backend=" << backendName << " border=" << cpuBorderModeName(backendOptions.border)
+                   << " overviews=" << overviewLevels() << (orientationOnly ? " orientation-only" : "");
+        if (syntheticCount > 0) {
+            parameters << " synthetic=" << describeSyntheticSpec(synthetic);
+        }
+        config.parameters = parameters.str();
 
-        // Process each image
-        for (size_t i = 0; i < imageFiles.size(); ++i) {
-            std::cout << "\n[" << (i+1) << "/" << imageFiles.size() << "] ";
-            
-            std::string inputPath = imageFiles[i];
-            fs::path inPath(inputPath);
-            
-            // Create output filename
-            std::string outputFilename = inPath.stem().string() + "_rotated" + inPath.extension().string();
-            std::string outputPath = outputDir + "/" + outputFilename;
-
-            auto imgStartTime = std::chrono::high_resolution_clock::now();
-            bool success = processImage(inputPath, outputPath, angle);
-            auto imgEndTime = std::chrono::high_resolution_clock::now();
-            
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(imgEndTime - imgStartTime);
-            std::cout << "  Time: " << duration.count() << " ms" << std::endl;
-
-            if (success) {
-                successCount++;
-            } else {
-                failCount++;
+        std::unique_ptr<ProgressJournal> journal;
+        std::string journalPath;
+        if (checkCmdLineFlag(argc, (const char **)argv, "resume") ||
+            checkCmdLineFlag(argc, (const char **)argv, "journal"))
+        {
+            journalPath = outputDir + "/" + kJournalFileName;
+            if (checkCmdLineFlag(argc, (const char **)argv, "journal")) {
+                char *pathText;
+                getCmdLineArgumentString(argc, (const char **)argv, "journal", &pathText);
+                journalPath = pathText;
             }
+            unsigned int intervalMs = 1000;
+            if (checkCmdLineFlag(argc, (const char **)argv, "commit-interval-ms")) {
+                intervalMs = std::max(1, getCmdLineArgumentInt(argc, (const char **)argv, "commit-interval-ms"));
+            }
+            journal.reset(new ProgressJournal(journalPath, outputDir, intervalMs));
+            config.pJournal = journal.get();
+            std::cout << "Journal: " << journalPath << ", committed every " << intervalMs << " ms" << std::endl;
         }
 
+        if (orientationOnly) {
+            std::cout << "Orientation only: TIFF and JPEG files are copied with a new orientation tag" << std::endl;
+        }
+        std::cout << "Workers: " << workers << ", memory limit: ";
+        if (memoryLimitMB > 0) {
+            std::cout << memoryLimitMB << " MB";
+        } else {
+            std::cout << "none";
+        }
+        std::cout << "\n" << std::endl;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        BatchStats stats = runBatch(imageFiles, config);
+        journal.reset();    // commits the last records
+        releaseRotateBackend();
+        int successCount = stats.successCount;
+        int failCount = stats.failCount;
+
         auto endTime = std::chrono::high_resolution_clock::now();
         auto totalDuration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
 
@@ -277,6 +733,33 @@ int main(int argc, char *argv[])
         std::cout << "Total images processed: " << imageFiles.size() << std::endl;
         std::cout << "Successful: " << successCount << std::endl;
         std::cout << "Failed: " << failCount << std::endl;
+        if (!journalPath.empty()) {
+            std::cout << "Resumed (already complete): " << stats.resumedCount << std::endl;
+        }
+        if (memoryLimitMB > 0) {
+            std::cout << "Tiled (over memory limit): " << stats.tiledCount << std::endl;
+            std::cout << "Peak reserved memory: " << (stats.peakReserved >> 20) << " MB" << std::endl;
+        }
+        if (orientationOnly) {
+            std::cout << "Orientation tag only: " << stats.orientedCount << std::endl;
+        }
+        if (packedBatch > 1) {
+            std::cout << "Packed (small-image batches): " << stats.packedCount << std::endl;
+        }
+        RemapCacheStats remaps = remapCacheStats();
+        if (remaps.built > 0) {
+            std::cout << "Remap tables: " << remaps.built << " built, " << remaps.reused << " rotation(s) from cache, "
+                      << remaps.evicted << " evicted" << std::endl;
+        }
+        if (hugePageMode() != HUGE_PAGES_OFF) {
+            HugePageStats pages = hugePageStats();
+            std::cout << "Huge-page buffers (" << hugePageModeName(hugePageMode()) << "): " << pages.hugetlb
+                      << " hugetlbfs, " << pages.transparent << " transparent, " << pages.regular
+                      << " regular pages" << std::endl;
+        }
+        if (perfCountersEnabled()) {
+            std::cout << "Perf counters per stage:\n" << formatPerfCounters("  ");
+        }
         std::cout << "Total time: " << totalDuration.count() << " ms" << std::endl;
         std::cout << "Average time per image: " << (imageFiles.size() > 0 ? totalDuration.count() / imageFiles.size() : 0) << " ms" << std::endl;
         std::cout << "Output directory: " << outputDir << std::endl;
@@ -289,16 +772,47 @@ int main(int argc, char *argv[])
             logFile << "NPP Image Rotation Processing Log\n";
             logFile << "==================================\n\n";
             logFile << "Date: " << __DATE__ << " " << __TIME__ << "\n";
-            logFile << "Input directory: " << inputDir << "\n";
+            if (syntheticCount > 0) {
+                logFile << "Input: synthetic, " << describeSyntheticSpec(synthetic) << "\n";
+            } else {
+                logFile << "Input directory: " << inputDir << "\n";
+            }
             logFile << "Output directory: " << outputDir << "\n";
-            logFile << "Rotation angle: " << angle << " degrees\n";
-            logFile << "Extension filter: " << extension << "\n\n";
+            if (isAutoAngle(angle)) {
+                logFile << "Rotation angle: auto\n";
+            } else {
+                logFile << "Rotation angle: " << angle << " degrees\n";
+            }
+            if (useROI) {
+                logFile << "Output ROI: " << roi.x << "," << roi.y << " " << roi.width << "x" << roi.height << "\n";
+            }
+            logFile << "Extension filter: " << extension << "\n";
+            logFile << "File I/O: " << stats.ioName << ", queue depth " << ioDepth << "\n";
+            logFile << "Read-ahead budget: " << (useROI ? 0 : prefetchMB) << " MB\n";
+            logFile << "Workers: " << workers << "\n";
+            logFile << "Small-image batch: " << packedBatch << "\n";
+            logFile << "Job order: " << jobOrderName(order) << "\n";
+            logFile << "Huge pages: " << hugePageModeName(hugePageMode()) << "\n";
+            logFile << "Overviews: " << overviewLevels() << "\n";
+            logFile << "Border: " << cpuBorderModeName(backendOptions.border) << "\n";
+            logFile << "Orientation only: " << (orientationOnly ? "yes" : "no") << "\n";
+            logFile << "Journal: " << (journalPath.empty() ? "none" : journalPath) << "\n";
+            logFile << "Memory limit: " << memoryLimitMB << " MB\n\n";
             logFile << "Results:\n";
             logFile << "  Total images: " << imageFiles.size() << "\n";
             logFile << "  Successful: " << successCount << "\n";
             logFile << "  Failed: " << failCount << "\n";
+            logFile << "  Resumed (already complete): " << stats.resumedCount << "\n";
+            logFile << "  Tiled (over memory limit): " << stats.tiledCount << "\n";
+            logFile << "  Peak reserved memory: " << (stats.peakReserved >> 20) << " MB\n";
+            logFile << "  Packed (small-image batches): " << stats.packedCount << "\n";
+            logFile << "  Orientation tag only: " << stats.orientedCount << "\n";
             logFile << "  Total time: " << totalDuration.count() << " ms\n";
-            logFile << "  Average time: " << (imageFiles.size() > 0 ? totalDuration.count() / imageFiles.size() : 0) << " ms\n\n";
+            logFile << "  Average time: " << (imageFiles.size() > 0 ? totalDuration.count() / imageFiles.size() : 0) << " ms\n";
+            if (perfCountersEnabled()) {
+                logFile << "  Perf counters per stage:\n" << formatPerfCounters("    ");
+            }
+            logFile << "\n";
             logFile << "Processed files:\n";
             for (const auto& file : imageFiles) {
                 logFile << "  - " << file << "\n";
@@ -0,0 +1,107 @@
+#include "jobOrder.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#include "imageCodec.h"
+#include "rotateGeometry.h"
+
+namespace
+{
+
+const char *const kOrderNames[] = {"largest-first", "smallest-first", "fs", "random"};
+
+// Pixels decoded plus pixels produced.  Sizes are only read from headers;
+// a file whose size cannot be had that way is costed as a square 8-bit
+// image of one pixel per byte on disk, so that it sorts on the same scale
+// (compressed files come out smaller than they are).
+double estimateJobCost(const std::string &path, double angle, const NppiRect *pROI)
+{
+    NppiSize oSrcSize;
+    if (!probeImageSize(path, oSrcSize, true)) {
+        struct stat oStat;
+        if (stat(path.c_str(), &oStat) != 0 || oStat.st_size <= 0) {
+            return 0.0;
+        }
+        const int side = (int)std::min(std::ceil(std::sqrt((double)oStat.st_size)), (double)INT_MAX);
+        oSrcSize = NppiSize{side, side};
+    }
+
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, angle);
+    NppiRect oSrcWindow = {0, 0, oSrcSize.width, oSrcSize.height};
+    NppiRect oDstROI = oGeometry.bound;
+    if (pROI) {
+        oDstROI = intersectRect(*pROI, oGeometry.bound);
+        oSrcWindow = isEmptyRect(oDstROI) ? NppiRect{0, 0, 0, 0} : backProjectROI(oGeometry, oDstROI);
+    }
+    return (double)oSrcWindow.width * oSrcWindow.height + (double)oDstROI.width * oDstROI.height;
+}
+
+} // namespace
+
+bool parseJobOrder(const std::string &name, JobOrder &rOrder)
+{
+    for (int i = 0; i < 4; ++i) {
+        if (name == kOrderNames[i]) {
+            rOrder = (JobOrder)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *jobOrderName(JobOrder order)
+{
+    return kOrderNames[order];
+}
+
+void orderJobs(std::vector<std::string> &imageFiles, JobOrder order, double angle, const NppiRect *pROI)
+{
+    if (order == ORDER_FS) {
+        return;
+    }
+    if (order == ORDER_RANDOM) {
+        std::shuffle(imageFiles.begin(), imageFiles.end(), std::mt19937(std::random_device()()));
+        return;
+    }
+
+    // Headers are probed in parallel; on network file systems each probe is
+    // a round trip.
+    std::vector<double> aCosts(imageFiles.size());
+    std::atomic<size_t> nNext(0);
+    auto probe = [&] {
+        for (size_t i = nNext++; i < imageFiles.size(); i = nNext++) {
+            aCosts[i] = estimateJobCost(imageFiles[i], angle, pROI);
+        }
+    };
+    std::vector<std::thread> aThreads;
+    unsigned int nThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), imageFiles.size());
+    for (unsigned int i = 1; i < nThreads; ++i) {
+        aThreads.emplace_back(probe);
+    }
+    probe();
+    for (auto &rThread : aThreads) {
+        rThread.join();
+    }
+
+    // Stable, so that equal costs keep directory order
+    std::vector<size_t> aIndices(imageFiles.size());
+    std::iota(aIndices.begin(), aIndices.end(), 0);
+    std::stable_sort(aIndices.begin(), aIndices.end(), [&](size_t a, size_t b) {
+        return order == ORDER_LARGEST_FIRST ? aCosts[a] > aCosts[b] : aCosts[a] < aCosts[b];
+    });
+
+    std::vector<std::string> aOrdered;
+    aOrdered.reserve(imageFiles.size());
+    for (size_t i : aIndices) {
+        aOrdered.push_back(std::move(imageFiles[i]));
+    }
+    imageFiles.swap(aOrdered);
+}
@@ -0,0 +1,34 @@
+/* Order in which the batch processes its files.
+ *
+ * The scheduler admits jobs in list order, so a large image that happens to
+ * come last keeps one worker busy while the others sit idle.  Sorting the
+ * list by estimated cost, largest first, lets the small jobs fill in around
+ * the large ones at the end of the run.  A job's cost is the pixel count it
+ * decodes and rotates, taken from the image header; files whose header
+ * cannot be read count by their size on disk.
+ */
+
+#ifndef JOB_ORDER_H
+#define JOB_ORDER_H
+
+#include <npp.h>
+
+#include <string>
+#include <vector>
+
+enum JobOrder
+{
+    ORDER_LARGEST_FIRST,        // shortest makespan with parallel workers
+    ORDER_SMALLEST_FIRST,
+    ORDER_FS,                   // directory iteration order
+    ORDER_RANDOM
+};
+
+// Parses "largest-first", "smallest-first", "fs" or "random".
+bool parseJobOrder(const std::string &name, JobOrder &rOrder);
+const char *jobOrderName(JobOrder order);
+
+// Reorders imageFiles for a rotation by angle, restricted to pROI if set.
+void orderJobs(std::vector<std::string> &imageFiles, JobOrder order, double angle, const NppiRect *pROI);
+
+#endif // JOB_ORDER_H
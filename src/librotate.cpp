@@ -0,0 +1,227 @@
+#include <librotate.h>
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "batchRotate.h"
+#include "logging.h"
+#include "rotateBackend.h"
+#include "rotateEngine.h"
+
+namespace
+{
+
+bool validSource(const RotateSource &rSrc)
+{
+    return rSrc.data && rSrc.width > 0 && rSrc.height > 0 && rSrc.pitch >= rSrc.width;
+}
+
+void logException(const npp::Exception &rException)
+{
+    std::ostringstream oMessage;
+    oMessage << "  librotate: " << rException;
+    logError(oMessage.str());
+}
+
+// Status for the exception being handled.  Called from catch (...) so that
+// nothing unwinds into a C caller.
+int currentExceptionStatus()
+{
+    try {
+        throw;
+    }
+    catch (npp::Exception &rException) {
+        logException(rException);
+        return ROTATE_ERROR_DEVICE;
+    }
+    catch (std::bad_alloc &) {
+        logError("  librotate: out of memory");
+        return ROTATE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...) {
+        logError("  librotate: unexpected exception");
+        return ROTATE_ERROR_DEVICE;
+    }
+}
+
+// Checks a job and fills in its output size.  Returns ROTATE_SUCCESS if the
+// job can run.
+int prepareJob(const RotateJob &rJob, RotateResult &rResult)
+{
+    rResult.width = 0;
+    rResult.height = 0;
+
+    if (!validSource(rJob.src) || !rJob.dst.data || rJob.dst.pitch < rJob.dst.width) {
+        return ROTATE_ERROR_INVALID_ARGUMENT;
+    }
+
+    NppiSize oSrcSize = {rJob.src.width, rJob.src.height};
+    NppiRect oROI = {rJob.roi[0], rJob.roi[1], rJob.roi[2], rJob.roi[3]};
+    const NppiRect *pROI = rJob.useROI ? &oROI : nullptr;
+
+    NppiSize oDstSize;
+    try {
+        oDstSize = rotatedImageSize(oSrcSize, rJob.angle, pROI);
+    }
+    catch (...) {
+        return currentExceptionStatus();
+    }
+    if (oDstSize.width <= 0 || oDstSize.height <= 0) {
+        return ROTATE_ERROR_ROI_OUTSIDE;
+    }
+    rResult.width = oDstSize.width;
+    rResult.height = oDstSize.height;
+    if (oDstSize.width > rJob.dst.width || oDstSize.height > rJob.dst.height) {
+        return ROTATE_ERROR_BUFFER_TOO_SMALL;
+    }
+    return ROTATE_SUCCESS;
+}
+
+bool isPackable(const RotateJob &rJob)
+{
+    return !rJob.useROI && (size_t)rJob.src.width * rJob.src.height <= kSmallImagePixels;
+}
+
+int runJob(const RotateJob &rJob)
+{
+    NppiSize oSrcSize = {rJob.src.width, rJob.src.height};
+    NppiRect oROI = {rJob.roi[0], rJob.roi[1], rJob.roi[2], rJob.roi[3]};
+    try {
+        rotateImage(rJob.src.data, rJob.src.pitch, oSrcSize, rJob.angle, rJob.useROI ? &oROI : nullptr,
+                    rJob.dst.data, rJob.dst.pitch);
+    }
+    catch (...) {
+        return currentExceptionStatus();
+    }
+    return ROTATE_SUCCESS;
+}
+
+} // namespace
+
+extern "C" int rotateInit(int deviceId)
+{
+    return cudaSetDevice(deviceId) == cudaSuccess ? ROTATE_SUCCESS : ROTATE_ERROR_DEVICE;
+}
+
+extern "C" int rotateOutputSize(int width, int height, double angle, const int *roi, int *pWidth, int *pHeight)
+{
+    if (width <= 0 || height <= 0 || !pWidth || !pHeight) {
+        return ROTATE_ERROR_INVALID_ARGUMENT;
+    }
+
+    NppiSize oSrcSize = {width, height};
+    NppiRect oROI = {0, 0, 0, 0};
+    if (roi) {
+        oROI = {roi[0], roi[1], roi[2], roi[3]};
+    }
+    NppiSize oDstSize;
+    try {
+        oDstSize = rotatedImageSize(oSrcSize, angle, roi ? &oROI : nullptr);
+    }
+    catch (...) {
+        return currentExceptionStatus();
+    }
+    if (oDstSize.width <= 0 || oDstSize.height <= 0) {
+        return ROTATE_ERROR_ROI_OUTSIDE;
+    }
+
+    *pWidth = oDstSize.width;
+    *pHeight = oDstSize.height;
+    return ROTATE_SUCCESS;
+}
+
+extern "C" size_t rotateBatch(const RotateJob *pJobs, RotateResult *pResults, size_t nJobs)
+{
+    if (!pJobs || !pResults) {
+        return 0;
+    }
+
+    // Small whole-image jobs share packed launches; the rest run one by one.
+    // The lists are sized up front so that filling them cannot throw.
+    std::vector<BatchImage> aPacked;
+    std::vector<size_t> aPackedJobs;
+    try {
+        aPacked.reserve(nJobs);
+        aPackedJobs.reserve(nJobs);
+    }
+    catch (...) {
+        const int status = currentExceptionStatus();
+        for (size_t i = 0; i < nJobs; ++i) {
+            pResults[i].status = status;
+            pResults[i].width = 0;
+            pResults[i].height = 0;
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < nJobs; ++i) {
+        const RotateJob &rJob = pJobs[i];
+        pResults[i].status = prepareJob(rJob, pResults[i]);
+        if (pResults[i].status != ROTATE_SUCCESS) {
+            continue;
+        }
+
+        if (isPackable(rJob)) {
+            NppiSize oSrcSize = {rJob.src.width, rJob.src.height};
+            BatchImage oImage = {rJob.src.data, rJob.src.pitch, oSrcSize, rJob.angle, rJob.dst.data, rJob.dst.pitch};
+            aPacked.push_back(oImage);
+            aPackedJobs.push_back(i);
+        } else {
+            pResults[i].status = runJob(rJob);
+        }
+    }
+
+    if (!aPacked.empty()) {
+        int status = ROTATE_SUCCESS;
+        try {
+            rotateBackend().rotateBatch(aPacked);
+        }
+        catch (...) {
+            status = currentExceptionStatus();
+        }
+        for (size_t i : aPackedJobs) {
+            pResults[i].status = status;
+        }
+    }
+
+    size_t nSucceeded = 0;
+    for (size_t i = 0; i < nJobs; ++i) {
+        if (pResults[i].status == ROTATE_SUCCESS) {
+            ++nSucceeded;
+        }
+    }
+    return nSucceeded;
+}
+
+extern "C" void rotateReleaseResources(void)
+{
+    try {
+        releaseRotateBackend();
+    }
+    catch (...) {
+        currentExceptionStatus();
+    }
+}
+
+extern "C" const char *rotateStatusString(int status)
+{
+    switch (status) {
+    case ROTATE_SUCCESS:
+        return "success";
+    case ROTATE_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case ROTATE_ERROR_ROI_OUTSIDE:
+        return "ROI lies outside of the rotated image";
+    case ROTATE_ERROR_BUFFER_TOO_SMALL:
+        return "destination buffer too small";
+    case ROTATE_ERROR_DEVICE:
+        return "device error";
+    case ROTATE_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    default:
+        return "unknown status";
+    }
+}
@@ -0,0 +1,28 @@
+/* Line-atomic console output for code that runs on worker threads. */
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <iostream>
+#include <mutex>
+#include <string>
+
+inline std::mutex &logMutex()
+{
+    static std::mutex s_mutex;
+    return s_mutex;
+}
+
+inline void logInfo(const std::string &rMessage)
+{
+    std::lock_guard<std::mutex> oLock(logMutex());
+    std::cout << rMessage << std::endl;
+}
+
+inline void logError(const std::string &rMessage)
+{
+    std::lock_guard<std::mutex> oLock(logMutex());
+    std::cerr << rMessage << std::endl;
+}
+
+#endif // LOGGING_H
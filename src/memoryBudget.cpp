@@ -0,0 +1,71 @@
+#include "memoryBudget.h"
+
+#include <Exceptions.h>
+
+#include <algorithm>
+
+#include "tiffPyramid.h"
+
+JobFootprint estimateJobFootprint(const NppiRect &srcWindow, const NppiRect &dstROI, size_t fileBytes)
+{
+    JobFootprint oFootprint;
+    oFootprint.srcBytes = (size_t)srcWindow.width * srcWindow.height;
+    oFootprint.dstBytes = (size_t)dstROI.width * dstROI.height;
+    // Uncompressed output formats are about the size of the raster.
+    oFootprint.encodedBytes = fileBytes + oFootprint.dstBytes;
+    // Overviews add up to a third of the raster
+    if (overviewLevels() > 0) {
+        oFootprint.encodedBytes += oFootprint.dstBytes / 3;
+    }
+    // FreeImage holds its own bitmap while decoding and encoding.
+    oFootprint.scratchBytes = oFootprint.srcBytes + oFootprint.dstBytes;
+
+    return oFootprint;
+}
+
+MemoryBudget::MemoryBudget(size_t limitBytes)
+    : nLimit_(limitBytes), nInUse_(0), nPeak_(0)
+{
+}
+
+bool MemoryBudget::tryAcquire(size_t nBytes)
+{
+    std::lock_guard<std::mutex> oLock(mutex_);
+    if (nLimit_ != 0 && nInUse_ + nBytes > nLimit_) {
+        return false;
+    }
+    nInUse_ += nBytes;
+    nPeak_ = std::max(nPeak_, nInUse_);
+    return true;
+}
+
+void MemoryBudget::acquire(size_t nBytes)
+{
+    NPP_ASSERT_MSG(fits(nBytes), "Reservation larger than the memory limit");
+
+    std::unique_lock<std::mutex> oLock(mutex_);
+    released_.wait(oLock, [&] { return nLimit_ == 0 || nInUse_ + nBytes <= nLimit_; });
+    nInUse_ += nBytes;
+    nPeak_ = std::max(nPeak_, nInUse_);
+}
+
+void MemoryBudget::release(size_t nBytes)
+{
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        nInUse_ -= std::min(nBytes, nInUse_);
+    }
+    released_.notify_all();
+}
+
+size_t MemoryBudget::inUse() const
+{
+    std::lock_guard<std::mutex> oLock(mutex_);
+    return nInUse_;
+}
+
+size_t MemoryBudget::peak() const
+{
+    std::lock_guard<std::mutex> oLock(mutex_);
+    return nPeak_;
+}
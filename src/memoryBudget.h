@@ -0,0 +1,77 @@
+/* Host memory admission control for the batch pipeline.
+ *
+ * Every job reserves its estimated peak footprint before its file is read
+ * and gives it back once its output has been written.  Jobs that do not fit
+ * in the remaining budget wait; jobs that could never fit are sent down the
+ * tiled path instead, which works in bounded pieces.
+ */
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <npp.h>
+
+#include <condition_variable>
+#include <mutex>
+
+struct JobFootprint
+{
+    size_t encodedBytes;    // input file plus encoded output
+    size_t srcBytes;        // decoded source (or source window)
+    size_t dstBytes;        // rotated output, nppiGetRotateBound size or ROI
+    size_t scratchBytes;    // codec bitmaps on both sides
+
+    size_t total() const
+    {
+        return encodedBytes + srcBytes + dstBytes + scratchBytes;
+    }
+};
+
+// Estimates the peak host memory of one job from its header dimensions.
+// srcWindow is the part of the source decoded (the whole image unless an ROI
+// is set) and dstROI the part of the rotated bounding box produced.
+JobFootprint estimateJobFootprint(const NppiRect &srcWindow, const NppiRect &dstROI, size_t fileBytes);
+
+class MemoryBudget
+{
+public:
+    // limitBytes == 0 disables the limit.
+    explicit MemoryBudget(size_t limitBytes);
+
+    bool limited() const
+    {
+        return nLimit_ != 0;
+    }
+
+    size_t limit() const
+    {
+        return nLimit_;
+    }
+
+    // True if a reservation of nBytes can ever be granted.
+    bool fits(size_t nBytes) const
+    {
+        return nLimit_ == 0 || nBytes <= nLimit_;
+    }
+
+    // Reserves nBytes if they are available right now.
+    bool tryAcquire(size_t nBytes);
+
+    // Blocks until nBytes are available.  nBytes must fit().
+    void acquire(size_t nBytes);
+
+    void release(size_t nBytes);
+
+    size_t inUse() const;
+    size_t peak() const;
+
+private:
+    const size_t nLimit_;
+    size_t nInUse_;
+    size_t nPeak_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+#endif // MEMORY_BUDGET_H
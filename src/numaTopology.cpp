@@ -0,0 +1,109 @@
+#include "numaTopology.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+thread_local int tCurrentNode = -1;
+
+// Parses a kernel CPU list such as "0-3,8-11".
+std::vector<int> parseCpuList(const std::string &text)
+{
+    std::vector<int> aCpus;
+    std::stringstream oList(text);
+    std::string range;
+    while (std::getline(oList, range, ',')) {
+        char *pEnd;
+        long first = strtol(range.c_str(), &pEnd, 10);
+        if (pEnd == range.c_str()) {
+            continue;
+        }
+        long last = *pEnd == '-' ? strtol(pEnd + 1, nullptr, 10) : first;
+        for (long cpu = first; cpu <= last; ++cpu) {
+            aCpus.push_back((int)cpu);
+        }
+    }
+    return aCpus;
+}
+
+} // namespace
+
+std::vector<NumaNode> detectNumaNodes()
+{
+    cpu_set_t oAllowed;
+    CPU_ZERO(&oAllowed);
+    if (sched_getaffinity(0, sizeof(oAllowed), &oAllowed) != 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &oAllowed);
+        }
+    }
+
+    std::vector<NumaNode> aNodes;
+    if (DIR *pDir = opendir("/sys/devices/system/node")) {
+        while (struct dirent *pEntry = readdir(pDir)) {
+            std::string name = pEntry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+
+            std::ifstream oFile("/sys/devices/system/node/" + name + "/cpulist");
+            std::string cpuList;
+            std::getline(oFile, cpuList);
+
+            NumaNode oNode;
+            oNode.id = atoi(name.c_str() + 4);
+            for (int cpu : parseCpuList(cpuList)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &oAllowed)) {
+                    oNode.aCpus.push_back(cpu);
+                }
+            }
+            if (!oNode.aCpus.empty()) {
+                aNodes.push_back(oNode);
+            }
+        }
+        closedir(pDir);
+    }
+
+    if (aNodes.empty()) {
+        NumaNode oNode;
+        oNode.id = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &oAllowed)) {
+                oNode.aCpus.push_back(cpu);
+            }
+        }
+        aNodes.push_back(oNode);
+    }
+
+    std::sort(aNodes.begin(), aNodes.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+    return aNodes;
+}
+
+bool bindThreadToNode(const NumaNode &rNode)
+{
+    cpu_set_t oSet;
+    CPU_ZERO(&oSet);
+    for (int cpu : rNode.aCpus) {
+        CPU_SET(cpu, &oSet);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(oSet), &oSet) != 0) {
+        return false;
+    }
+    tCurrentNode = rNode.id;
+    return true;
+}
+
+int currentNumaNode()
+{
+    return tCurrentNode;
+}
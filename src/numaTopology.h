@@ -0,0 +1,32 @@
+/* NUMA topology for thread and buffer placement.
+ *
+ * Nodes and their CPUs come from /sys/devices/system/node, restricted to
+ * the CPUs this process may run on.  A thread bound to a node with
+ * bindThreadToNode() only runs on that node's CPUs, and under the default
+ * first-touch policy the pages it writes first are placed in that node's
+ * memory.  Without NUMA information the machine is one node holding every
+ * allowed CPU.
+ */
+
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#include <vector>
+
+struct NumaNode
+{
+    int id;                     // kernel node number
+    std::vector<int> aCpus;
+};
+
+// Nodes with at least one allowed CPU, in node order.  Never empty.
+std::vector<NumaNode> detectNumaNodes();
+
+// Restricts the calling thread to rNode's CPUs.  Returns false if the
+// affinity could not be set.
+bool bindThreadToNode(const NumaNode &rNode);
+
+// Node the calling thread was bound to, -1 if it was not.
+int currentNumaNode();
+
+#endif // NUMA_TOPOLOGY_H
@@ -0,0 +1,470 @@
+#include "orientationTag.h"
+
+#include <Exceptions.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+namespace
+{
+
+const uint16_t kOrientationTag = 274;
+const uint16_t kTypeShort = 3;
+
+// EXIF orientation values by mirroring (first index) and clockwise quarter
+// turns from the stored to the displayed image (second index).
+const int kOrientations[2][4] = {{1, 6, 3, 8}, {2, 7, 4, 5}};
+
+// A sane upper bound on the entries of one directory.
+const uint64_t kMaxEntries = 4096;
+
+// Largest JPEG segment payload after the length field.
+const size_t kMaxSegmentBytes = 65533;
+
+int rotatedOrientation(int orientation, int quarterTurns)
+{
+    int flip = 0, turns = 0;
+    for (int f = 0; f < 2; ++f) {
+        for (int k = 0; k < 4; ++k) {
+            if (kOrientations[f][k] == orientation) {
+                flip = f;
+                turns = k;
+            }
+        }
+    }
+    // Turning the display counter-clockwise takes clockwise turns away
+    return kOrientations[flip][((turns - quarterTurns) % 4 + 4) % 4];
+}
+
+class File
+{
+public:
+    File(const std::string &rPath, int flags) : path_(rPath)
+    {
+        fd_ = open(rPath.c_str(), flags | O_CLOEXEC, 0644);
+        NPP_ASSERT_MSG(fd_ >= 0, "Unable to open " + rPath + ": " + strerror(errno));
+    }
+
+    ~File()
+    {
+        close(fd_);
+    }
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+    const std::string &path() const
+    {
+        return path_;
+    }
+
+    uint64_t size() const
+    {
+        struct stat oStat;
+        NPP_ASSERT_MSG(fstat(fd_, &oStat) == 0, "Unable to stat " + path_);
+        return (uint64_t)oStat.st_size;
+    }
+
+    void readAt(uint64_t offset, void *pData, size_t nBytes) const
+    {
+        size_t nDone = 0;
+        while (nDone < nBytes) {
+            ssize_t n = pread(fd_, (char *)pData + nDone, nBytes - nDone, (off_t)(offset + nDone));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            NPP_ASSERT_MSG(n > 0, "Unexpected end of " + path_);
+            nDone += n;
+        }
+    }
+
+    void writeAt(uint64_t offset, const void *pData, size_t nBytes)
+    {
+        size_t nDone = 0;
+        while (nDone < nBytes) {
+            ssize_t n = pwrite(fd_, (const char *)pData + nDone, nBytes - nDone, (off_t)(offset + nDone));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            NPP_ASSERT_MSG(n > 0, "Write failed on " + path_);
+            nDone += n;
+        }
+    }
+
+private:
+    File(const File &);
+    File &operator=(const File &);
+
+    int fd_;
+    std::string path_;
+};
+
+// Copies nBytes in the kernel, falling back to read/write where
+// copy_file_range() is not supported between the two files.
+void copyRange(const File &rIn, uint64_t inOffset, File &rOut, uint64_t outOffset, uint64_t nBytes)
+{
+    while (nBytes > 0) {
+        loff_t inPos = (loff_t)inOffset, outPos = (loff_t)outOffset;
+        ssize_t n = copy_file_range(rIn.fd(), &inPos, rOut.fd(), &outPos, (size_t)std::min<uint64_t>(nBytes, 1u << 30),
+                                    0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            NPP_ASSERT_MSG(n == 0 || errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP,
+                           "Copy failed on " + rOut.path() + ": " + strerror(errno));
+            break;
+        }
+        inOffset += n;
+        outOffset += n;
+        nBytes -= n;
+    }
+
+    std::vector<char> aBuffer((size_t)std::min<uint64_t>(nBytes, 1u << 20));
+    while (nBytes > 0) {
+        size_t nChunk = (size_t)std::min<uint64_t>(nBytes, aBuffer.size());
+        rIn.readAt(inOffset, aBuffer.data(), nChunk);
+        rOut.writeAt(outOffset, aBuffer.data(), nChunk);
+        inOffset += nChunk;
+        outOffset += nChunk;
+        nBytes -= nChunk;
+    }
+}
+
+// Whole-file copy: shares the extents where the file system can.
+void cloneFile(const File &rIn, File &rOut)
+{
+    if (ioctl(rOut.fd(), FICLONE, rIn.fd()) == 0) {
+        return;
+    }
+    copyRange(rIn, 0, rOut, 0, rIn.size());
+}
+
+struct ByteOrder
+{
+    bool bLittle;
+
+    uint64_t get(const unsigned char *p, size_t nBytes) const
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < nBytes; ++i) {
+            value |= (uint64_t)p[bLittle ? i : nBytes - 1 - i] << (8 * i);
+        }
+        return value;
+    }
+
+    void put(unsigned char *p, size_t nBytes, uint64_t value) const
+    {
+        for (size_t i = 0; i < nBytes; ++i) {
+            p[bLittle ? i : nBytes - 1 - i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+};
+
+// Reads bytes at an offset from the start of a TIFF structure.
+typedef std::function<void(uint64_t, void *, size_t)> TIFFReader;
+
+struct TIFFLayout
+{
+    ByteOrder order;
+    bool bBig;
+    uint64_t firstDirectory;
+
+    size_t countBytes() const
+    {
+        return bBig ? 8 : 2;
+    }
+
+    size_t entryBytes() const
+    {
+        return bBig ? 20 : 12;
+    }
+
+    size_t offsetBytes() const
+    {
+        return bBig ? 8 : 4;
+    }
+
+    // Where an entry's value (or its offset) starts
+    size_t valueField() const
+    {
+        return bBig ? 12 : 8;
+    }
+};
+
+bool parseTIFFHeader(const unsigned char *pHeader, TIFFLayout &rLayout)
+{
+    if (pHeader[0] == 'I' && pHeader[1] == 'I') {
+        rLayout.order.bLittle = true;
+    } else if (pHeader[0] == 'M' && pHeader[1] == 'M') {
+        rLayout.order.bLittle = false;
+    } else {
+        return false;
+    }
+    uint64_t version = rLayout.order.get(pHeader + 2, 2);
+    if (version == 42) {
+        rLayout.bBig = false;
+        rLayout.firstDirectory = rLayout.order.get(pHeader + 4, 4);
+    } else if (version == 43) {
+        rLayout.bBig = true;
+        rLayout.firstDirectory = rLayout.order.get(pHeader + 8, 8);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// The first directory: its entry count, entries and next-directory offset.
+struct Directory
+{
+    std::vector<unsigned char> aBytes;
+    uint64_t count;
+    int orientationEntry;       // -1 without an orientation tag
+};
+
+void readDirectory(const TIFFReader &rRead, const TIFFLayout &rLayout, Directory &rDirectory)
+{
+    rDirectory.orientationEntry = -1;
+    if (rLayout.firstDirectory == 0) {
+        rDirectory.count = 0;
+        rDirectory.aBytes.assign(rLayout.countBytes() + rLayout.offsetBytes(), 0);
+        return;
+    }
+
+    unsigned char aCount[8];
+    rRead(rLayout.firstDirectory, aCount, rLayout.countBytes());
+    rDirectory.count = rLayout.order.get(aCount, rLayout.countBytes());
+    NPP_ASSERT_MSG(rDirectory.count <= kMaxEntries, "Malformed TIFF directory");
+
+    rDirectory.aBytes.resize(rLayout.countBytes() + rDirectory.count * rLayout.entryBytes() + rLayout.offsetBytes());
+    rRead(rLayout.firstDirectory, rDirectory.aBytes.data(), rDirectory.aBytes.size());
+    for (uint64_t i = 0; i < rDirectory.count; ++i) {
+        const unsigned char *pEntry = rDirectory.aBytes.data() + rLayout.countBytes() + i * rLayout.entryBytes();
+        if (rLayout.order.get(pEntry, 2) == kOrientationTag) {
+            NPP_ASSERT_MSG(rLayout.order.get(pEntry + 2, 2) == kTypeShort, "Malformed TIFF orientation tag");
+            rDirectory.orientationEntry = (int)i;
+        }
+    }
+}
+
+// Offset of the orientation value, from the start of the TIFF structure.
+uint64_t orientationOffset(const TIFFLayout &rLayout, const Directory &rDirectory)
+{
+    return rLayout.firstDirectory + rLayout.countBytes() + rDirectory.orientationEntry * rLayout.entryBytes() +
+           rLayout.valueField();
+}
+
+int currentOrientation(const TIFFLayout &rLayout, const Directory &rDirectory)
+{
+    return (int)rLayout.order.get(rDirectory.aBytes.data() + orientationOffset(rLayout, rDirectory) -
+                                      rLayout.firstDirectory,
+                                  2);
+}
+
+// rDirectory with an orientation entry added in tag order.
+std::vector<unsigned char> addOrientation(const TIFFLayout &rLayout, const Directory &rDirectory, int orientation)
+{
+    const size_t nCount = rLayout.countBytes(), nEntry = rLayout.entryBytes();
+    std::vector<unsigned char> aEntry(nEntry, 0);
+    rLayout.order.put(aEntry.data(), 2, kOrientationTag);
+    rLayout.order.put(aEntry.data() + 2, 2, kTypeShort);
+    rLayout.order.put(aEntry.data() + 4, rLayout.bBig ? 8 : 4, 1);
+    rLayout.order.put(aEntry.data() + rLayout.valueField(), 2, (uint64_t)orientation);
+
+    uint64_t position = 0;
+    while (position < rDirectory.count &&
+           rLayout.order.get(rDirectory.aBytes.data() + nCount + position * nEntry, 2) < kOrientationTag) {
+        ++position;
+    }
+
+    std::vector<unsigned char> aBytes(rDirectory.aBytes);
+    rLayout.order.put(aBytes.data(), nCount, rDirectory.count + 1);
+    aBytes.insert(aBytes.begin() + nCount + position * nEntry, aEntry.begin(), aEntry.end());
+    return aBytes;
+}
+
+void writeOrientedTIFF(const File &rIn, File &rOut, const TIFFLayout &rLayout, int quarterTurns)
+{
+    TIFFReader read = [&](uint64_t offset, void *pData, size_t nBytes) { rIn.readAt(offset, pData, nBytes); };
+    Directory oDirectory;
+    readDirectory(read, rLayout, oDirectory);
+
+    cloneFile(rIn, rOut);
+    if (oDirectory.orientationEntry >= 0) {
+        unsigned char aValue[2];
+        rLayout.order.put(aValue, 2, (uint64_t)rotatedOrientation(currentOrientation(rLayout, oDirectory),
+                                                                  quarterTurns));
+        rOut.writeAt(orientationOffset(rLayout, oDirectory), aValue, sizeof(aValue));
+        return;
+    }
+
+    // The new first directory goes at the end; the old one stays unused
+    const uint64_t alignment = rLayout.bBig ? 8 : 2;
+    const uint64_t end = rIn.size();
+    const uint64_t offset = (end + alignment - 1) / alignment * alignment;
+    std::vector<unsigned char> aDirectory = addOrientation(rLayout, oDirectory, rotatedOrientation(1, quarterTurns));
+    NPP_ASSERT_MSG(rLayout.bBig || offset + aDirectory.size() <= 0xFFFFFFFFull,
+                   "No room for an orientation tag in " + rIn.path());
+    if (offset > end) {
+        const unsigned char aPad[8] = {0};
+        rOut.writeAt(end, aPad, (size_t)(offset - end));
+    }
+    rOut.writeAt(offset, aDirectory.data(), aDirectory.size());
+
+    unsigned char aPointer[8];
+    rLayout.order.put(aPointer, rLayout.offsetBytes(), offset);
+    rOut.writeAt(rLayout.bBig ? 8 : 4, aPointer, rLayout.offsetBytes());
+}
+
+const unsigned char kExifHeader[6] = {'E', 'x', 'i', 'f', 0, 0};
+
+// The EXIF segment of a JPEG file, if any, and where a new one would go.
+struct JPEGLayout
+{
+    uint64_t exifStart;         // marker of the EXIF APP1 segment, 0 if none
+    uint64_t exifBytes;         // whole segment
+    std::vector<unsigned char> aExif;   // TIFF structure inside it
+    uint64_t insertAt;          // after SOI and a JFIF APP0
+};
+
+void scanJPEG(const File &rIn, JPEGLayout &rLayout)
+{
+    const uint64_t size = rIn.size();
+    rLayout.exifStart = 0;
+    rLayout.exifBytes = 0;
+    rLayout.insertAt = 2;
+
+    uint64_t position = 2;
+    while (position + 4 <= size) {
+        unsigned char aMarker[4];
+        rIn.readAt(position, aMarker, sizeof(aMarker));
+        NPP_ASSERT_MSG(aMarker[0] == 0xFF, "Malformed JPEG segment in " + rIn.path());
+        if (aMarker[1] == 0xFF) {
+            ++position;         // fill byte
+            continue;
+        }
+        if (aMarker[1] == 0xDA || aMarker[1] == 0xD9) {
+            break;              // entropy coded data from here on
+        }
+
+        const uint64_t length = ((uint64_t)aMarker[2] << 8) | aMarker[3];
+        NPP_ASSERT_MSG(length >= 2 && position + 2 + length <= size, "Malformed JPEG segment in " + rIn.path());
+        if (aMarker[1] == 0xE0 && position == 2) {
+            rLayout.insertAt = position + 2 + length;
+        }
+        if (aMarker[1] == 0xE1 && length >= 2 + sizeof(kExifHeader) + 8 && rLayout.exifStart == 0) {
+            std::vector<unsigned char> aPayload(length - 2);
+            rIn.readAt(position + 4, aPayload.data(), aPayload.size());
+            if (memcmp(aPayload.data(), kExifHeader, sizeof(kExifHeader)) == 0) {
+                rLayout.exifStart = position;
+                rLayout.exifBytes = 2 + length;
+                rLayout.aExif.assign(aPayload.begin() + sizeof(kExifHeader), aPayload.end());
+            }
+        }
+        position += 2 + length;
+    }
+}
+
+void writeOrientedJPEG(const File &rIn, File &rOut, int quarterTurns)
+{
+    JPEGLayout oJPEG;
+    scanJPEG(rIn, oJPEG);
+
+    TIFFLayout oLayout;
+    if (oJPEG.exifStart == 0) {
+        // A big-endian TIFF header without directories
+        const unsigned char aHeader[8] = {'M', 'M', 0, 42, 0, 0, 0, 0};
+        oJPEG.aExif.assign(aHeader, aHeader + sizeof(aHeader));
+    }
+    NPP_ASSERT_MSG(parseTIFFHeader(oJPEG.aExif.data(), oLayout) && !oLayout.bBig,
+                   "Malformed EXIF data in " + rIn.path());
+
+    const std::vector<unsigned char> &rExif = oJPEG.aExif;
+    TIFFReader read = [&](uint64_t offset, void *pData, size_t nBytes) {
+        NPP_ASSERT_MSG(offset + nBytes <= rExif.size(), "Malformed EXIF data in " + rIn.path());
+        memcpy(pData, rExif.data() + offset, nBytes);
+    };
+    Directory oDirectory;
+    readDirectory(read, oLayout, oDirectory);
+
+    // APP1 offsets count from the TIFF header after "Exif\0\0"
+    const uint64_t tiffStart = oJPEG.exifStart + 4 + sizeof(kExifHeader);
+    if (oDirectory.orientationEntry >= 0) {
+        cloneFile(rIn, rOut);
+        unsigned char aValue[2];
+        oLayout.order.put(aValue, 2, (uint64_t)rotatedOrientation(currentOrientation(oLayout, oDirectory),
+                                                                  quarterTurns));
+        rOut.writeAt(tiffStart + orientationOffset(oLayout, oDirectory), aValue, sizeof(aValue));
+        return;
+    }
+
+    // Rebuild the segment with a new first directory at its end
+    std::vector<unsigned char> aTIFF(oJPEG.aExif);
+    aTIFF.resize((aTIFF.size() + 1) / 2 * 2, 0);
+    std::vector<unsigned char> aDirectory = addOrientation(oLayout, oDirectory, rotatedOrientation(1, quarterTurns));
+    oLayout.order.put(aTIFF.data() + 4, 4, aTIFF.size());
+    aTIFF.insert(aTIFF.end(), aDirectory.begin(), aDirectory.end());
+
+    const size_t nPayload = sizeof(kExifHeader) + aTIFF.size();
+    NPP_ASSERT_MSG(nPayload <= kMaxSegmentBytes, "No room for an orientation tag in " + rIn.path());
+    std::vector<unsigned char> aSegment = {0xFF, 0xE1, (unsigned char)((nPayload + 2) >> 8),
+                                           (unsigned char)(nPayload + 2)};
+    aSegment.insert(aSegment.end(), kExifHeader, kExifHeader + sizeof(kExifHeader));
+    aSegment.insert(aSegment.end(), aTIFF.begin(), aTIFF.end());
+
+    // The segment replaces the old EXIF segment, or is inserted
+    const uint64_t start = oJPEG.exifStart ? oJPEG.exifStart : oJPEG.insertAt;
+    const uint64_t resume = start + oJPEG.exifBytes;
+    copyRange(rIn, 0, rOut, 0, start);
+    rOut.writeAt(start, aSegment.data(), aSegment.size());
+    copyRange(rIn, resume, rOut, start + aSegment.size(), rIn.size() - resume);
+}
+
+} // namespace
+
+bool isQuarterTurn(double angle)
+{
+    const double turns = angle / 90.0;
+    return std::fabs(turns - std::round(turns)) < 1e-9;
+}
+
+bool writeOrientedCopy(const std::string &inputPath, const std::string &outputPath, double angle)
+{
+    if (!isQuarterTurn(angle)) {
+        return false;
+    }
+    const int quarterTurns = (int)(((long long)std::round(angle / 90.0) % 4 + 4) % 4);
+
+    File oIn(inputPath, O_RDONLY);
+    unsigned char aHeader[16] = {0};
+    const uint64_t size = oIn.size();
+    oIn.readAt(0, aHeader, (size_t)std::min<uint64_t>(size, sizeof(aHeader)));
+
+    TIFFLayout oLayout;
+    const bool bTIFF = size >= sizeof(aHeader) && parseTIFFHeader(aHeader, oLayout);
+    const bool bJPEG = size >= 4 && aHeader[0] == 0xFF && aHeader[1] == 0xD8;
+    if (!bTIFF && !bJPEG) {
+        return false;
+    }
+
+    File oOut(outputPath, O_RDWR | O_CREAT | O_TRUNC);
+    if (bTIFF) {
+        writeOrientedTIFF(oIn, oOut, oLayout, quarterTurns);
+    } else {
+        writeOrientedJPEG(oIn, oOut, quarterTurns);
+    }
+    return true;
+}
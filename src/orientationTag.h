@@ -0,0 +1,33 @@
+/* Metadata-only quarter turns for archive normalisation.
+ *
+ * TIFF files and JPEG files with EXIF data carry an Orientation tag (274)
+ * that tells viewers how the stored pixels are to be displayed.  For a
+ * right-angle rotation the output can therefore be the input file with
+ * only that tag changed: the pixel data is not decoded, and is copied byte
+ * for byte by the kernel, as a reflink (FICLONE) where the file system
+ * shares extents and with copy_file_range() otherwise.
+ *
+ * The new tag is the old one composed with the rotation, so mirrored and
+ * already rotated sources stay correct.  Where the tag exists it is patched
+ * in place in the copy.  A TIFF without one gets a new first directory
+ * appended at the end of the file; a JPEG gets an EXIF segment with the tag
+ * added, or a new one after SOI (and JFIF APP0), and the rest of the file
+ * is copied behind it.
+ */
+
+#ifndef ORIENTATION_TAG_H
+#define ORIENTATION_TAG_H
+
+#include <string>
+
+// True if angle is a multiple of 90 degrees.
+bool isQuarterTurn(double angle);
+
+// Writes outputPath as a copy of inputPath whose orientation tag displays
+// it rotated by angle (counter-clockwise, like rotateImage()).  Returns
+// false, writing nothing, if angle is not a quarter turn or inputPath is
+// neither a TIFF nor a JPEG file.  Throws npp::Exception on I/O errors and
+// malformed files.
+bool writeOrientedCopy(const std::string &inputPath, const std::string &outputPath, double angle);
+
+#endif // ORIENTATION_TAG_H
@@ -0,0 +1,247 @@
+#include "perfCounters.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+
+std::atomic<bool> g_bEnabled(false);
+
+std::mutex g_mutex;
+PerfStageStats g_aStats[PERF_STAGE_COUNT];
+std::string g_error;
+
+struct EventSpec
+{
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+};
+
+const EventSpec kEvents[PERF_EVENT_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses"},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+     "dTLB misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses"},
+};
+
+int openEvent(const EventSpec &rEvent, int groupFd)
+{
+    struct perf_event_attr oAttr;
+    memset(&oAttr, 0, sizeof(oAttr));
+    oAttr.size = sizeof(oAttr);
+    oAttr.type = rEvent.type;
+    oAttr.config = rEvent.config;
+    oAttr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    oAttr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &oAttr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
+}
+
+// One counter group for the calling thread, opened on first use.
+class CounterGroup
+{
+public:
+    CounterGroup() : leader_(-1), nOpen_(0)
+    {
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            aFds_[i] = -1;
+            aSlots_[i] = -1;
+        }
+
+        // The first event that opens leads; the others join it, so that
+        // all of them are scheduled onto the PMU together
+        int error = 0;
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            aFds_[i] = openEvent(kEvents[i], leader_);
+            if (aFds_[i] < 0) {
+                error = error ? error : errno;
+                continue;
+            }
+            if (leader_ < 0) {
+                leader_ = aFds_[i];
+            }
+            aSlots_[i] = nOpen_++;
+        }
+
+        if (error) {
+            std::lock_guard<std::mutex> oLock(g_mutex);
+            if (g_error.empty()) {
+                std::ostringstream oMessage;
+                oMessage << "perf_event_open: " << strerror(error);
+                if (error == EACCES || error == EPERM) {
+                    oMessage << " (see /proc/sys/kernel/perf_event_paranoid)";
+                }
+                g_error = oMessage.str();
+            }
+        }
+    }
+
+    ~CounterGroup()
+    {
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            if (aFds_[i] >= 0) {
+                close(aFds_[i]);
+            }
+        }
+    }
+
+    // Current counts (0 for events that did not open) and the group's time
+    // enabled and running.
+    bool read(uint64_t aCounts[PERF_EVENT_COUNT], uint64_t aTimes[2]) const
+    {
+        if (leader_ < 0) {
+            return false;
+        }
+        uint64_t aBuffer[3 + PERF_EVENT_COUNT];
+        const ssize_t nExpected = (ssize_t)((3 + nOpen_) * sizeof(uint64_t));
+        if (::read(leader_, aBuffer, sizeof(aBuffer)) != nExpected) {
+            return false;
+        }
+        aTimes[0] = aBuffer[1];
+        aTimes[1] = aBuffer[2];
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            aCounts[i] = aSlots_[i] >= 0 ? aBuffer[3 + aSlots_[i]] : 0;
+        }
+        return true;
+    }
+
+    bool available(int event) const
+    {
+        return aSlots_[event] >= 0;
+    }
+
+private:
+    int leader_;
+    int nOpen_;
+    int aFds_[PERF_EVENT_COUNT];
+    int aSlots_[PERF_EVENT_COUNT];      // position in a group read, -1 if not open
+};
+
+CounterGroup &threadCounters()
+{
+    static thread_local CounterGroup s_group;
+    return s_group;
+}
+
+} // namespace
+
+const char *perfStageName(PerfStage stage)
+{
+    switch (stage) {
+    case PERF_STAGE_DECODE:
+        return "decode";
+    case PERF_STAGE_ROTATE:
+        return "rotate";
+    case PERF_STAGE_ENCODE:
+        return "encode";
+    default:
+        return "?";
+    }
+}
+
+void setPerfCounters(bool bEnabled)
+{
+    g_bEnabled.store(bEnabled, std::memory_order_relaxed);
+}
+
+bool perfCountersEnabled()
+{
+    return g_bEnabled.load(std::memory_order_relaxed);
+}
+
+PerfScope::PerfScope(PerfStage stage, size_t nPixels)
+    : stage_(stage), nPixels_(nPixels), bActive_(perfCountersEnabled()), bCounting_(false)
+{
+    if (bActive_) {
+        bCounting_ = threadCounters().read(aStart_, aEnabled_);
+    }
+}
+
+PerfScope::~PerfScope()
+{
+    if (!bActive_) {
+        return;
+    }
+    const CounterGroup &rCounters = threadCounters();
+    uint64_t aEnd[PERF_EVENT_COUNT], aTimes[2];
+    const bool bCounted = bCounting_ && rCounters.read(aEnd, aTimes);
+
+    // Scale up when the group shared the PMU with other events
+    double scale = 1.0;
+    if (bCounted) {
+        const uint64_t enabled = aTimes[0] - aEnabled_[0];
+        const uint64_t running = aTimes[1] - aEnabled_[1];
+        scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+    }
+
+    std::lock_guard<std::mutex> oLock(g_mutex);
+    PerfStageStats &rStats = g_aStats[stage_];
+    ++rStats.calls;
+    rStats.pixels += nPixels_;
+    for (int i = 0; bCounted && i < PERF_EVENT_COUNT; ++i) {
+        if (rCounters.available(i)) {
+            rStats.aCounts[i] += (uint64_t)((aEnd[i] - aStart_[i]) * scale);
+            rStats.aAvailable[i] = true;
+        }
+    }
+}
+
+PerfStageStats perfStageStats(PerfStage stage)
+{
+    std::lock_guard<std::mutex> oLock(g_mutex);
+    return g_aStats[stage];
+}
+
+std::string perfCountersError()
+{
+    std::lock_guard<std::mutex> oLock(g_mutex);
+    return g_error;
+}
+
+std::string formatPerfCounters(const std::string &rIndent)
+{
+    std::ostringstream oText;
+    oText << std::fixed;
+    const std::string error = perfCountersError();
+    if (!error.empty()) {
+        oText << rIndent << "Counters unavailable or incomplete: " << error << "\n";
+    }
+
+    for (int stage = 0; stage < PERF_STAGE_COUNT; ++stage) {
+        const PerfStageStats oStats = perfStageStats((PerfStage)stage);
+        if (oStats.calls == 0) {
+            continue;
+        }
+        oText << rIndent << perfStageName((PerfStage)stage) << ": " << oStats.calls << " call(s)";
+        if (oStats.aAvailable[PERF_CYCLES]) {
+            oText << ", " << std::setprecision(1) << oStats.aCounts[PERF_CYCLES] / 1e6 << " Mcycles";
+        }
+        if (oStats.aAvailable[PERF_CYCLES] && oStats.aAvailable[PERF_INSTRUCTIONS] &&
+            oStats.aCounts[PERF_CYCLES] > 0) {
+            oText << ", IPC " << std::setprecision(2)
+                  << (double)oStats.aCounts[PERF_INSTRUCTIONS] / oStats.aCounts[PERF_CYCLES];
+        }
+        for (int event = PERF_LLC_MISSES; event < PERF_EVENT_COUNT; ++event) {
+            oText << ", " << kEvents[event].name << "/px ";
+            if (oStats.aAvailable[event] && oStats.pixels > 0) {
+                oText << std::setprecision(4) << (double)oStats.aCounts[event] / oStats.pixels;
+            } else {
+                oText << "n/a";
+            }
+        }
+        oText << "\n";
+    }
+    return oText.str();
+}
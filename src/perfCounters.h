@@ -0,0 +1,95 @@
+/* Hardware performance counters per pipeline stage (--perf-counters).
+ *
+ * Wall time alone does not say whether a stage is bound by compute or by
+ * memory.  With counters enabled, every thread that runs a stage opens one
+ * perf_event_open() group for itself (cycles, instructions, last level
+ * cache misses, dTLB load misses and branch misses, user and kernel) and
+ * reads it when the stage starts and ends.  The differences, scaled for
+ * multiplexing, are summed per stage together with the pixels processed,
+ * which gives IPC and misses per pixel at the end of the run.
+ *
+ * Decode and encode are measured where processImage() and the packed
+ * groups run them; rotate is measured in the CPU rotation kernel, on the
+ * thread that runs it, as that is where the work happens.  Rotations on
+ * the device are not host work and are not counted.
+ *
+ * Counters that cannot be opened (no PMU in a VM, perf_event_paranoid, a
+ * seccomp filter) are reported as unavailable; nothing else changes.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+enum PerfStage
+{
+    PERF_STAGE_DECODE,
+    PERF_STAGE_ROTATE,
+    PERF_STAGE_ENCODE,
+    PERF_STAGE_COUNT
+};
+
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+const char *perfStageName(PerfStage stage);
+
+// Process wide, set before any work starts.
+void setPerfCounters(bool bEnabled);
+bool perfCountersEnabled();
+
+// Counts the calling thread's events from construction to destruction
+// towards stage.  Does nothing with counters disabled.  The pixel count can
+// be given later, for decodes that only learn it at the end.
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfStage stage, size_t nPixels = 0);
+    ~PerfScope();
+
+    void setPixels(size_t nPixels)
+    {
+        nPixels_ = nPixels;
+    }
+
+private:
+    PerfScope(const PerfScope &);
+    PerfScope &operator=(const PerfScope &);
+
+    PerfStage stage_;
+    size_t nPixels_;
+    bool bActive_;
+    bool bCounting_;            // the thread's counters could be read
+    uint64_t aStart_[PERF_EVENT_COUNT];
+    uint64_t aEnabled_[2];      // time enabled and running at the start
+};
+
+struct PerfStageStats
+{
+    size_t calls;
+    size_t pixels;
+    uint64_t aCounts[PERF_EVENT_COUNT];
+    bool aAvailable[PERF_EVENT_COUNT];
+};
+
+PerfStageStats perfStageStats(PerfStage stage);
+
+// Why the counters could not be opened, empty if they could (or were not
+// tried).
+std::string perfCountersError();
+
+// One line per stage: calls, cycles, IPC and misses per pixel.
+std::string formatPerfCounters(const std::string &rIndent);
+
+#endif // PERF_COUNTERS_H
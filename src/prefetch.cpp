@@ -0,0 +1,94 @@
+#include "prefetch.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ReadAheadPrefetcher::ReadAheadPrefetcher(const std::vector<std::string> &files, size_t budgetBytes)
+    : files_(files), budgetBytes_(budgetBytes), sizes_(files.size(), 0),
+      consumed_(0), hinted_(0), bytesAhead_(0), bStop_(false)
+{
+    thread_ = std::thread(&ReadAheadPrefetcher::run, this);
+}
+
+ReadAheadPrefetcher::~ReadAheadPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        bStop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+void ReadAheadPrefetcher::advance(size_t index)
+{
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        while (consumed_ < index && consumed_ < files_.size()) {
+            if (consumed_ < hinted_) {
+                bytesAhead_ -= sizes_[consumed_];
+            }
+            ++consumed_;
+        }
+    }
+    changed_.notify_all();
+}
+
+size_t ReadAheadPrefetcher::window() const
+{
+    std::lock_guard<std::mutex> oLock(mutex_);
+    return hinted_ > consumed_ ? hinted_ - consumed_ : 0;
+}
+
+void ReadAheadPrefetcher::run()
+{
+    for (;;) {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            if (bStop_ || hinted_ >= files_.size()) {
+                return;
+            }
+            // Files the reader already took need no hint.
+            if (hinted_ < consumed_) {
+                hinted_ = consumed_;
+                continue;
+            }
+            index = hinted_;
+        }
+
+        // stat() is itself a round trip on network file systems, so it is
+        // done here rather than on the processing thread.
+        struct stat oStat;
+        size_t nBytes = stat(files_[index].c_str(), &oStat) == 0 ? (size_t)oStat.st_size : 0;
+
+        {
+            std::unique_lock<std::mutex> oLock(mutex_);
+            // Always allow one file ahead so a single oversized image still
+            // gets its read-ahead.
+            changed_.wait(oLock, [&] {
+                return bStop_ || consumed_ > index || bytesAhead_ == 0 || bytesAhead_ + nBytes <= budgetBytes_;
+            });
+            if (bStop_) {
+                return;
+            }
+            if (consumed_ > index) {
+                continue;
+            }
+        }
+
+        int fd = open(files_[index].c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+
+        std::lock_guard<std::mutex> oLock(mutex_);
+        if (consumed_ <= index) {
+            sizes_[index] = nBytes;
+            bytesAhead_ += nBytes;
+        }
+        hinted_ = index + 1;
+    }
+}
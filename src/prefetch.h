@@ -0,0 +1,49 @@
+/* Read-ahead for the files the batch will open next.
+ *
+ * A background thread walks the work list ahead of the reader stage and asks
+ * the kernel to start pulling each file into the page cache with
+ * posix_fadvise(POSIX_FADV_WILLNEED).  On cold caches (spinning disks, NFS)
+ * this hides first-byte latency behind the processing of earlier images.
+ * The number of files hinted ahead is bounded by a byte budget so the
+ * read-ahead cannot evict data the pipeline is still about to use.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ReadAheadPrefetcher
+{
+public:
+    ReadAheadPrefetcher(const std::vector<std::string> &files, size_t budgetBytes);
+    ~ReadAheadPrefetcher();
+
+    // Tells the prefetcher that every file before index has been handed to the
+    // reader stage, which frees their share of the budget.
+    void advance(size_t index);
+
+    // Number of files hinted but not yet consumed.
+    size_t window() const;
+
+private:
+    void run();
+
+    const std::vector<std::string> &files_;
+    const size_t budgetBytes_;
+    std::vector<size_t> sizes_;     // bytes hinted per file
+    size_t consumed_;               // files handed to the reader
+    size_t hinted_;                 // files hinted so far
+    size_t bytesAhead_;             // bytes hinted in [consumed_, hinted_)
+    bool bStop_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread thread_;
+};
+
+#endif // PREFETCH_H
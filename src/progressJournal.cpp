@@ -0,0 +1,462 @@
+#include "progressJournal.h"
+
+#include <Exceptions.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+#include "logging.h"
+
+namespace
+{
+
+const char kHeader[] = "# batchRotateTIFF progress journal v1\n";
+
+// The xxHash64 construction: four independent lanes over 32-byte stripes,
+// so that the multiplies of one stripe overlap.
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t load64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t v)
+{
+    return rotl(acc + v * kPrime2, 31) * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t h, uint64_t lane)
+{
+    return (h ^ mixRound(0, lane)) * kPrime1 + kPrime4;
+}
+
+// Journal fields are tab separated and records newline terminated, so
+// those and the escape character itself are escaped.
+std::string escapeField(const std::string &text)
+{
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+bool unescapeField(const std::string &text, std::string &rOut)
+{
+    rOut.clear();
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\') {
+            rOut += text[i];
+            continue;
+        }
+        if (++i == text.size()) {
+            return false;
+        }
+        if (text[i] == '\\') {
+            rOut += '\\';
+        } else if (text[i] == 't') {
+            rOut += '\t';
+        } else if (text[i] == 'n') {
+            rOut += '\n';
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string hex64(uint64_t value)
+{
+    char aText[17];
+    snprintf(aText, sizeof(aText), "%016llx", (unsigned long long)value);
+    return aText;
+}
+
+bool parseHex64(const std::string &text, uint64_t &rValue)
+{
+    if (text.size() != 16) {
+        return false;
+    }
+    char *pEnd = nullptr;
+    rValue = strtoull(text.c_str(), &pEnd, 16);
+    return *pEnd == '\0';
+}
+
+std::vector<std::string> splitTabs(const std::string &line)
+{
+    std::vector<std::string> aFields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        aFields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos) {
+            return aFields;
+        }
+        start = tab + 1;
+    }
+}
+
+bool writeAll(int fd, const char *pData, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, pData, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pData += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+} // namespace
+
+Checksum64::Checksum64() : tailBytes_(0), total_(0)
+{
+    aLanes_[0] = kPrime1 + kPrime2;
+    aLanes_[1] = kPrime2;
+    aLanes_[2] = 0;
+    aLanes_[3] = 0 - kPrime1;
+}
+
+void Checksum64::update(const void *pData, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(pData);
+    total_ += size;
+
+    if (tailBytes_ > 0) {
+        const size_t n = std::min(size, sizeof(aTail_) - tailBytes_);
+        memcpy(aTail_ + tailBytes_, p, n);
+        tailBytes_ += n;
+        p += n;
+        size -= n;
+        if (tailBytes_ < sizeof(aTail_)) {
+            return;
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            aLanes_[lane] = mixRound(aLanes_[lane], load64(aTail_ + 8 * lane));
+        }
+        tailBytes_ = 0;
+    }
+
+    uint64_t v0 = aLanes_[0], v1 = aLanes_[1], v2 = aLanes_[2], v3 = aLanes_[3];
+    for (; size >= 32; p += 32, size -= 32) {
+        v0 = mixRound(v0, load64(p));
+        v1 = mixRound(v1, load64(p + 8));
+        v2 = mixRound(v2, load64(p + 16));
+        v3 = mixRound(v3, load64(p + 24));
+    }
+    aLanes_[0] = v0;
+    aLanes_[1] = v1;
+    aLanes_[2] = v2;
+    aLanes_[3] = v3;
+
+    memcpy(aTail_, p, size);
+    tailBytes_ = size;
+}
+
+uint64_t Checksum64::value() const
+{
+    uint64_t h;
+    if (total_ >= 32) {
+        h = rotl(aLanes_[0], 1) + rotl(aLanes_[1], 7) + rotl(aLanes_[2], 12) + rotl(aLanes_[3], 18);
+        for (int lane = 0; lane < 4; ++lane) {
+            h = mergeRound(h, aLanes_[lane]);
+        }
+    } else {
+        h = aLanes_[2] + kPrime5;
+    }
+    h += total_;
+
+    const unsigned char *p = aTail_;
+    size_t size = tailBytes_;
+    for (; size >= 8; p += 8, size -= 8) {
+        h = rotl(h ^ mixRound(0, load64(p)), 27) * kPrime1 + kPrime4;
+    }
+    if (size >= 4) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h = rotl(h ^ (v * kPrime1), 23) * kPrime2 + kPrime3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; ++p, --size) {
+        h = rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t checksum64(const void *pData, size_t size)
+{
+    Checksum64 oChecksum;
+    oChecksum.update(pData, size);
+    return oChecksum.value();
+}
+
+bool fileChecksum(const std::string &path, uint64_t &rSize, uint64_t &rChecksum)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Checksum64 oChecksum;
+    std::vector<unsigned char> aBuffer((size_t)1 << 20);
+    rSize = 0;
+    for (;;) {
+        ssize_t n = read(fd, aBuffer.data(), aBuffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        oChecksum.update(aBuffer.data(), (size_t)n);
+        rSize += (uint64_t)n;
+    }
+    close(fd);
+    rChecksum = oChecksum.value();
+    return true;
+}
+
+ProgressJournal::ProgressJournal(const std::string &path, const std::string &outputDir,
+                                 unsigned int commitIntervalMs)
+    : path_(path)
+    , outputDir_(outputDir)
+    , intervalMs_(std::max(1u, commitIntervalMs))
+    , fd_(-1)
+    , bStop_(false)
+    , bFailed_(false)
+{
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    NPP_ASSERT_MSG(fd_ >= 0, "Unable to open journal " + path + ": " + strerror(errno));
+    try {
+        load();
+    }
+    catch (...) {
+        close(fd_);
+        throw;
+    }
+    thread_ = std::thread([this] { commitLoop(); });
+}
+
+ProgressJournal::~ProgressJournal()
+{
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        bStop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+    flush();
+    close(fd_);
+}
+
+void ProgressJournal::load()
+{
+    std::string text;
+    char aBuffer[65536];
+    for (;;) {
+        ssize_t n = pread(fd_, aBuffer, sizeof(aBuffer), (off_t)text.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        NPP_ASSERT_MSG(n >= 0, "Unable to read journal " + path_ + ": " + strerror(errno));
+        if (n == 0) {
+            break;
+        }
+        text.append(aBuffer, (size_t)n);
+    }
+
+    // A header cut short by a crash is rewritten; anything else that is
+    // not ours is left alone
+    const size_t headerSize = sizeof(kHeader) - 1;
+    if (text.compare(0, headerSize, kHeader) != 0) {
+        NPP_ASSERT_MSG(text.size() < headerSize && text.compare(0, text.size(), kHeader, text.size()) == 0,
+                       "Not a progress journal: " + path_);
+        NPP_ASSERT_MSG(ftruncate(fd_, 0) == 0 && writeAll(fd_, kHeader, headerSize) && fdatasync(fd_) == 0,
+                       "Unable to write journal " + path_ + ": " + strerror(errno));
+        return;
+    }
+
+    // Records up to the first torn or corrupt one
+    size_t end = headerSize;
+    while (end < text.size()) {
+        const size_t newline = text.find('\n', end);
+        if (newline == std::string::npos) {
+            break;
+        }
+        const std::string line = text.substr(end, newline - end);
+        const size_t lastTab = line.rfind('\t');
+        uint64_t lineChecksum;
+        if (lastTab == std::string::npos || !parseHex64(line.substr(lastTab + 1), lineChecksum) ||
+            checksum64(line.data(), lastTab) != lineChecksum) {
+            break;
+        }
+
+        std::vector<std::string> aFields = splitTabs(line.substr(0, lastTab));
+        std::string outputPath;
+        Entry oEntry;
+        char *pEnd = nullptr;
+        if (aFields.size() != 6 || aFields[0] != "R" || !unescapeField(aFields[1], outputPath) ||
+            !unescapeField(aFields[3], oEntry.parameters) || !parseHex64(aFields[5], oEntry.checksum)) {
+            break;
+        }
+        oEntry.size = strtoull(aFields[4].c_str(), &pEnd, 10);
+        if (aFields[4].empty() || *pEnd != '\0') {
+            break;
+        }
+        aEntries_[outputPath] = oEntry;
+        end = newline + 1;
+    }
+
+    std::ostringstream oMessage;
+    oMessage << "Journal: " << path_ << ", " << aEntries_.size() << " completed output(s) recorded";
+    if (end < text.size()) {
+        NPP_ASSERT_MSG(ftruncate(fd_, (off_t)end) == 0 && fdatasync(fd_) == 0,
+                       "Unable to truncate journal " + path_ + ": " + strerror(errno));
+        oMessage << ", " << text.size() - end << " byte(s) of torn tail discarded";
+    }
+    logInfo(oMessage.str());
+}
+
+bool ProgressJournal::completed(const std::string &outputPath, const std::string &parameters, bool bVerify) const
+{
+    auto entry = aEntries_.find(outputPath);
+    if (entry == aEntries_.end() || entry->second.parameters != parameters) {
+        return false;
+    }
+    struct stat oStat;
+    if (stat(outputPath.c_str(), &oStat) != 0 || (uint64_t)oStat.st_size != entry->second.size) {
+        return false;
+    }
+    if (!bVerify) {
+        return true;
+    }
+    uint64_t size, checksum;
+    return fileChecksum(outputPath, size, checksum) && size == entry->second.size &&
+           checksum == entry->second.checksum;
+}
+
+void ProgressJournal::record(const std::string &inputPath, const std::string &outputPath,
+                             const std::string &parameters, uint64_t size, uint64_t checksum)
+{
+    std::ostringstream oLine;
+    oLine << "R\t" << escapeField(outputPath) << "\t" << escapeField(inputPath) << "\t" << escapeField(parameters)
+          << "\t" << size << "\t" << hex64(checksum);
+    std::string line = oLine.str();
+    line += "\t" + hex64(checksum64(line.data(), line.size())) + "\n";
+
+    std::lock_guard<std::mutex> oLock(mutex_);
+    pending_ += line;
+}
+
+void ProgressJournal::commit()
+{
+    flush();
+}
+
+void ProgressJournal::flush()
+{
+    std::lock_guard<std::mutex> oFlushLock(flushMutex_);
+    std::string records;
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        records.swap(pending_);
+    }
+    if (records.empty()) {
+        return;
+    }
+
+    // The outputs first, so that no record is durable before its file
+    int error = 0;
+    int dirFd = open(outputDir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0 || syncfs(dirFd) != 0) {
+        error = errno;
+    }
+    if (dirFd >= 0) {
+        close(dirFd);
+    }
+    // A failed append is cut off again, as a torn line would hide the
+    // records after it from the next load
+    if (error == 0) {
+        const off_t end = lseek(fd_, 0, SEEK_END);
+        if (!writeAll(fd_, records.data(), records.size()) || fdatasync(fd_) != 0) {
+            error = errno;
+            if (end >= 0 && ftruncate(fd_, end) != 0) {
+                error = errno;
+            }
+        }
+    }
+
+    if (error != 0 && !bFailed_) {
+        bFailed_ = true;
+        logError("Journal commit failed, completed outputs may be redone on resume: " + path_ + ": " +
+                 strerror(error));
+    }
+}
+
+void ProgressJournal::commitLoop()
+{
+    std::unique_lock<std::mutex> oLock(mutex_);
+    while (!bStop_) {
+        wake_.wait_for(oLock, std::chrono::milliseconds(intervalMs_), [this] { return bStop_; });
+        oLock.unlock();
+        flush();
+        oLock.lock();
+    }
+}
+
+size_t ProgressJournal::loadedRecords() const
+{
+    return aEntries_.size();
+}
+
+const std::string &ProgressJournal::path() const
+{
+    return path_;
+}
@@ -0,0 +1,116 @@
+/* Progress journal for resumable batches (--journal).
+ *
+ * Every output the batch completes is appended to a journal file as one
+ * line: the output and input paths, the parameters the output was made
+ * with, its size and a checksum of its contents.  A rerun with the same
+ * journal skips the inputs whose output is recorded with the same
+ * parameters and is still on disk at the recorded size (or, with
+ * --verify-resume, with the recorded checksum).
+ *
+ * Recording is cheap: a completed output only appends its line to a memory
+ * buffer.  A commit thread writes the buffer out every commit interval
+ * (group commit).  It first calls syncfs() on the output directory, which
+ * makes every output written so far durable in one call instead of one
+ * fsync per file, and then appends the lines and fdatasync()s the journal.
+ * A line therefore never reaches the disk before its output does.  A crash
+ * loses at most the last interval of records, whose inputs are then simply
+ * processed again.
+ *
+ * Each line carries a checksum of itself.  On opening, the journal is read
+ * up to the first line that is torn or does not check out, and truncated
+ * there, so a crash during an append costs only that append.
+ *
+ * Outputs themselves are written through a ".part" file that is renamed
+ * once complete (see asyncIO.h), so a file under the output name is always
+ * whole, whether or not the journal knows about it.
+ */
+
+#ifndef PROGRESS_JOURNAL_H
+#define PROGRESS_JOURNAL_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Default journal file name inside the output directory.
+const char *const kJournalFileName = "progress.journal";
+
+// Fast non-cryptographic 64-bit checksum, eight bytes at a time.  Chunks
+// may be fed in any sizes; the value depends on the bytes only.
+class Checksum64
+{
+public:
+    Checksum64();
+    void update(const void *pData, size_t size);
+    uint64_t value() const;
+
+private:
+    uint64_t aLanes_[4];
+    unsigned char aTail_[32];
+    size_t tailBytes_;
+    uint64_t total_;
+};
+
+uint64_t checksum64(const void *pData, size_t size);
+
+// Size and checksum of the file at path.  Returns false if it cannot be
+// read.
+bool fileChecksum(const std::string &path, uint64_t &rSize, uint64_t &rChecksum);
+
+class ProgressJournal
+{
+public:
+    // Opens or creates the journal at path and loads its records.
+    // outputDir is synced before each commit.  Throws npp::Exception if
+    // the file cannot be opened or is not a journal.
+    ProgressJournal(const std::string &path, const std::string &outputDir, unsigned int commitIntervalMs);
+
+    // Commits the remaining records.
+    ~ProgressJournal();
+
+    // True if outputPath is recorded with parameters and is on disk at the
+    // recorded size; with bVerify its contents are checked as well.
+    bool completed(const std::string &outputPath, const std::string &parameters, bool bVerify) const;
+
+    // Queues a record for the next commit.  Thread safe.
+    void record(const std::string &inputPath, const std::string &outputPath, const std::string &parameters,
+                uint64_t size, uint64_t checksum);
+
+    // Writes the queued records now and waits for them to be durable.
+    void commit();
+
+    size_t loadedRecords() const;
+    const std::string &path() const;
+
+private:
+    struct Entry
+    {
+        std::string parameters;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    void load();
+    void flush();
+    void commitLoop();
+
+    std::string path_;
+    std::string outputDir_;
+    unsigned int intervalMs_;
+    int fd_;
+    std::map<std::string, Entry> aEntries_;     // output path -> last record
+
+    std::mutex flushMutex_;                     // one flush at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string pending_;                       // records not yet written
+    bool bStop_;
+    bool bFailed_;
+    std::thread thread_;
+};
+
+#endif // PROGRESS_JOURNAL_H
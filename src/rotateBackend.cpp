@@ -0,0 +1,661 @@
+#include "rotateBackend.h"
+
+#include <Exceptions.h>
+#include <cuda_runtime.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "costModel.h"
+#include "cpuRotate.h"
+#include "hugePages.h"
+#include "logging.h"
+#include "numaTopology.h"
+
+namespace
+{
+
+std::string exceptionText(const npp::Exception &rException)
+{
+    std::ostringstream oMessage;
+    oMessage << rException;
+    return oMessage.str();
+}
+
+// ---------------------------------------------------------------------------
+// Shared by both backends
+
+template <typename T>
+class StageQueue
+{
+public:
+    StageQueue()
+        : bClosed_(false)
+    {
+    }
+
+    void push(T item)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            items_.push_back(std::move(item));
+        }
+        ready_.notify_one();
+    }
+
+    // Returns false once the queue is closed and empty.
+    bool pop(T &rItem)
+    {
+        std::unique_lock<std::mutex> oLock(mutex_);
+        ready_.wait(oLock, [this] { return bClosed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return false;
+        }
+        rItem = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            bClosed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<T> items_;
+    bool bClosed_;
+};
+
+// The staging slots of a backend.  Free slots are handed out least recently
+// used first, so consecutive requests cycle through the ring: while one
+// slot downloads, the next rotates and the one after that uploads.  A slot
+// comes back only once its download has landed, and its buffers are kept
+// for the next request.
+template <typename Slot>
+class SlotRing
+{
+public:
+    void add(std::unique_ptr<Slot> pSlot)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        free_.push_back(pSlot.get());
+        aSlots_.push_back(std::move(pSlot));
+    }
+
+    // Blocks while every slot is in flight.
+    Slot *acquire()
+    {
+        std::unique_lock<std::mutex> oLock(mutex_);
+        slotFree_.wait(oLock, [this] { return !free_.empty(); });
+        Slot *pSlot = free_.front();
+        free_.pop_front();
+        return pSlot;
+    }
+
+    void release(Slot *pSlot)
+    {
+        {
+            std::lock_guard<std::mutex> oLock(mutex_);
+            free_.push_back(pSlot);
+        }
+        slotFree_.notify_all();
+    }
+
+    // Blocks until no slot is in flight.
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> oLock(mutex_);
+        slotFree_.wait(oLock, [this] { return free_.size() == aSlots_.size(); });
+    }
+
+    const std::vector<std::unique_ptr<Slot>> &slots() const
+    {
+        return aSlots_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable slotFree_;
+    std::vector<std::unique_ptr<Slot>> aSlots_;
+    std::deque<Slot *> free_;
+};
+
+// ---------------------------------------------------------------------------
+// NPP backend
+
+struct DeviceBuffer
+{
+    Npp8u *data;
+    int pitch;
+    int width;
+    int height;
+};
+
+// Grows rBuffer to at least width x height; buffers are never shrunk, so a
+// warm slot rotates without allocating.
+void reserveDeviceBuffer(DeviceBuffer &rBuffer, int width, int height)
+{
+    if (rBuffer.data && width <= rBuffer.width && height <= rBuffer.height) {
+        return;
+    }
+
+    nppiFree(rBuffer.data);
+    rBuffer.width = std::max(width, rBuffer.width);
+    rBuffer.height = std::max(height, rBuffer.height);
+    rBuffer.data = nppiMalloc_8u_C1(rBuffer.width, rBuffer.height, &rBuffer.pitch);
+    NPP_ASSERT_MSG(rBuffer.data != nullptr, "Out of device memory");
+}
+
+// Page-locked host memory, in huge pages if enabled; copies from and to it
+// run as DMA without blocking the host, which pageable memory cannot.
+struct PinnedBuffer
+{
+    Npp8u *data;
+    size_t bytes;
+};
+
+void reservePinnedBuffer(PinnedBuffer &rBuffer, size_t nBytes)
+{
+    if (rBuffer.data && nBytes <= rBuffer.bytes) {
+        return;
+    }
+
+    freePinnedImageMemory(rBuffer.data);
+    rBuffer.data = nullptr;
+    rBuffer.bytes = std::max(nBytes, rBuffer.bytes);
+    rBuffer.data = static_cast<Npp8u *>(allocatePinnedImageMemory(rBuffer.bytes));
+}
+
+// Copies height rows of width bytes between two strided buffers.
+void copyRows(const Npp8u *pSrc, size_t srcStep, Npp8u *pDst, size_t dstStep, int width, int height)
+{
+    for (int y = 0; y < height; ++y) {
+        memcpy(pDst + y * dstStep, pSrc + y * srcStep, width);
+    }
+}
+
+// Uploads, rotations and downloads go to three streams, ordered per request
+// by events, so the upload of one request, the rotation of the one before
+// it and the download of the one before that run at the same time.  Every
+// slot of the ring stages its request through pinned buffers: the caller's
+// source window is copied in on submit and the result is copied out by a
+// finisher thread once the download has landed.
+class NppRotateBackend : public IRotateBackend
+{
+public:
+    explicit NppRotateBackend(const BackendOptions &rOptions)
+        : deviceId_(rOptions.deviceId)
+    {
+        NPP_CHECK_CUDA(cudaSetDevice(deviceId_));
+        NPP_CHECK_CUDA(cudaStreamCreateWithFlags(&uploadStream_, cudaStreamNonBlocking));
+        NPP_CHECK_CUDA(cudaStreamCreateWithFlags(&computeStream_, cudaStreamNonBlocking));
+        NPP_CHECK_CUDA(cudaStreamCreateWithFlags(&downloadStream_, cudaStreamNonBlocking));
+        NPP_CHECK_NPP(nppGetStreamContext(&context_));
+        context_.hStream = computeStream_;
+
+        for (unsigned int i = 0; i < std::max(1u, rOptions.slots); ++i) {
+            std::unique_ptr<Slot> pSlot(new Slot());
+            pSlot->pOwner = this;
+            pSlot->src = {nullptr, 0, 0, 0};
+            pSlot->dst = {nullptr, 0, 0, 0};
+            pSlot->stagedSrc = {nullptr, 0};
+            pSlot->stagedDst = {nullptr, 0};
+            NPP_CHECK_CUDA(cudaEventCreateWithFlags(&pSlot->uploaded, cudaEventDisableTiming));
+            NPP_CHECK_CUDA(cudaEventCreateWithFlags(&pSlot->rotated, cudaEventDisableTiming));
+            ring_.add(std::move(pSlot));
+        }
+
+        finisher_ = std::thread([this] { finishStage(); });
+    }
+
+    ~NppRotateBackend()
+    {
+        ring_.waitIdle();
+        landed_.close();
+        finisher_.join();
+
+        cudaSetDevice(deviceId_);
+        for (auto &rSlot : ring_.slots()) {
+            cudaEventDestroy(rSlot->uploaded);
+            cudaEventDestroy(rSlot->rotated);
+            nppiFree(rSlot->src.data);
+            nppiFree(rSlot->dst.data);
+            freePinnedImageMemory(rSlot->stagedSrc.data);
+            freePinnedImageMemory(rSlot->stagedDst.data);
+        }
+        cudaStreamDestroy(uploadStream_);
+        cudaStreamDestroy(computeStream_);
+        cudaStreamDestroy(downloadStream_);
+    }
+
+    void submit(RotateRequest oRequest) override
+    {
+        Slot *pSlot = ring_.acquire();
+        pSlot->request = std::move(oRequest);
+        try {
+            // The current device is per thread, and callers may feed
+            // several devices.
+            NPP_CHECK_CUDA(cudaSetDevice(deviceId_));
+            enqueue(*pSlot);
+        }
+        catch (npp::Exception &rException) {
+            std::function<void(const RotateCompletion &)> onComplete = std::move(pSlot->request.onComplete);
+            ring_.release(pSlot);
+            onComplete({false, exceptionText(rException)});
+        }
+    }
+
+    void rotateBatch(const std::vector<BatchImage> &aImages) override
+    {
+        NPP_CHECK_CUDA(cudaSetDevice(deviceId_));
+        rotateImageBatch(aImages);
+    }
+
+    const char *name() const override
+    {
+        return "npp";
+    }
+
+private:
+    // Device and staging buffers for one request at a time.
+    struct Slot
+    {
+        NppRotateBackend *pOwner;
+        DeviceBuffer src;
+        DeviceBuffer dst;
+        PinnedBuffer stagedSrc;     // source window, rows packed
+        PinnedBuffer stagedDst;     // result, rows packed
+        cudaEvent_t uploaded;
+        cudaEvent_t rotated;
+        RotateRequest request;
+    };
+
+    void enqueue(Slot &rSlot)
+    {
+        const RotateRequest &rRequest = rSlot.request;
+        const NppiRect &srcWindow = rRequest.srcWindow;
+        const NppiRect &dstROI = rRequest.dstROI;
+
+        if (!isEmptyRect(srcWindow)) {
+            reservePinnedBuffer(rSlot.stagedSrc, (size_t)srcWindow.width * srcWindow.height);
+            copyRows(rRequest.pSrc, rRequest.srcStep, rSlot.stagedSrc.data, srcWindow.width, srcWindow.width,
+                     srcWindow.height);
+            reserveDeviceBuffer(rSlot.src, srcWindow.width, srcWindow.height);
+            NPP_CHECK_CUDA(cudaMemcpy2DAsync(rSlot.src.data, rSlot.src.pitch, rSlot.stagedSrc.data, srcWindow.width,
+                                             srcWindow.width, srcWindow.height, cudaMemcpyHostToDevice,
+                                             uploadStream_));
+        }
+        NPP_CHECK_CUDA(cudaEventRecord(rSlot.uploaded, uploadStream_));
+
+        // Pixels that map outside the source are left at 0
+        NPP_CHECK_CUDA(cudaStreamWaitEvent(computeStream_, rSlot.uploaded, 0));
+        reserveDeviceBuffer(rSlot.dst, dstROI.width, dstROI.height);
+        NppiSize oDstSize = {dstROI.width, dstROI.height};
+        NPP_CHECK_NPP(nppiSet_8u_C1R_Ctx(0, rSlot.dst.data, rSlot.dst.pitch, oDstSize, context_));
+
+        if (!isEmptyRect(srcWindow)) {
+            NppiSize oWindowSize = {srcWindow.width, srcWindow.height};
+            NppiRect oWindowROI = {0, 0, srcWindow.width, srcWindow.height};
+            NppiRect oDstRect = {0, 0, dstROI.width, dstROI.height};
+            double shiftX, shiftY;
+            windowShift(rRequest.geometry, srcWindow, dstROI, shiftX, shiftY);
+
+            NPP_CHECK_NPP(nppiRotate_8u_C1R_Ctx(
+                rSlot.src.data, oWindowSize, rSlot.src.pitch, oWindowROI,
+                rSlot.dst.data, rSlot.dst.pitch, oDstRect, rRequest.geometry.angle,
+                shiftX, shiftY, NPPI_INTER_LINEAR, context_));
+        }
+        NPP_CHECK_CUDA(cudaEventRecord(rSlot.rotated, computeStream_));
+
+        NPP_CHECK_CUDA(cudaStreamWaitEvent(downloadStream_, rSlot.rotated, 0));
+        reservePinnedBuffer(rSlot.stagedDst, (size_t)dstROI.width * dstROI.height);
+        NPP_CHECK_CUDA(cudaMemcpy2DAsync(rSlot.stagedDst.data, dstROI.width, rSlot.dst.data, rSlot.dst.pitch,
+                                         dstROI.width, dstROI.height, cudaMemcpyDeviceToHost, downloadStream_));
+        NPP_CHECK_CUDA(cudaLaunchHostFunc(downloadStream_, &NppRotateBackend::onDownloaded, &rSlot));
+    }
+
+    // Runs on a CUDA callback thread, which must not call into CUDA and
+    // holds up the download stream while it runs, so the copy out of the
+    // staging buffer is left to the finisher.
+    static void onDownloaded(void *pData)
+    {
+        Slot *pSlot = static_cast<Slot *>(pData);
+        pSlot->pOwner->landed_.push(pSlot);
+    }
+
+    void finishStage()
+    {
+        Slot *pSlot;
+        while (landed_.pop(pSlot)) {
+            const RotateRequest &rRequest = pSlot->request;
+            copyRows(pSlot->stagedDst.data, rRequest.dstROI.width, rRequest.pDst, rRequest.dstStep,
+                     rRequest.dstROI.width, rRequest.dstROI.height);
+
+            std::function<void(const RotateCompletion &)> onComplete = std::move(pSlot->request.onComplete);
+            ring_.release(pSlot);
+            onComplete({true, ""});
+        }
+    }
+
+    const int deviceId_;
+    cudaStream_t uploadStream_;
+    cudaStream_t computeStream_;
+    cudaStream_t downloadStream_;
+    NppStreamContext context_;
+    SlotRing<Slot> ring_;
+    StageQueue<Slot *> landed_;
+    std::thread finisher_;
+};
+
+// ---------------------------------------------------------------------------
+// CPU virtual device
+
+// Mirrors the NPP backend: a ring of slots whose "device" buffers are kept
+// between requests, and one thread per stream.  The upload thread copies
+// the source window into the slot, compute threads rotate, and the
+// download thread copies the result out and hands the slot back.
+class CpuRotateBackend : public IRotateBackend
+{
+public:
+    explicit CpuRotateBackend(const BackendOptions &rOptions)
+        : nComputeThreads_(std::max(1u, rOptions.cpuThreads))
+        , bytesPerSecond_(rOptions.transferMBps * 1e6)
+        , uploadNs_(0)
+        , computeNs_(0)
+        , downloadNs_(0)
+        , startTime_(std::chrono::steady_clock::now())
+        , bBindNode_(false)
+        , border_(rOptions.border)
+    {
+        for (const NumaNode &rNode : detectNumaNodes()) {
+            if (rNode.id == rOptions.numaNode) {
+                node_ = rNode;
+                bBindNode_ = true;
+            }
+        }
+        for (unsigned int i = 0; i < std::max(1u, rOptions.slots); ++i) {
+            ring_.add(std::unique_ptr<Slot>(new Slot()));
+        }
+
+        uploader_ = std::thread([this] {
+            bindToNode();
+            uploadStage();
+        });
+        for (unsigned int i = 0; i < nComputeThreads_; ++i) {
+            aComputers_.emplace_back([this] {
+                bindToNode();
+                computeStage();
+            });
+        }
+        downloader_ = std::thread([this] {
+            bindToNode();
+            downloadStage();
+        });
+    }
+
+    ~CpuRotateBackend()
+    {
+        uploads_.close();
+        uploader_.join();
+        computes_.close();
+        for (auto &rThread : aComputers_) {
+            rThread.join();
+        }
+        downloads_.close();
+        downloader_.join();
+
+        auto wall = std::chrono::steady_clock::now() - startTime_;
+        std::ostringstream oMessage;
+        oMessage << "CPU backend busy time: upload " << uploadNs_ / 1000000 << " ms, compute "
+                 << computeNs_ / 1000000 << " ms, download " << downloadNs_ / 1000000 << " ms over "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(wall).count() << " ms";
+        logInfo(oMessage.str());
+    }
+
+    void submit(RotateRequest oRequest) override
+    {
+        Slot *pSlot = ring_.acquire();
+        pSlot->request = std::move(oRequest);
+        pSlot->success = true;
+        pSlot->error.clear();
+        uploads_.push(pSlot);
+    }
+
+    // One parallel-for over the images.
+    void rotateBatch(const std::vector<BatchImage> &aImages) override
+    {
+        std::atomic<size_t> nNext(0);
+        auto work = [&] {
+            for (size_t i = nNext++; i < aImages.size(); i = nNext++) {
+                const BatchImage &rImage = aImages[i];
+                RotationGeometry oGeometry = makeRotationGeometry(rImage.srcSize, rImage.angle);
+                for (int y = 0; y < oGeometry.bound.height; ++y) {
+                    memset(rImage.pDst + (size_t)y * rImage.dstStep, 0, oGeometry.bound.width);
+                }
+                NppiRect oSrcROI = {0, 0, rImage.srcSize.width, rImage.srcSize.height};
+                cpuRotate_8u_C1R(rImage.pSrc, rImage.srcSize, rImage.srcStep, oSrcROI, rImage.pDst,
+                                 rImage.dstStep, oGeometry.bound, oGeometry.angle, oGeometry.shiftX,
+                                 oGeometry.shiftY, border_);
+            }
+        };
+
+        std::vector<std::thread> aThreads;
+        for (unsigned int i = 1; i < std::min<size_t>(nComputeThreads_, aImages.size()); ++i) {
+            aThreads.emplace_back([this, &work] {
+                bindToNode();
+                work();
+            });
+        }
+        work();
+        for (auto &rThread : aThreads) {
+            rThread.join();
+        }
+    }
+
+    const char *name() const override
+    {
+        return "cpu";
+    }
+
+private:
+    // Stage threads of a backend placed on a NUMA node run on its CPUs, so
+    // the slot buffers they allocate are that node's memory.
+    void bindToNode()
+    {
+        if (bBindNode_) {
+            bindThreadToNode(node_);
+        }
+    }
+
+    // "Device memory" of one request at a time; kept between requests.  The
+    // rotation gathers from src, so it goes in huge pages when enabled.
+    struct Slot
+    {
+        RotateRequest request;
+        ImageBytes src;
+        ImageBytes dst;
+        bool success;
+        std::string error;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Holds a transfer of nBytes that began at start to the simulated bus
+    // rate, and books the time against rCounter.
+    void finishTransfer(size_t nBytes, Clock::time_point start, std::atomic<uint64_t> &rCounter)
+    {
+        if (bytesPerSecond_ > 0) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds((uint64_t)(nBytes / bytesPerSecond_ * 1e9)));
+        }
+        rCounter += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    void uploadStage()
+    {
+        Slot *pSlot;
+        while (uploads_.pop(pSlot)) {
+            const RotateRequest &rRequest = pSlot->request;
+            const NppiRect &srcWindow = rRequest.srcWindow;
+            Clock::time_point start = Clock::now();
+
+            if (!isEmptyRect(srcWindow)) {
+                pSlot->src.resize((size_t)srcWindow.width * srcWindow.height);
+                copyRows(rRequest.pSrc, rRequest.srcStep, pSlot->src.data(), srcWindow.width, srcWindow.width,
+                         srcWindow.height);
+            }
+            finishTransfer(isEmptyRect(srcWindow) ? 0 : (size_t)srcWindow.width * srcWindow.height, start,
+                           uploadNs_);
+            computes_.push(pSlot);
+        }
+    }
+
+    void computeStage()
+    {
+        Slot *pSlot;
+        while (computes_.pop(pSlot)) {
+            const RotateRequest &rRequest = pSlot->request;
+            const NppiRect &srcWindow = rRequest.srcWindow;
+            const NppiRect &dstROI = rRequest.dstROI;
+            Clock::time_point start = Clock::now();
+
+            try {
+                // Pixels that map outside the source are left at 0
+                pSlot->dst.assign((size_t)dstROI.width * dstROI.height, 0);
+                if (!isEmptyRect(srcWindow)) {
+                    NppiSize oWindowSize = {srcWindow.width, srcWindow.height};
+                    NppiRect oWindowROI = {0, 0, srcWindow.width, srcWindow.height};
+                    NppiRect oDstRect = {0, 0, dstROI.width, dstROI.height};
+                    double shiftX, shiftY;
+                    windowShift(rRequest.geometry, srcWindow, dstROI, shiftX, shiftY);
+
+                    cpuRotate_8u_C1R(pSlot->src.data(), oWindowSize, srcWindow.width, oWindowROI,
+                                     pSlot->dst.data(), dstROI.width, oDstRect, rRequest.geometry.angle,
+                                     shiftX, shiftY, border_);
+                }
+            }
+            catch (std::exception &rException) {
+                pSlot->success = false;
+                pSlot->error = rException.what();
+            }
+            computeNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            downloads_.push(pSlot);
+        }
+    }
+
+    void downloadStage()
+    {
+        Slot *pSlot;
+        while (downloads_.pop(pSlot)) {
+            const RotateRequest &rRequest = pSlot->request;
+            const NppiRect &dstROI = rRequest.dstROI;
+            Clock::time_point start = Clock::now();
+
+            if (pSlot->success) {
+                copyRows(pSlot->dst.data(), dstROI.width, rRequest.pDst, rRequest.dstStep, dstROI.width,
+                         dstROI.height);
+            }
+            finishTransfer(pSlot->success ? (size_t)dstROI.width * dstROI.height : 0, start, downloadNs_);
+
+            RotateCompletion oCompletion = {pSlot->success, pSlot->error};
+            std::function<void(const RotateCompletion &)> onComplete = std::move(pSlot->request.onComplete);
+            ring_.release(pSlot);
+            onComplete(oCompletion);
+        }
+    }
+
+    const unsigned int nComputeThreads_;
+    const double bytesPerSecond_;
+
+    SlotRing<Slot> ring_;
+    StageQueue<Slot *> uploads_;
+    StageQueue<Slot *> computes_;
+    StageQueue<Slot *> downloads_;
+    std::thread uploader_;
+    std::vector<std::thread> aComputers_;
+    std::thread downloader_;
+
+    std::atomic<uint64_t> uploadNs_;
+    std::atomic<uint64_t> computeNs_;
+    std::atomic<uint64_t> downloadNs_;
+    const Clock::time_point startTime_;
+    NumaNode node_;
+    bool bBindNode_;
+    const CpuBorderMode border_;
+};
+
+std::mutex g_backendMutex;
+std::unique_ptr<IRotateBackend> g_pBackend;
+
+} // namespace
+
+std::unique_ptr<IRotateBackend> createRotateBackend(const std::string &name, const BackendOptions &rOptions)
+{
+    if (name == "npp") {
+        return std::unique_ptr<IRotateBackend>(new NppRotateBackend(rOptions));
+    }
+    if (name == "cpu") {
+        return std::unique_ptr<IRotateBackend>(new CpuRotateBackend(rOptions));
+    }
+    if (name == "auto") {
+        return createAutoBackend(rOptions);
+    }
+    return nullptr;
+}
+
+void setRotateBackend(std::unique_ptr<IRotateBackend> pBackend)
+{
+    std::lock_guard<std::mutex> oLock(g_backendMutex);
+    g_pBackend = std::move(pBackend);
+}
+
+IRotateBackend &rotateBackend()
+{
+    std::lock_guard<std::mutex> oLock(g_backendMutex);
+    if (!g_pBackend) {
+        BackendOptions oOptions = {0, 4, std::max(1u, std::thread::hardware_concurrency()), 0.0, "", false, -1, CPU_BORDER_CONSTANT};
+        cudaGetDevice(&oOptions.deviceId);
+        g_pBackend = createRotateBackend("npp", oOptions);
+    }
+    return *g_pBackend;
+}
+
+void releaseRotateBackend()
+{
+    std::lock_guard<std::mutex> oLock(g_backendMutex);
+    g_pBackend.reset();
+}
+
+void rotateSync(IRotateBackend &rBackend, RotateRequest oRequest)
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    bool bDone = false;
+    RotateCompletion oCompletion = {false, ""};
+
+    oRequest.onComplete = [&](const RotateCompletion &rCompletion) {
+        std::lock_guard<std::mutex> oLock(mutex);
+        oCompletion = rCompletion;
+        bDone = true;
+        done.notify_one();
+    };
+    rBackend.submit(std::move(oRequest));
+
+    std::unique_lock<std::mutex> oLock(mutex);
+    done.wait(oLock, [&] { return bDone; });
+    NPP_ASSERT_MSG(oCompletion.success, std::string("Rotation failed on the ") + rBackend.name() + " backend: " +
+                                            oCompletion.error);
+}
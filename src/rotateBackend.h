@@ -0,0 +1,109 @@
+/* Where rotations run.
+ *
+ * An IRotateBackend accepts rotations asynchronously: submit() queues the
+ * upload of the source window, the rotation and the download of the result,
+ * and returns; the request's onComplete callback fires on a backend thread
+ * once the destination holds the result.  Several requests may be in flight
+ * at once, so uploads, rotations and downloads of different requests
+ * overlap.
+ *
+ * "npp" runs on the CUDA device with one stream per slot.  "cpu" is a
+ * virtual device: an upload thread copies into host-side "device" memory,
+ * compute threads run cpuRotate_8u_C1R and a download thread copies back.
+ * It needs no GPU and can throttle its transfers to a simulated bus rate,
+ * so overlap logic can be developed and checked anywhere.  "auto" holds
+ * one of each and picks per request with the cost model in costModel.h.
+ * Several backends, one per device or CPU domain, can be combined with
+ * createShardedBackend().
+ *
+ * The engine uses one process-wide backend, selected with setRotateBackend()
+ * before any work starts.
+ */
+
+#ifndef ROTATE_BACKEND_H
+#define ROTATE_BACKEND_H
+
+#include <npp.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "batchRotate.h"
+#include "cpuRotate.h"
+#include "rotateGeometry.h"
+
+struct RotateCompletion
+{
+    bool success;
+    std::string error;
+};
+
+struct RotateRequest
+{
+    const Npp8u *pSrc;          // first pixel of srcWindow
+    int srcStep;
+    NppiRect srcWindow;         // empty: the output is all background
+    RotationGeometry geometry;
+    NppiRect dstROI;
+    Npp8u *pDst;                // dstROI.width x dstROI.height pixels
+    int dstStep;
+    std::function<void(const RotateCompletion &)> onComplete;
+};
+
+struct BackendOptions
+{
+    int deviceId;               // npp
+    unsigned int slots;         // requests in flight before submit() blocks
+    unsigned int cpuThreads;    // cpu: compute threads
+    double transferMBps;        // cpu: simulated bus rate, 0 = memcpy speed
+    std::string profilePath;    // auto: cost model profile
+    bool recalibrate;           // auto: calibrate even if the profile exists
+    int numaNode;               // cpu: node whose CPUs run the stages, -1 = any
+    CpuBorderMode border;       // cpu: what pixels mapped outside the source get
+};
+
+class IRotateBackend
+{
+public:
+    virtual ~IRotateBackend() {}
+
+    // Queues a rotation.  The source and destination must stay valid until
+    // onComplete has run.  Blocks while all slots are busy.
+    virtual void submit(RotateRequest oRequest) = 0;
+
+    // Rotates small whole images, see rotateImageBatch().  Synchronous.
+    virtual void rotateBatch(const std::vector<BatchImage> &aImages) = 0;
+
+    virtual const char *name() const = 0;
+};
+
+// Returns the backend called name ("npp", "cpu" or "auto"), or nullptr.
+std::unique_ptr<IRotateBackend> createRotateBackend(const std::string &name, const BackendOptions &rOptions);
+
+// One backend of a sharded set, e.g. "npp:1" for the NPP backend on device 1.
+struct RotateShard
+{
+    std::string label;
+    std::unique_ptr<IRotateBackend> pBackend;
+    int numaNode;               // node the shard's threads run on, -1 = any
+};
+
+// Backend that spreads requests over aShards, sending each to the shard with
+// the least work outstanding.  Callers bound to a NUMA node prefer the shards
+// on their node.  A single shard is returned as it is.
+std::unique_ptr<IRotateBackend> createShardedBackend(std::vector<RotateShard> aShards);
+
+// The process-wide backend.  The NPP backend on the current device is
+// created on first use if none was set.
+void setRotateBackend(std::unique_ptr<IRotateBackend> pBackend);
+IRotateBackend &rotateBackend();
+
+// Destroys the process-wide backend and its buffers.
+void releaseRotateBackend();
+
+// Submits oRequest and waits for it; throws npp::Exception if it failed.
+void rotateSync(IRotateBackend &rBackend, RotateRequest oRequest);
+
+#endif // ROTATE_BACKEND_H
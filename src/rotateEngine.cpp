@@ -0,0 +1,370 @@
+#include "rotateEngine.h"
+
+#include <Exceptions.h>
+#include <ImageIO.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+
+#include "asyncIO.h"
+#include "deskew.h"
+#include "imageCodec.h"
+#include "logging.h"
+#include "perfCounters.h"
+#include "rotateBackend.h"
+#include "tiffPyramid.h"
+
+namespace
+{
+
+void logException(const std::string &inputPath, const npp::Exception &rException)
+{
+    std::ostringstream oMessage;
+    oMessage << "  NPP Exception (" << inputPath << "): " << rException;
+    logError(oMessage.str());
+}
+
+// Largest power-of-two tile whose band of output rows, source window and
+// tile buffers fit in workingSetBytes.
+int chooseTileSize(const RotationGeometry &rGeometry, int bandWidth, size_t workingSetBytes)
+{
+    const double kRadians = rGeometry.angle * M_PI / 180.0;
+    const double kSpread = std::fabs(std::cos(kRadians)) + std::fabs(std::sin(kRadians));
+
+    int tile = 4096;
+    while (tile > 64) {
+        size_t nWindow = (size_t)std::pow(tile * kSpread + 3.0, 2.0);
+        size_t nBytes = (size_t)bandWidth * tile + nWindow + (size_t)tile * tile;
+        if (nBytes <= workingSetBytes) {
+            break;
+        }
+        tile /= 2;
+    }
+    return tile;
+}
+
+// Side of the reduced copy a tiled image's skew is estimated from.
+const int kTiledSkewSide = 2048;
+
+// Skew of an image read window by window.  Bands of rows are box-reduced
+// on the way in, so only the reduced copy is ever held.
+double estimateTiledSkew(ImageWindowReader &rReader)
+{
+    const NppiSize oSize = rReader.size();
+    const int factor = std::max(1, (std::max(oSize.width, oSize.height) + kTiledSkewSide - 1) / kTiledSkewSide);
+    const int reducedWidth = (oSize.width + factor - 1) / factor;
+    const int reducedHeight = (oSize.height + factor - 1) / factor;
+
+    npp::ImageCPU_8u_C1 oReduced(reducedWidth, reducedHeight);
+    std::vector<uint32_t> aSums(reducedWidth);
+    for (int ry = 0; ry < reducedHeight; ++ry) {
+        NppiRect oBand = {0, ry * factor, oSize.width, std::min(factor, oSize.height - ry * factor)};
+        npp::ImageCPU_8u_C1 oRows;
+        rReader.read(oBand, oRows);
+
+        std::fill(aSums.begin(), aSums.end(), 0);
+        for (int y = 0; y < oBand.height; ++y) {
+            const Npp8u *pRow = oRows.data(0, y);
+            for (int x = 0; x < oSize.width; ++x) {
+                aSums[x / factor] += pRow[x];
+            }
+        }
+        for (int rx = 0; rx < reducedWidth; ++rx) {
+            const int columns = std::min(factor, oSize.width - rx * factor);
+            *oReduced.data(rx, ry) = (Npp8u)(aSums[rx] / (columns * oBand.height));
+        }
+    }
+    return estimateSkewAngle(oReduced);
+}
+
+void logSkew(const std::string &inputPath, double angle)
+{
+    std::ostringstream oMessage;
+    oMessage << "  Estimated skew of " << inputPath << ": " << angle << " degrees";
+    logInfo(oMessage.str());
+}
+
+} // namespace
+
+double resolveAngle(const std::string &inputPath, const npp::ImageCPU_8u_C1 &rSrc, double angle)
+{
+    if (!isAutoAngle(angle)) {
+        return angle;
+    }
+    angle = estimateSkewAngle(rSrc);
+    logSkew(inputPath, angle);
+    return angle;
+}
+
+bool rotateLossless(const std::string &inputPath, const std::vector<unsigned char> *pEncoded,
+                    const std::string &outputPath, double angle, std::vector<unsigned char> &encodedOut)
+{
+    if (isAutoAngle(angle) || !isJPEGFileName(inputPath) || !isJPEGFileName(outputPath)) {
+        return false;
+    }
+
+    std::vector<unsigned char> aRead;
+    if (!pEncoded) {
+        std::ifstream oFile(inputPath, std::ios::binary);
+        aRead.assign(std::istreambuf_iterator<char>(oFile), std::istreambuf_iterator<char>());
+        pEncoded = &aRead;
+    }
+    if (!rotateJPEGLossless(*pEncoded, angle, encodedOut)) {
+        return false;
+    }
+    logInfo("  Lossless JPEG rotation of " + inputPath);
+    return true;
+}
+
+void rotateWindow(const Npp8u *pSrc, int srcStep, const RotationGeometry &rGeometry,
+                  const NppiRect &srcWindow, const NppiRect &dstROI, Npp8u *pDst, int dstStep)
+{
+    RotateRequest oRequest;
+    oRequest.pSrc = pSrc;
+    oRequest.srcStep = srcStep;
+    oRequest.srcWindow = srcWindow;
+    oRequest.geometry = rGeometry;
+    oRequest.dstROI = dstROI;
+    oRequest.pDst = pDst;
+    oRequest.dstStep = dstStep;
+    rotateSync(rotateBackend(), std::move(oRequest));
+}
+
+void rotateWindow(const npp::ImageCPU_8u_C1 &rSrc, const RotationGeometry &rGeometry,
+                  const NppiRect &srcWindow, const NppiRect &dstROI, npp::ImageCPU_8u_C1 &rDst)
+{
+    npp::ImageCPU_8u_C1 oHostDst(dstROI.width, dstROI.height);
+    rotateWindow(rSrc.data(), rSrc.pitch(), rGeometry, srcWindow, dstROI, oHostDst.data(), oHostDst.pitch());
+    oHostDst.swap(rDst);
+}
+
+void rotateImage(const Npp8u *pSrc, int srcStep, NppiSize oSrcSize, double angle, const NppiRect *pROI,
+                 Npp8u *pDst, int dstStep)
+{
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, angle);
+
+    NppiRect oDstROI = oGeometry.bound;
+    NppiRect oSrcWindow = {0, 0, oSrcSize.width, oSrcSize.height};
+    if (pROI) {
+        oDstROI = intersectRect(*pROI, oGeometry.bound);
+        NPP_ASSERT_MSG(!isEmptyRect(oDstROI), "ROI lies outside of the rotated image");
+        oSrcWindow = backProjectROI(oGeometry, oDstROI);
+    }
+
+    // The window is uploaded straight out of the caller's rows
+    const Npp8u *pWindow = isEmptyRect(oSrcWindow) ? pSrc : pSrc + (size_t)oSrcWindow.y * srcStep + oSrcWindow.x;
+    rotateWindow(pWindow, srcStep, oGeometry, oSrcWindow, oDstROI, pDst, dstStep);
+}
+
+NppiSize rotatedImageSize(NppiSize oSrcSize, double angle, const NppiRect *pROI)
+{
+    RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, angle);
+    NppiRect oDstROI = pROI ? intersectRect(*pROI, oGeometry.bound) : oGeometry.bound;
+    NppiSize oSize = {oDstROI.width, oDstROI.height};
+    return oSize;
+}
+
+void rotateImage(const npp::ImageCPU_8u_C1 &rSrc, double angle, const NppiRect *pROI, npp::ImageCPU_8u_C1 &rDst)
+{
+    NppiSize oSrcSize = {(int)rSrc.width(), (int)rSrc.height()};
+    NppiSize oDstSize = rotatedImageSize(oSrcSize, angle, pROI);
+    NPP_ASSERT_MSG(oDstSize.width > 0 && oDstSize.height > 0, "ROI lies outside of the rotated image");
+
+    npp::ImageCPU_8u_C1 oHostDst(oDstSize.width, oDstSize.height);
+    rotateImage(rSrc.data(), rSrc.pitch(), oSrcSize, angle, pROI, oHostDst.data(), oHostDst.pitch());
+    oHostDst.swap(rDst);
+}
+
+bool processImage(const std::string &inputPath, const std::vector<unsigned char> *pEncoded,
+                  const std::string &outputPath, double angle, const NppiRect *pROI,
+                  std::vector<unsigned char> &encodedOut)
+{
+    try {
+        if (!pROI && rotateLossless(inputPath, pEncoded, outputPath, angle, encodedOut)) {
+            return true;
+        }
+
+        // Load image (NPP supports PGM, PPM, and with proper libraries, TIFF).
+        // With an output ROI only the header is read up front; the pixels
+        // come from the back-projected source window further down.
+        npp::ImageCPU_8u_C1 oHostSrc;
+        NppiSize oSrcSize;
+        if (pROI) {
+            NPP_ASSERT_MSG(!isAutoAngle(angle), "An ROI needs a fixed rotation angle");
+            NPP_ASSERT_MSG(probeImageSize(inputPath, oSrcSize), "Unable to read image header");
+        } else {
+            {
+                PerfScope oPerf(PERF_STAGE_DECODE);
+                if (pEncoded) {
+                    decodeImage(*pEncoded, oHostSrc);
+                } else {
+                    loadImageFile(inputPath, oHostSrc);
+                }
+                oPerf.setPixels((size_t)oHostSrc.width() * oHostSrc.height());
+            }
+            oSrcSize = {(int)oHostSrc.width(), (int)oHostSrc.height()};
+            angle = resolveAngle(inputPath, oHostSrc, angle);
+        }
+
+        // Calculate bounding box for rotated image
+        RotationGeometry oGeometry = makeRotationGeometry(oSrcSize, angle);
+
+        // Restrict the output to the requested ROI and find the source
+        // pixels it depends on
+        NppiRect oDstROI = oGeometry.bound;
+        NppiRect oSrcWindow = {0, 0, oSrcSize.width, oSrcSize.height};
+        if (pROI) {
+            oDstROI = intersectRect(*pROI, oGeometry.bound);
+            NPP_ASSERT_MSG(!isEmptyRect(oDstROI), "ROI lies outside of the rotated image");
+            oSrcWindow = backProjectROI(oGeometry, oDstROI);
+
+            std::ostringstream oMessage;
+            oMessage << "  ROI " << oDstROI.x << "," << oDstROI.y << " " << oDstROI.width << "x" << oDstROI.height
+                     << " of " << inputPath << " reads source window " << oSrcWindow.x << "," << oSrcWindow.y
+                     << " " << oSrcWindow.width << "x" << oSrcWindow.height;
+            logInfo(oMessage.str());
+
+            if (!isEmptyRect(oSrcWindow)) {
+                loadImageWindow(inputPath, oSrcWindow, oHostSrc);
+            }
+        }
+
+        npp::ImageCPU_8u_C1 oHostDst;
+        rotateWindow(oHostSrc, oGeometry, oSrcWindow, oDstROI, oHostDst);
+
+        // Encode output image; the writer stage puts it on disk
+        {
+            PerfScope oPerf(PERF_STAGE_ENCODE, (size_t)oHostDst.width() * oHostDst.height());
+            encodeImage(outputPath, oHostDst, encodedOut);
+        }
+
+        return true;
+    }
+    catch (npp::Exception &rException) {
+        logException(inputPath, rException);
+        return false;
+    }
+    catch (...) {
+        logError("  Unknown exception occurred (" + inputPath + ")");
+        return false;
+    }
+}
+
+bool processImageTiled(const std::string &inputPath, const std::string &outputPath, double angle,
+                       const NppiRect *pROI, size_t workingSetBytes)
+{
+    try {
+        ImageWindowReader oReader(inputPath);
+        if (isAutoAngle(angle)) {
+            NPP_ASSERT_MSG(!pROI, "An ROI needs a fixed rotation angle");
+            angle = estimateTiledSkew(oReader);
+            logSkew(inputPath, angle);
+        }
+        RotationGeometry oGeometry = makeRotationGeometry(oReader.size(), angle);
+
+        NppiRect oDstROI = oGeometry.bound;
+        if (pROI) {
+            oDstROI = intersectRect(*pROI, oGeometry.bound);
+            NPP_ASSERT_MSG(!isEmptyRect(oDstROI), "ROI lies outside of the rotated image");
+        }
+
+        // A source that cannot be read window by window is already fully
+        // decoded and takes its share of the working set.
+        size_t nSourceBytes = oReader.streaming() ? 0 : (size_t)oReader.size().width * oReader.size().height;
+        size_t nAvailable = workingSetBytes > nSourceBytes ? workingSetBytes - nSourceBytes : 0;
+
+        // PGM outputs, and TIFF outputs with overviews, are streamed to disk
+        const bool bPyramid = overviewLevels() > 0 && isTIFFFileName(outputPath);
+        const bool bStream = isPGMFileName(outputPath) || bPyramid;
+        if (!bStream) {
+            size_t nOutputBytes = (size_t)oDstROI.width * oDstROI.height;
+            nAvailable = nAvailable > nOutputBytes ? nAvailable - nOutputBytes : 0;
+        }
+        const int tile = chooseTileSize(oGeometry, oDstROI.width, nAvailable);
+
+        std::ostringstream oMessage;
+        oMessage << "  Tiled rotation of " << inputPath << ": " << oDstROI.width << "x" << oDstROI.height
+                 << " in " << tile << "x" << tile << " tiles" << (bStream ? ", streamed to disk" : "");
+        logInfo(oMessage.str());
+
+        // Streamed outputs only get their name once they are complete
+        std::unique_ptr<PGMStreamWriter> pWriter;
+        std::unique_ptr<TIFFPyramidWriter> pPyramid;
+        npp::ImageCPU_8u_C1 oHostDst;
+        if (bPyramid) {
+            pPyramid.reset(
+                new TIFFPyramidWriter(partialPath(outputPath), oDstROI.width, oDstROI.height, overviewLevels()));
+        } else if (bStream) {
+            pWriter.reset(new PGMStreamWriter(partialPath(outputPath), oDstROI.width, oDstROI.height));
+        } else {
+            npp::ImageCPU_8u_C1 oFull(oDstROI.width, oDstROI.height);
+            oFull.swap(oHostDst);
+        }
+
+        npp::ImageCPU_8u_C1 oBand(oDstROI.width, std::min(tile, oDstROI.height));
+        for (int by = 0; by < oDstROI.height; by += tile) {
+            const int bandHeight = std::min(tile, oDstROI.height - by);
+
+            for (int bx = 0; bx < oDstROI.width; bx += tile) {
+                NppiRect oTileROI = {oDstROI.x + bx, oDstROI.y + by, std::min(tile, oDstROI.width - bx), bandHeight};
+                NppiRect oWindow = backProjectROI(oGeometry, oTileROI);
+
+                npp::ImageCPU_8u_C1 oSrc;
+                if (!isEmptyRect(oWindow)) {
+                    oReader.read(oWindow, oSrc);
+                }
+
+                npp::ImageCPU_8u_C1 oTile;
+                rotateWindow(oSrc, oGeometry, oWindow, oTileROI, oTile);
+                for (int y = 0; y < bandHeight; ++y) {
+                    memcpy(oBand.data(bx, y), oTile.data(0, y), oTileROI.width);
+                }
+            }
+
+            // The band is reduced into the overviews while still in cache
+            if (bPyramid) {
+                pPyramid->writeRows(oBand, bandHeight);
+            } else if (bStream) {
+                pWriter->writeRows(oBand, bandHeight);
+            } else {
+                for (int y = 0; y < bandHeight; ++y) {
+                    memcpy(oHostDst.data(0, by + y), oBand.data(0, y), oDstROI.width);
+                }
+            }
+        }
+
+        int error = 0;
+        if (bPyramid) {
+            pPyramid->close();
+            error = commitPartial(outputPath, 0);
+        } else if (bStream) {
+            pWriter->close();
+            error = commitPartial(outputPath, 0);
+        } else {
+            std::vector<unsigned char> encoded;
+            encodeImage(outputPath, oHostDst, encoded);
+            error = writeFileAtomically(outputPath, encoded);
+        }
+        NPP_ASSERT_MSG(error == 0, "Write failed on " + outputPath + ": " + strerror(error));
+
+        return true;
+    }
+    catch (npp::Exception &rException) {
+        logException(inputPath, rException);
+        unlink(partialPath(outputPath).c_str());
+        return false;
+    }
+    catch (...) {
+        logError("  Unknown exception occurred (" + inputPath + ")");
+        unlink(partialPath(outputPath).c_str());
+        return false;
+    }
+}
@@ -0,0 +1,68 @@
+/* Per-image rotation.
+ *
+ * The rotations themselves run on the process-wide backend (see
+ * rotateBackend.h), whose slots keep their device buffers between calls, so
+ * long-lived workers rotate without device allocations once warm.
+ */
+
+#ifndef ROTATE_ENGINE_H
+#define ROTATE_ENGINE_H
+
+#include <ImagesCPU.h>
+#include <npp.h>
+
+#include <string>
+#include <vector>
+
+#include "rotateGeometry.h"
+
+// Rotates the srcWindow part of the source image, whose first row starts at
+// pSrc, into the dstROI part of the rotated bounding box at pDst.  No host
+// memory is allocated.
+void rotateWindow(const Npp8u *pSrc, int srcStep, const RotationGeometry &rGeometry,
+                  const NppiRect &srcWindow, const NppiRect &dstROI, Npp8u *pDst, int dstStep);
+
+// Rotates rSrc, which holds srcWindow of the source image, into the dstROI
+// part of the rotated bounding box.
+void rotateWindow(const npp::ImageCPU_8u_C1 &rSrc, const RotationGeometry &rGeometry,
+                  const NppiRect &srcWindow, const NppiRect &dstROI, npp::ImageCPU_8u_C1 &rDst);
+
+// Size of the rotated bounding box, or of the part of pROI inside it.
+NppiSize rotatedImageSize(NppiSize oSrcSize, double angle, const NppiRect *pROI);
+
+// Rotates an image already in memory, producing the whole bounding box or
+// only pROI of it.  The raw form writes rotatedImageSize() pixels to pDst.
+void rotateImage(const Npp8u *pSrc, int srcStep, NppiSize oSrcSize, double angle, const NppiRect *pROI,
+                 Npp8u *pDst, int dstStep);
+void rotateImage(const npp::ImageCPU_8u_C1 &rSrc, double angle, const NppiRect *pROI, npp::ImageCPU_8u_C1 &rDst);
+
+// The angle to rotate rSrc by: angle itself, or for kAutoAngle the skew
+// estimated from rSrc (see deskew.h), which is logged against inputPath.
+double resolveAngle(const std::string &inputPath, const npp::ImageCPU_8u_C1 &rSrc, double angle);
+
+// Quarter turns of a JPEG written as JPEG: the compressed coefficients are
+// rotated without decoding (see rotateJPEGLossless()).  Reads inputPath when
+// pEncoded is null.  Returns false, leaving the pixel path to the caller,
+// when the source, target or angle do not allow it.  A colour source stays
+// in colour here, while the pixel path writes 8-bit gray.
+bool rotateLossless(const std::string &inputPath, const std::vector<unsigned char> *pEncoded,
+                    const std::string &outputPath, double angle, std::vector<unsigned char> &encodedOut);
+
+// Decodes, rotates and encodes one image.  The source comes from pEncoded
+// when the reader stage already holds the file contents, and from inputPath
+// otherwise.  The encoded result is returned for the writer stage.  With
+// kAutoAngle the image is deskewed; pROI then must be null.
+bool processImage(const std::string &inputPath, const std::vector<unsigned char> *pEncoded,
+                  const std::string &outputPath, double angle, const NppiRect *pROI,
+                  std::vector<unsigned char> &encodedOut);
+
+// Rotates an image too large for the memory budget.  The output is produced
+// in square tiles, each from its own back-projected source window, and
+// written band by band; PGM outputs are streamed to disk so only one band of
+// rows is ever held.  workingSetBytes bounds the band plus one tile and its
+// source window.  The output is written to partialPath(outputPath) and
+// renamed once complete.
+bool processImageTiled(const std::string &inputPath, const std::string &outputPath, double angle,
+                       const NppiRect *pROI, size_t workingSetBytes);
+
+#endif // ROTATE_ENGINE_H
@@ -0,0 +1,126 @@
+#include "rotateGeometry.h"
+
+#include <Exceptions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Rounding noise from cos/sin at right angles must not add a pixel column.
+static const double kBoundEpsilon = 1e-6;
+
+RotationGeometry makeRotationGeometry(NppiSize srcSize, double angle)
+{
+    RotationGeometry oGeometry;
+    oGeometry.srcSize = srcSize;
+    oGeometry.angle = angle;
+
+    NppiRect oSrcROI = {0, 0, srcSize.width, srcSize.height};
+    double aBoundingBox[2][2];
+    NPP_CHECK_NPP(nppiGetRotateBound(oSrcROI, aBoundingBox, angle, 0.0, 0.0));
+
+    oGeometry.shiftX = -aBoundingBox[0][0];
+    oGeometry.shiftY = -aBoundingBox[0][1];
+    oGeometry.bound.x = 0;
+    oGeometry.bound.y = 0;
+    oGeometry.bound.width = (int)std::ceil(aBoundingBox[1][0] - aBoundingBox[0][0] - kBoundEpsilon) + 1;
+    oGeometry.bound.height = (int)std::ceil(aBoundingBox[1][1] - aBoundingBox[0][1] - kBoundEpsilon) + 1;
+
+    return oGeometry;
+}
+
+double rotatedPixelBound(double width, double height, double angle, const NppiRect *pROI)
+{
+    const double kRadians = angle * M_PI / 180.0;
+    const double c = std::fabs(std::cos(kRadians));
+    const double s = std::fabs(std::sin(kRadians));
+    double boundWidth = width * c + height * s + 2.0;
+    double boundHeight = width * s + height * c + 2.0;
+    if (pROI) {
+        boundWidth = std::min(boundWidth, (double)std::max(0, pROI->width));
+        boundHeight = std::min(boundHeight, (double)std::max(0, pROI->height));
+    }
+    return boundWidth * boundHeight;
+}
+
+NppiRect backProjectROI(const RotationGeometry &rGeometry, const NppiRect &dstROI, int nMargin)
+{
+    NppiRect oEmpty = {0, 0, 0, 0};
+    if (isEmptyRect(dstROI)) {
+        return oEmpty;
+    }
+
+    const double kRadians = rGeometry.angle * M_PI / 180.0;
+    const double c = std::cos(kRadians);
+    const double s = std::sin(kRadians);
+
+    // The inverse of a rotation is its transpose, so a destination point
+    // (u, v) comes from  x = c*du - s*dv,  y = s*du + c*dv.
+    const double aCornersX[2] = {(double)dstROI.x, (double)(dstROI.x + dstROI.width - 1)};
+    const double aCornersY[2] = {(double)dstROI.y, (double)(dstROI.y + dstROI.height - 1)};
+
+    double minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+    for (double u : aCornersX) {
+        for (double v : aCornersY) {
+            double du = u - rGeometry.shiftX;
+            double dv = v - rGeometry.shiftY;
+            double x = c * du - s * dv;
+            double y = s * du + c * dv;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+    }
+
+    int x0 = (int)std::floor(minX) - nMargin;
+    int y0 = (int)std::floor(minY) - nMargin;
+    int x1 = (int)std::ceil(maxX) + nMargin;
+    int y1 = (int)std::ceil(maxY) + nMargin;
+
+    NppiRect oWindow = {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+    NppiRect oImage = {0, 0, rGeometry.srcSize.width, rGeometry.srcSize.height};
+    oWindow = intersectRect(oWindow, oImage);
+
+    return isEmptyRect(oWindow) ? oEmpty : oWindow;
+}
+
+void windowShift(const RotationGeometry &rGeometry, const NppiRect &srcWindow, const NppiRect &dstROI,
+                 double &shiftX, double &shiftY)
+{
+    const double kRadians = rGeometry.angle * M_PI / 180.0;
+    const double c = std::cos(kRadians);
+    const double s = std::sin(kRadians);
+
+    shiftX = rGeometry.shiftX + c * srcWindow.x + s * srcWindow.y - dstROI.x;
+    shiftY = rGeometry.shiftY - s * srcWindow.x + c * srcWindow.y - dstROI.y;
+}
+
+NppiRect intersectRect(const NppiRect &a, const NppiRect &b)
+{
+    int x0 = std::max(a.x, b.x);
+    int y0 = std::max(a.y, b.y);
+    int x1 = std::min(a.x + a.width, b.x + b.width);
+    int y1 = std::min(a.y + a.height, b.y + b.height);
+
+    NppiRect oResult = {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+    return oResult;
+}
+
+bool parseROI(const std::string &text, NppiRect &roi)
+{
+    char trailing;
+    int x, y, w, h;
+    if (sscanf(text.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &trailing) != 4) {
+        return false;
+    }
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+
+    roi.x = x;
+    roi.y = y;
+    roi.width = w;
+    roi.height = h;
+    return true;
+}
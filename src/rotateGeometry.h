@@ -0,0 +1,57 @@
+/* Rotation geometry shared by the full-image and region-of-interest paths.
+ *
+ * NPP rotates about the source origin and then shifts the result:
+ *
+ *   x' =  cos(a) * x + sin(a) * y + shiftX
+ *   y' = -sin(a) * x + cos(a) * y + shiftY
+ *
+ * The shift is chosen so that the whole rotated image lands inside a
+ * bounding box whose top-left corner is (0, 0).  Output coordinates used by
+ * --roi are expressed in that bounding box.
+ */
+
+#ifndef ROTATE_GEOMETRY_H
+#define ROTATE_GEOMETRY_H
+
+#include <npp.h>
+
+#include <string>
+
+struct RotationGeometry
+{
+    NppiSize srcSize;   // full source image
+    double angle;       // degrees, counter-clockwise
+    double shiftX;      // shift that moves the rotated image into the box
+    double shiftY;
+    NppiRect bound;     // full output box, always at (0, 0)
+};
+
+// Computes the output bounding box for rotating an image of srcSize.
+RotationGeometry makeRotationGeometry(NppiSize srcSize, double angle);
+
+// Upper bound of the pixels in the output of rotating a width x height
+// image, or of the part of pROI in it.  Computed in floating point without
+// NPP, so untrusted sizes can be checked before anything is allocated.
+double rotatedPixelBound(double width, double height, double angle, const NppiRect *pROI = nullptr);
+
+// Smallest source rectangle (clamped to the image) whose pixels contribute to
+// dstROI, grown by nMargin pixels for the interpolation footprint.  Returns
+// an empty rectangle when dstROI only covers background.
+NppiRect backProjectROI(const RotationGeometry &rGeometry, const NppiRect &dstROI, int nMargin = 1);
+
+// Shift to pass to nppiRotate when the source starts at srcWindow and the
+// destination buffer starts at dstROI, both given in full-image coordinates.
+void windowShift(const RotationGeometry &rGeometry, const NppiRect &srcWindow, const NppiRect &dstROI,
+                 double &shiftX, double &shiftY);
+
+NppiRect intersectRect(const NppiRect &a, const NppiRect &b);
+
+inline bool isEmptyRect(const NppiRect &r)
+{
+    return r.width <= 0 || r.height <= 0;
+}
+
+// Parses "x,y,w,h".  Returns false on malformed input or non-positive size.
+bool parseROI(const std::string &text, NppiRect &roi);
+
+#endif // ROTATE_GEOMETRY_H
@@ -0,0 +1,126 @@
+#include "rotateBackend.h"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+#include "logging.h"
+#include "numaTopology.h"
+
+namespace
+{
+
+// Spreads requests over several backends.  Each request goes to the shard
+// with the fewest output pixels outstanding, so a faster or less busy
+// device simply receives more of the image list.
+class ShardedRotateBackend : public IRotateBackend
+{
+public:
+    explicit ShardedRotateBackend(std::vector<RotateShard> aShards)
+        : aShards_(std::move(aShards))
+        , aQueuedPixels_(aShards_.size(), 0.0)
+        , aCounts_(aShards_.size(), 0)
+        , nNext_(0)
+    {
+    }
+
+    ~ShardedRotateBackend()
+    {
+        std::ostringstream oMessage;
+        oMessage << "Shards:";
+        for (size_t i = 0; i < aShards_.size(); ++i) {
+            aShards_[i].pBackend.reset();
+            oMessage << " " << aShards_[i].label << " " << aCounts_[i];
+        }
+        oMessage << " rotation(s)";
+        logInfo(oMessage.str());
+    }
+
+    void submit(RotateRequest oRequest) override
+    {
+        const double pixels = (double)oRequest.dstROI.width * oRequest.dstROI.height;
+        size_t shard = acquire(pixels, 1);
+
+        std::function<void(const RotateCompletion &)> onComplete = std::move(oRequest.onComplete);
+        oRequest.onComplete = [this, shard, pixels, onComplete](const RotateCompletion &rCompletion) {
+            release(shard, pixels);
+            onComplete(rCompletion);
+        };
+        aShards_[shard].pBackend->submit(std::move(oRequest));
+    }
+
+    void rotateBatch(const std::vector<BatchImage> &aImages) override
+    {
+        double pixels = 0;
+        for (const BatchImage &rImage : aImages) {
+            NppiRect oBound = makeRotationGeometry(rImage.srcSize, rImage.angle).bound;
+            pixels += (double)oBound.width * oBound.height;
+        }
+
+        size_t shard = acquire(pixels, aImages.size());
+        try {
+            aShards_[shard].pBackend->rotateBatch(aImages);
+        }
+        catch (...) {
+            release(shard, pixels);
+            throw;
+        }
+        release(shard, pixels);
+    }
+
+    const char *name() const override
+    {
+        return "sharded";
+    }
+
+private:
+    // Picks the least loaded shard; ties rotate so that an idle start still
+    // fans out.  A caller bound to a NUMA node that has shards of its own
+    // only picks among those, so its images stay in the node's memory.
+    size_t acquire(double pixels, size_t nRotations)
+    {
+        const int node = currentNumaNode();
+        bool bLocal = false;
+        for (const RotateShard &rShard : aShards_) {
+            bLocal = bLocal || (node >= 0 && rShard.numaNode == node);
+        }
+
+        std::lock_guard<std::mutex> oLock(mutex_);
+        size_t best = aShards_.size();
+        for (size_t i = 0; i < aShards_.size(); ++i) {
+            size_t shard = (nNext_ + i) % aShards_.size();
+            if (bLocal && aShards_[shard].numaNode != node) {
+                continue;
+            }
+            if (best == aShards_.size() || aQueuedPixels_[shard] < aQueuedPixels_[best]) {
+                best = shard;
+            }
+        }
+        nNext_ = (best + 1) % aShards_.size();
+        aQueuedPixels_[best] += pixels;
+        aCounts_[best] += nRotations;
+        return best;
+    }
+
+    void release(size_t shard, double pixels)
+    {
+        std::lock_guard<std::mutex> oLock(mutex_);
+        aQueuedPixels_[shard] -= pixels;
+    }
+
+    std::vector<RotateShard> aShards_;
+    std::mutex mutex_;
+    std::vector<double> aQueuedPixels_;
+    std::vector<size_t> aCounts_;
+    size_t nNext_;
+};
+
+} // namespace
+
+std::unique_ptr<IRotateBackend> createShardedBackend(std::vector<RotateShard> aShards)
+{
+    if (aShards.size() == 1) {
+        return std::move(aShards.front().pBackend);
+    }
+    return std::unique_ptr<IRotateBackend>(new ShardedRotateBackend(std::move(aShards)));
+}
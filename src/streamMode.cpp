@@ -0,0 +1,353 @@
+#include "streamMode.h"
+
+#include <Exceptions.h>
+#include <ImagesCPU.h>
+#include <cuda_runtime.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+#include "rotateEngine.h"
+#include "rotateGeometry.h"
+
+namespace
+{
+
+// Largest plane accepted, before and after the rotation.  Frame headers
+// are untrusted, and UtilNPP sizes its buffers with 32-bit arithmetic.
+const uint64_t kMaxFramePixels = (uint64_t)1 << 30;
+
+enum FrameFormat
+{
+    FRAME_PGM,
+    FRAME_PPM,
+    FRAME_RAW
+};
+
+struct Frame
+{
+    uint64_t index;
+    FrameFormat format;
+    int maxValue;                               // PNM maxval, kept on output
+    std::vector<npp::ImageCPU_8u_C1> aPlanes;   // one per channel
+    bool success;
+};
+
+// Next decimal field of a PNM header, skipping whitespace and '#' comments.
+int readPNMField(FILE *pInput)
+{
+    int c = getc(pInput);
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = getc(pInput);
+            }
+        }
+        c = getc(pInput);
+    }
+    NPP_ASSERT_MSG(c != EOF && isdigit(c), "Malformed PNM header in input stream");
+
+    long value = 0;
+    while (c != EOF && isdigit(c)) {
+        value = value * 10 + (c - '0');
+        NPP_ASSERT_MSG(value <= 0x7fffffff, "Malformed PNM header in input stream");
+        c = getc(pInput);
+    }
+    // The single whitespace character after the field is consumed here,
+    // which after maxval is exactly the separator before the raster.
+    NPP_ASSERT_MSG(c != EOF && isspace(c), "Malformed PNM header in input stream");
+    return (int)value;
+}
+
+void readPlanes(FILE *pInput, int width, int height, int nChannels, Frame &rFrame)
+{
+    NPP_ASSERT_MSG(width > 0 && height > 0 && (nChannels == 1 || nChannels == 3), "Unsupported frame in input stream");
+    NPP_ASSERT_MSG((uint64_t)width * (uint64_t)height <= kMaxFramePixels, "Frame too large in input stream");
+
+    rFrame.aPlanes.resize(nChannels);
+    for (int i = 0; i < nChannels; ++i) {
+        npp::ImageCPU_8u_C1 oPlane(width, height);
+        oPlane.swap(rFrame.aPlanes[i]);
+    }
+
+    std::vector<Npp8u> aRow((size_t)width * nChannels);
+    for (int y = 0; y < height; ++y) {
+        if (nChannels == 1) {
+            NPP_ASSERT_MSG(fread(rFrame.aPlanes[0].data(0, y), 1, width, pInput) == (size_t)width,
+                           "Truncated frame in input stream");
+            continue;
+        }
+
+        NPP_ASSERT_MSG(fread(aRow.data(), 1, aRow.size(), pInput) == aRow.size(), "Truncated frame in input stream");
+        for (int i = 0; i < nChannels; ++i) {
+            Npp8u *pPlane = rFrame.aPlanes[i].data(0, y);
+            for (int x = 0; x < width; ++x) {
+                pPlane[x] = aRow[(size_t)x * nChannels + i];
+            }
+        }
+    }
+}
+
+// Reads the next frame.  Returns false at a clean end of input and throws on
+// malformed input.
+bool readFrame(FILE *pInput, Frame &rFrame)
+{
+    int c = getc(pInput);
+    if (c == EOF) {
+        return false;
+    }
+
+    if (c == 'P') {
+        int type = getc(pInput);
+        NPP_ASSERT_MSG(type == '5' || type == '6', "Only binary PGM (P5) and PPM (P6) frames are supported");
+        int width = readPNMField(pInput);
+        int height = readPNMField(pInput);
+        int maxValue = readPNMField(pInput);
+        NPP_ASSERT_MSG(maxValue > 0 && maxValue <= 255, "Only 8-bit PNM frames are supported");
+
+        rFrame.format = type == '5' ? FRAME_PGM : FRAME_PPM;
+        rFrame.maxValue = maxValue;
+        readPlanes(pInput, width, height, type == '5' ? 1 : 3, rFrame);
+        return true;
+    }
+
+    ungetc(c, pInput);
+    RawFrameHeader oHeader;
+    NPP_ASSERT_MSG(fread(&oHeader, sizeof(oHeader), 1, pInput) == 1, "Truncated frame header in input stream");
+    NPP_ASSERT_MSG(oHeader.magic == RAW_FRAME_MAGIC, "Unknown frame format in input stream");
+    NPP_ASSERT_MSG(oHeader.width <= 0x7fffffff && oHeader.height <= 0x7fffffff, "Unsupported frame in input stream");
+
+    rFrame.format = FRAME_RAW;
+    rFrame.maxValue = 255;
+    readPlanes(pInput, oHeader.width, oHeader.height, oHeader.channels, rFrame);
+    return true;
+}
+
+// Writes one frame in the format and with the maxval it arrived in and
+// flushes it, so the next process in the pipeline sees it right away.
+// Bilinear samples and the zero border stay within the input maxval.
+bool writeFrame(FILE *pOutput, const Frame &rFrame)
+{
+    const int nChannels = (int)rFrame.aPlanes.size();
+    const int width = rFrame.aPlanes[0].width();
+    const int height = rFrame.aPlanes[0].height();
+
+    if (rFrame.format == FRAME_RAW) {
+        RawFrameHeader oHeader = {RAW_FRAME_MAGIC, (uint32_t)width, (uint32_t)height, (uint32_t)nChannels};
+        if (fwrite(&oHeader, sizeof(oHeader), 1, pOutput) != 1) {
+            return false;
+        }
+    } else if (fprintf(pOutput, "P%c\n%d %d\n%d\n", rFrame.format == FRAME_PGM ? '5' : '6', width, height,
+                       rFrame.maxValue) < 0) {
+        return false;
+    }
+
+    std::vector<Npp8u> aRow((size_t)width * nChannels);
+    for (int y = 0; y < height; ++y) {
+        for (int i = 0; i < nChannels; ++i) {
+            const Npp8u *pPlane = rFrame.aPlanes[i].data(0, y);
+            for (int x = 0; x < width; ++x) {
+                aRow[(size_t)x * nChannels + i] = pPlane[x];
+            }
+        }
+        if (fwrite(aRow.data(), 1, aRow.size(), pOutput) != aRow.size()) {
+            return false;
+        }
+    }
+    return fflush(pOutput) == 0;
+}
+
+void rotateFrame(Frame &rFrame, const StreamConfig &rConfig)
+{
+    const NppiRect *pROI = rConfig.useROI ? &rConfig.roi : nullptr;
+    try {
+        const npp::ImageCPU_8u_C1 &rFirst = rFrame.aPlanes[0];
+        NPP_ASSERT_MSG(rotatedPixelBound(rFirst.width(), rFirst.height(), rConfig.angle, pROI) <= kMaxFramePixels,
+                       "Rotated frame too large");
+        for (auto &rPlane : rFrame.aPlanes) {
+            npp::ImageCPU_8u_C1 oRotated;
+            rotateImage(rPlane, rConfig.angle, pROI, oRotated);
+            oRotated.swap(rPlane);
+        }
+        rFrame.success = true;
+    }
+    catch (npp::Exception &rException) {
+        std::ostringstream oMessage;
+        oMessage << "  NPP Exception (frame " << rFrame.index << "): " << rException;
+        logError(oMessage.str());
+        rFrame.success = false;
+    }
+    catch (std::exception &rException) {
+        std::ostringstream oMessage;
+        oMessage << "  Frame " << rFrame.index << ": " << rException.what();
+        logError(oMessage.str());
+        rFrame.success = false;
+    }
+}
+
+} // namespace
+
+int runStream(int inputFd, int outputFd, const StreamConfig &rConfig)
+{
+    FILE *pInput = fdopen(inputFd, "rb");
+    FILE *pOutput = fdopen(outputFd, "wb");
+    NPP_ASSERT_MSG(pInput && pOutput, "Unable to open the frame streams");
+
+    // A reader that goes away shows up as a failed write, not a signal.
+    signal(SIGPIPE, SIG_IGN);
+
+    const unsigned int nWorkers = std::max(1u, rConfig.workers);
+    const size_t nMaxInFlight = nWorkers + 2;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::unique_ptr<Frame>> pending;
+    std::map<uint64_t, std::unique_ptr<Frame>> finished;
+    size_t nInFlight = 0;
+    uint64_t nFramesRead = 0;
+    bool bEndOfInput = false;
+    bool bOutputClosed = false;
+    bool bFailed = false;
+
+    // Rotate stage: frames are taken in arrival order but may finish out of
+    // order.
+    std::vector<std::thread> aWorkers;
+    for (unsigned int i = 0; i < nWorkers; ++i) {
+        aWorkers.emplace_back([&] {
+            cudaSetDevice(rConfig.deviceId);
+            std::unique_lock<std::mutex> oLock(mutex);
+            for (;;) {
+                changed.wait(oLock, [&] { return bEndOfInput || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                std::unique_ptr<Frame> pFrame = std::move(pending.front());
+                pending.pop_front();
+
+                oLock.unlock();
+                rotateFrame(*pFrame, rConfig);
+                oLock.lock();
+
+                uint64_t index = pFrame->index;
+                finished[index] = std::move(pFrame);
+                changed.notify_all();
+            }
+        });
+    }
+
+    // Write stage: restores input order.  The first frame that fails to
+    // rotate or to be written ends the output, so that what downstream gets
+    // is always the input up to that frame, with none missing.
+    std::thread oWriter([&] {
+        uint64_t nNext = 0;
+        std::unique_lock<std::mutex> oLock(mutex);
+        for (;;) {
+            changed.wait(oLock, [&] { return finished.count(nNext) || (bEndOfInput && nNext == nFramesRead); });
+            if (!finished.count(nNext)) {
+                return;
+            }
+            std::unique_ptr<Frame> pFrame = std::move(finished[nNext]);
+            finished.erase(nNext);
+
+            oLock.unlock();
+            bool bWritten = false;
+            if (pFrame->success && !bOutputClosed) {
+                bWritten = writeFrame(pOutput, *pFrame);
+                if (!bWritten) {
+                    logError(std::string("Unable to write rotated frame: ") + strerror(errno));
+                }
+            }
+            oLock.lock();
+
+            if (!bWritten) {
+                if (!pFrame->success && !bOutputClosed) {
+                    std::ostringstream oMessage;
+                    oMessage << "Stream stopped at frame " << pFrame->index;
+                    logError(oMessage.str());
+                }
+                bFailed = true;
+                bOutputClosed = true;
+            }
+            --nInFlight;
+            ++nNext;
+            changed.notify_all();
+        }
+    });
+
+    // Read stage, on the calling thread; at most nMaxInFlight frames are held.
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> oLock(mutex);
+            changed.wait(oLock, [&] { return bOutputClosed || nInFlight < nMaxInFlight; });
+            if (bOutputClosed) {
+                break;
+            }
+        }
+
+        std::unique_ptr<Frame> pFrame(new Frame());
+        pFrame->index = nFramesRead;
+        pFrame->success = false;
+        try {
+            if (!readFrame(pInput, *pFrame)) {
+                break;
+            }
+        }
+        catch (npp::Exception &rException) {
+            std::ostringstream oMessage;
+            oMessage << "  Frame " << nFramesRead << ": " << rException;
+            logError(oMessage.str());
+            std::lock_guard<std::mutex> oLock(mutex);
+            bFailed = true;
+            break;
+        }
+        catch (...) {
+            // Out of memory; the other stages must still be joined
+            std::ostringstream oMessage;
+            oMessage << "  Frame " << nFramesRead << ": unable to read the frame";
+            logError(oMessage.str());
+            std::lock_guard<std::mutex> oLock(mutex);
+            bFailed = true;
+            break;
+        }
+
+        std::lock_guard<std::mutex> oLock(mutex);
+        pending.push_back(std::move(pFrame));
+        ++nInFlight;
+        ++nFramesRead;
+        changed.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> oLock(mutex);
+        bEndOfInput = true;
+        changed.notify_all();
+    }
+    for (auto &rWorker : aWorkers) {
+        rWorker.join();
+    }
+    oWriter.join();
+
+    std::ostringstream oMessage;
+    oMessage << "Stream finished: " << nFramesRead << " frame(s) read";
+    logInfo(oMessage.str());
+
+    fclose(pInput);
+    fclose(pOutput);
+    return bFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+/* Filter mode: rotated frames are read from one descriptor and written to
+ * another, so the tool can sit in a shell pipeline without temp files.
+ *
+ * Frames are either binary PNM images (P5 grayscale or P6 RGB, maxval at
+ * most 255) written back to back, or raw frames: a RawFrameHeader followed by
+ * width * height * channels packed bytes.  Each output frame uses the format
+ * and maxval of its input frame.  Reading, rotating and writing overlap, and
+ * frames are written in input order.  Planes over 2^30 pixels, before or
+ * after the rotation, are rejected.  The output stops before the first frame
+ * that cannot be read, rotated or written, so it is always a complete prefix
+ * of the input.
+ */
+
+#ifndef STREAM_MODE_H
+#define STREAM_MODE_H
+
+#include <npp.h>
+
+#include <stdint.h>
+
+#define RAW_FRAME_MAGIC 0x474d4952u     // "RIMG"
+
+struct RawFrameHeader
+{
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;  // 1 or 3, interleaved
+};
+
+struct StreamConfig
+{
+    double angle;
+    bool useROI;
+    NppiRect roi;
+    unsigned int workers;   // frames rotated concurrently
+    int deviceId;
+};
+
+// Runs until end of input or the first failed frame.  Returns the process
+// exit code; malformed input or a frame that fails to rotate makes it
+// EXIT_FAILURE.
+int runStream(int inputFd, int outputFd, const StreamConfig &rConfig);
+
+#endif // STREAM_MODE_H
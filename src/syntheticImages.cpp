@@ -0,0 +1,536 @@
+#include "syntheticImages.h"
+
+#include <Exceptions.h>
+#include <ImageIO.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+#include "logging.h"
+
+namespace
+{
+
+// Sides are kept within what the 32-bit sizes and pitches downstream allow
+// for a 16-bit RGBA image.
+const int kMinSide = 16;
+const int kMaxSide = 1 << 17;
+
+// Largest skew of the text lines, well inside what --angle=auto estimates.
+const double kMaxSyntheticSkew = 5.0;
+
+SyntheticSpec g_spec = defaultSyntheticSpec();
+
+uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// splitmix64: small, fast and good enough for test content, and its state
+// is one word, so a generator per image or per row costs nothing.
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : state_(seed)
+    {
+    }
+
+    uint64_t next()
+    {
+        state_ += 0x9e3779b97f4a7c15ULL;
+        return mix64(state_);
+    }
+
+    // Uniform in [0, 1).
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double normal()
+    {
+        const double u1 = 1.0 - uniform();
+        const double u2 = uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    }
+
+    size_t pick(size_t n)
+    {
+        return (size_t)(uniform() * n);
+    }
+
+private:
+    uint64_t state_;
+};
+
+uint64_t imageSeed(const SyntheticSpec &rSpec, size_t index)
+{
+    return mix64(rSpec.seed ^ mix64((uint64_t)index + 0x632be59bd9b4e019ULL));
+}
+
+int clampSide(double side)
+{
+    return (int)std::min<double>(kMaxSide, std::max<double>(kMinSide, std::round(side)));
+}
+
+// Draws the parameters of one image; rRandom is left where the content
+// parameters continue.
+SyntheticImage drawImage(const SyntheticSpec &rSpec, Random &rRandom)
+{
+    SyntheticImage oImage;
+    if (rSpec.sizeKind == SIZE_FIXED) {
+        oImage.size.width = clampSide(rSpec.sizeA);
+        oImage.size.height = clampSide(rSpec.sizeB);
+    } else {
+        const double side = rSpec.sizeKind == SIZE_UNIFORM
+                                ? rSpec.sizeA + (rSpec.sizeB - rSpec.sizeA) * rRandom.uniform()
+                                : rSpec.sizeA * std::exp(rSpec.sizeB * rRandom.normal());
+        // Aspect ratio between 1:1 and 4:3, either way up
+        const double shorter = side / std::exp(std::log(4.0 / 3.0) * rRandom.uniform());
+        const bool bPortrait = rRandom.uniform() < 0.5;
+        oImage.size.width = clampSide(bPortrait ? shorter : side);
+        oImage.size.height = clampSide(bPortrait ? side : shorter);
+    }
+
+    oImage.bitDepth = rSpec.bitDepths[rRandom.pick(rSpec.bitDepths.size())];
+    oImage.channels = rSpec.channels[rRandom.pick(rSpec.channels.size())];
+    oImage.extension = rSpec.formats[rRandom.pick(rSpec.formats.size())];
+
+    if (oImage.extension == ".jpg" || oImage.extension == ".bmp") {
+        oImage.bitDepth = 8;
+    }
+    if ((oImage.extension == ".jpg" || oImage.extension == ".pgm") && oImage.channels == 4) {
+        oImage.channels = 3;
+    }
+    if (oImage.extension == ".pgm" && oImage.channels > 1) {
+        oImage.extension = ".ppm";
+    }
+    return oImage;
+}
+
+// What the page looks like: paper and ink levels, a tint per channel and
+// the geometry of the text lines.
+struct PageStyle
+{
+    double paper;               // 16-bit levels
+    double ink;
+    double aTint[3];
+    double slope;               // tan(skew)
+    double linePitch;
+    double inkFraction;         // part of a line pitch that is ink
+    double wordLength;
+    int margin;
+};
+
+PageStyle drawStyle(const SyntheticImage &rImage, Random &rRandom)
+{
+    PageStyle oStyle;
+    oStyle.paper = (200.0 + 40.0 * rRandom.uniform()) * 257.0;
+    oStyle.ink = (20.0 + 40.0 * rRandom.uniform()) * 257.0;
+    for (double &rTint : oStyle.aTint) {
+        rTint = 0.85 + 0.15 * rRandom.uniform();
+    }
+    oStyle.slope = std::tan((2.0 * rRandom.uniform() - 1.0) * kMaxSyntheticSkew * M_PI / 180.0);
+    oStyle.linePitch = std::max(8.0, rImage.size.height / (25.0 + 20.0 * rRandom.uniform()));
+    oStyle.inkFraction = 0.3 + 0.2 * rRandom.uniform();
+    oStyle.wordLength = oStyle.linePitch * (1.0 + rRandom.uniform());
+    oStyle.margin = std::min(rImage.size.width, rImage.size.height) / 12;
+    return oStyle;
+}
+
+// Row y of the page as 16-bit luminance, noise included.
+void renderRow(const PageStyle &rStyle, const SyntheticImage &rImage, uint64_t seed, int y, uint16_t *pRow)
+{
+    const int width = rImage.size.width;
+    const bool bTextRow = y >= rStyle.margin && y < rImage.size.height - rStyle.margin;
+    Random oNoise(mix64(seed ^ (uint64_t)y));
+    uint64_t noise = 0;
+
+    for (int x = 0; x < width; ++x) {
+        if ((x & 7) == 0) {
+            noise = oNoise.next();
+        }
+        double level = rStyle.paper;
+        if (bTextRow && x >= rStyle.margin && x < width - rStyle.margin) {
+            const double across = (y + x * rStyle.slope) / rStyle.linePitch;
+            const double line = std::floor(across);
+            if (across - line < rStyle.inkFraction) {
+                // One word in four is left out, which makes the gaps
+                const uint64_t word =
+                    mix64(seed ^ ((uint64_t)(int64_t)line << 32) ^ (uint64_t)(x / rStyle.wordLength));
+                if ((word & 3) != 0) {
+                    level = rStyle.ink;
+                }
+            }
+        }
+        const double grain = (double)((noise >> ((x & 7) * 8)) & 0xff) - 127.5;
+        pRow[x] = (uint16_t)std::min(65535.0, std::max(0.0, level + grain * 24.0));
+    }
+}
+
+FIBITMAP *allocateBitmap(const SyntheticImage &rImage)
+{
+    const int width = rImage.size.width;
+    const int height = rImage.size.height;
+    if (rImage.bitDepth == 8) {
+        return FreeImage_Allocate(width, height, 8 * rImage.channels);
+    }
+    switch (rImage.channels) {
+    case 1:
+        return FreeImage_AllocateT(FIT_UINT16, width, height, 16);
+    case 3:
+        return FreeImage_AllocateT(FIT_RGB16, width, height, 48);
+    default:
+        return FreeImage_AllocateT(FIT_RGBA16, width, height, 64);
+    }
+}
+
+// Stores a rendered row into scan line pLine in the bitmap's layout.
+void storeRow(const PageStyle &rStyle, const SyntheticImage &rImage, const uint16_t *pRow, BYTE *pLine)
+{
+    const int width = rImage.size.width;
+    const int channels = rImage.channels;
+    if (channels == 1) {
+        for (int x = 0; x < width; ++x) {
+            if (rImage.bitDepth == 8) {
+                pLine[x] = (BYTE)(pRow[x] >> 8);
+            } else {
+                ((WORD *)pLine)[x] = pRow[x];
+            }
+        }
+        return;
+    }
+
+    for (int x = 0; x < width; ++x) {
+        const WORD red = (WORD)(pRow[x] * rStyle.aTint[0]);
+        const WORD green = (WORD)(pRow[x] * rStyle.aTint[1]);
+        const WORD blue = (WORD)(pRow[x] * rStyle.aTint[2]);
+        if (rImage.bitDepth == 8) {
+            BYTE *pPixel = pLine + (size_t)x * channels;
+            pPixel[FI_RGBA_RED] = (BYTE)(red >> 8);
+            pPixel[FI_RGBA_GREEN] = (BYTE)(green >> 8);
+            pPixel[FI_RGBA_BLUE] = (BYTE)(blue >> 8);
+            if (channels == 4) {
+                pPixel[FI_RGBA_ALPHA] = 0xff;
+            }
+        } else if (channels == 3) {
+            FIRGB16 &rPixel = ((FIRGB16 *)pLine)[x];
+            rPixel.red = red;
+            rPixel.green = green;
+            rPixel.blue = blue;
+        } else {
+            FIRGBA16 &rPixel = ((FIRGBA16 *)pLine)[x];
+            rPixel.red = red;
+            rPixel.green = green;
+            rPixel.blue = blue;
+            rPixel.alpha = 0xffff;
+        }
+    }
+}
+
+bool parseList(const std::string &text, std::vector<std::string> &rItems)
+{
+    rItems.clear();
+    std::stringstream oList(text);
+    std::string item;
+    while (std::getline(oList, item, ',')) {
+        if (item.empty()) {
+            return false;
+        }
+        rItems.push_back(item);
+    }
+    return !rItems.empty();
+}
+
+bool parseIntList(const std::string &text, const std::vector<int> &aAllowed, std::vector<int> &rValues)
+{
+    std::vector<std::string> aItems;
+    if (!parseList(text, aItems)) {
+        return false;
+    }
+    std::vector<int> aValues;
+    for (const std::string &item : aItems) {
+        char *pEnd;
+        const long value = strtol(item.c_str(), &pEnd, 10);
+        if (*pEnd != '\0' || std::find(aAllowed.begin(), aAllowed.end(), (int)value) == aAllowed.end()) {
+            return false;
+        }
+        aValues.push_back((int)value);
+    }
+    rValues.swap(aValues);
+    return true;
+}
+
+template <typename T>
+std::string joinList(const std::vector<T> &aItems)
+{
+    std::ostringstream oText;
+    for (size_t i = 0; i < aItems.size(); ++i) {
+        oText << (i ? "," : "") << aItems[i];
+    }
+    return oText.str();
+}
+
+// Index of "synthetic://image_N.ext", false for other paths.
+bool parseSyntheticPath(const std::string &path, size_t &rIndex)
+{
+    const std::string prefix = std::string(kSyntheticPrefix) + "image_";
+    if (path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    const char *pDigits = path.c_str() + prefix.size();
+    char *pEnd;
+    const unsigned long long index = strtoull(pDigits, &pEnd, 10);
+    if (pEnd == pDigits || *pEnd != '.') {
+        return false;
+    }
+    rIndex = (size_t)index;
+    return true;
+}
+
+} // namespace
+
+SyntheticSpec defaultSyntheticSpec()
+{
+    SyntheticSpec oSpec;
+    oSpec.seed = 1;
+    oSpec.sizeKind = SIZE_UNIFORM;
+    oSpec.sizeA = 512;
+    oSpec.sizeB = 2048;
+    oSpec.bitDepths.assign(1, 8);
+    oSpec.channels.assign(1, 1);
+    oSpec.formats.assign(1, ".tiff");
+    return oSpec;
+}
+
+bool parseSyntheticSize(const std::string &text, SyntheticSpec &rSpec)
+{
+    const size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    const std::string kind = text.substr(0, colon);
+    const std::string value = text.substr(colon + 1);
+
+    double a, b;
+    char separator, extra;
+    std::istringstream oValue(value);
+    if (!(oValue >> a >> separator >> b) || oValue >> extra) {
+        return false;
+    }
+    if (kind == "fixed" && separator == 'x' && a >= 1 && b >= 1) {
+        rSpec.sizeKind = SIZE_FIXED;
+    } else if (kind == "uniform" && separator == '-' && a >= 1 && b >= a) {
+        rSpec.sizeKind = SIZE_UNIFORM;
+    } else if (kind == "lognormal" && separator == ',' && a >= 1 && b >= 0) {
+        rSpec.sizeKind = SIZE_LOGNORMAL;
+    } else {
+        return false;
+    }
+    rSpec.sizeA = a;
+    rSpec.sizeB = b;
+    return true;
+}
+
+bool parseSyntheticDepths(const std::string &text, SyntheticSpec &rSpec)
+{
+    return parseIntList(text, {8, 16}, rSpec.bitDepths);
+}
+
+bool parseSyntheticChannels(const std::string &text, SyntheticSpec &rSpec)
+{
+    return parseIntList(text, {1, 3, 4}, rSpec.channels);
+}
+
+bool parseSyntheticFormats(const std::string &text, SyntheticSpec &rSpec)
+{
+    std::vector<std::string> aNames;
+    if (!parseList(text, aNames)) {
+        return false;
+    }
+    std::vector<std::string> aFormats;
+    for (std::string name : aNames) {
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (!name.empty() && name[0] == '.') {
+            name.erase(0, 1);
+        }
+        if (name == "tiff" || name == "tif") {
+            aFormats.push_back(".tiff");
+        } else if (name == "png" || name == "bmp") {
+            aFormats.push_back("." + name);
+        } else if (name == "pgm" || name == "ppm" || name == "pnm") {
+            aFormats.push_back(".pgm");
+        } else if (name == "jpg" || name == "jpeg") {
+            aFormats.push_back(".jpg");
+        } else {
+            return false;
+        }
+    }
+    rSpec.formats.swap(aFormats);
+    return true;
+}
+
+std::string describeSyntheticSpec(const SyntheticSpec &rSpec)
+{
+    std::ostringstream oText;
+    oText << "seed " << rSpec.seed << ", ";
+    switch (rSpec.sizeKind) {
+    case SIZE_FIXED:
+        oText << rSpec.sizeA << "x" << rSpec.sizeB;
+        break;
+    case SIZE_UNIFORM:
+        oText << "longer side " << rSpec.sizeA << "-" << rSpec.sizeB;
+        break;
+    case SIZE_LOGNORMAL:
+        oText << "longer side lognormal, median " << rSpec.sizeA << ", sigma " << rSpec.sizeB;
+        break;
+    }
+    oText << ", " << joinList(rSpec.bitDepths) << " bit, " << joinList(rSpec.channels) << " channel(s), "
+          << joinList(rSpec.formats);
+    return oText.str();
+}
+
+void setSyntheticSpec(const SyntheticSpec &rSpec)
+{
+    g_spec = rSpec;
+}
+
+const SyntheticSpec &syntheticSpec()
+{
+    return g_spec;
+}
+
+SyntheticImage describeSyntheticImage(const SyntheticSpec &rSpec, size_t index)
+{
+    Random oRandom(imageSeed(rSpec, index));
+    return drawImage(rSpec, oRandom);
+}
+
+std::string syntheticFileName(const SyntheticSpec &rSpec, size_t index)
+{
+    char aName[32];
+    snprintf(aName, sizeof(aName), "image_%08zu", index);
+    return aName + describeSyntheticImage(rSpec, index).extension;
+}
+
+void generateSyntheticImage(const SyntheticSpec &rSpec, size_t index, std::vector<unsigned char> &rEncoded)
+{
+    const uint64_t seed = imageSeed(rSpec, index);
+    Random oRandom(seed);
+    const SyntheticImage oImage = drawImage(rSpec, oRandom);
+    const PageStyle oStyle = drawStyle(oImage, oRandom);
+
+    FIBITMAP *pBitmap = allocateBitmap(oImage);
+    NPP_ASSERT_MSG(pBitmap != 0, "Unable to allocate synthetic image");
+
+    // FreeImage stores scan lines bottom-up
+    std::vector<uint16_t> aRow(oImage.size.width);
+    for (int y = 0; y < oImage.size.height; ++y) {
+        renderRow(oStyle, oImage, seed, y, aRow.data());
+        storeRow(oStyle, oImage, aRow.data(), FreeImage_GetScanLine(pBitmap, oImage.size.height - 1 - y));
+    }
+
+    const FREE_IMAGE_FORMAT eFormat = FreeImage_GetFIFFromFilename(("image" + oImage.extension).c_str());
+    FIMEMORY *pMemory = FreeImage_OpenMemory();
+    bool bSaved = FreeImage_SaveToMemory(eFormat, pBitmap, pMemory, 0) != 0;
+    FreeImage_Unload(pBitmap);
+
+    BYTE *pData = 0;
+    DWORD nSize = 0;
+    if (bSaved && FreeImage_AcquireMemory(pMemory, &pData, &nSize)) {
+        rEncoded.assign(pData, pData + nSize);
+    } else {
+        bSaved = false;
+    }
+    FreeImage_CloseMemory(pMemory);
+
+    NPP_ASSERT_MSG(bSaved, "Unable to encode synthetic image " + syntheticFileName(rSpec, index));
+}
+
+size_t writeSyntheticImages(const SyntheticSpec &rSpec, size_t count, const std::string &directory,
+                            unsigned int nThreads)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> nFailed(0);
+
+    auto generate = [&]() {
+        std::vector<unsigned char> aEncoded;
+        for (size_t index = next++; index < count; index = next++) {
+            const std::string path = directory + "/" + syntheticFileName(rSpec, index);
+            try {
+                generateSyntheticImage(rSpec, index, aEncoded);
+                FILE *pFile = fopen(path.c_str(), "wb");
+                NPP_ASSERT_MSG(pFile != 0, "Unable to create " + path);
+                const bool bWritten = fwrite(aEncoded.data(), 1, aEncoded.size(), pFile) == aEncoded.size();
+                NPP_ASSERT_MSG(fclose(pFile) == 0 && bWritten, "Write failed on " + path);
+
+                const SyntheticImage oImage = describeSyntheticImage(rSpec, index);
+                std::ostringstream oMessage;
+                oMessage << "[" << (index + 1) << "/" << count << "] Generated: " << path << " ("
+                         << oImage.size.width << "x" << oImage.size.height << ", " << oImage.bitDepth << " bit, "
+                         << oImage.channels << " channel(s))";
+                logInfo(oMessage.str());
+            }
+            catch (npp::Exception &rException) {
+                ++nFailed;
+                std::ostringstream oMessage;
+                oMessage << "NPP Exception (" << path << "): " << rException;
+                logError(oMessage.str());
+            }
+        }
+    };
+
+    std::vector<std::thread> aThreads;
+    for (unsigned int i = 1; i < std::min<size_t>(std::max(1u, nThreads), count); ++i) {
+        aThreads.emplace_back(generate);
+    }
+    generate();
+    for (std::thread &rThread : aThreads) {
+        rThread.join();
+    }
+    return nFailed;
+}
+
+std::vector<std::string> syntheticImagePaths(size_t count)
+{
+    std::vector<std::string> aPaths;
+    aPaths.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        aPaths.push_back(kSyntheticPrefix + syntheticFileName(g_spec, i));
+    }
+    return aPaths;
+}
+
+bool isSyntheticPath(const std::string &path)
+{
+    return path.compare(0, strlen(kSyntheticPrefix), kSyntheticPrefix) == 0;
+}
+
+bool describeSyntheticPath(const std::string &path, SyntheticImage &rImage)
+{
+    size_t index;
+    if (!parseSyntheticPath(path, index)) {
+        return false;
+    }
+    rImage = describeSyntheticImage(g_spec, index);
+    return true;
+}
+
+bool loadSyntheticImage(const std::string &path, std::vector<unsigned char> &rEncoded)
+{
+    size_t index;
+    if (!parseSyntheticPath(path, index)) {
+        return false;
+    }
+    generateSyntheticImage(g_spec, index, rEncoded);
+    return true;
+}
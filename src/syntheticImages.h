@@ -0,0 +1,107 @@
+/* Synthetic images for load and scaling tests.
+ *
+ * A workload is a seed plus distributions: of the image size, of the bit
+ * depth (8 or 16 bits per sample), of the channel count (1, 3 or 4) and of
+ * the file format.  Image i is drawn from a generator seeded with a hash of
+ * (seed, i) alone, so any image can be produced on its own, on any thread
+ * and in any order, and the same seed always yields the same bytes.
+ *
+ * The content looks like a scanned page: a tinted background with noise,
+ * and dark lines of "words" that share a random skew of a few degrees, so
+ * that --angle=auto has something to find.  Combinations a format cannot
+ * store are reduced to the nearest one it can: JPEG and BMP are 8-bit, PNM
+ * and JPEG have no alpha channel.
+ *
+ * Images are either written out as files (--generate) or fed to the batch
+ * in memory (--synthetic) under virtual paths "synthetic://image_N.ext".
+ * Such a path is never opened: its size comes from the description and its
+ * contents are encoded by the worker that processes it, so a run of
+ * millions of files, or of gigapixel images, needs no disk space for the
+ * inputs.
+ *
+ * Like the overview levels, the workload is process wide and set once
+ * before the batch starts.
+ */
+
+#ifndef SYNTHETIC_IMAGES_H
+#define SYNTHETIC_IMAGES_H
+
+#include <npp.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Prefix of the virtual paths of in-memory synthetic images.
+const char *const kSyntheticPrefix = "synthetic://";
+
+enum SyntheticSizeKind
+{
+    SIZE_FIXED,                 // a x b
+    SIZE_UNIFORM,               // longer side uniform in [a, b]
+    SIZE_LOGNORMAL              // longer side lognormal, median a, sigma b
+};
+
+struct SyntheticSpec
+{
+    uint64_t seed;
+    SyntheticSizeKind sizeKind;
+    double sizeA;
+    double sizeB;
+    std::vector<int> bitDepths;         // 8, 16
+    std::vector<int> channels;          // 1, 3, 4
+    std::vector<std::string> formats;   // extensions: ".tiff", ".png", ".pgm", ".jpg", ".bmp"
+};
+
+struct SyntheticImage
+{
+    NppiSize size;
+    int bitDepth;
+    int channels;
+    std::string extension;      // ".pgm" becomes ".ppm" for colour images
+};
+
+// Seed 1, 512 to 2048 pixels on the longer side, 8-bit gray TIFF.
+SyntheticSpec defaultSyntheticSpec();
+
+// Parsers for the command line, false on malformed input.  Sizes are
+// "fixed:WxH", "uniform:MIN-MAX" or "lognormal:MEDIAN,SIGMA"; the lists are
+// comma separated ("8,16", "1,3,4", "tiff,png,pgm,jpg,bmp").
+bool parseSyntheticSize(const std::string &text, SyntheticSpec &rSpec);
+bool parseSyntheticDepths(const std::string &text, SyntheticSpec &rSpec);
+bool parseSyntheticChannels(const std::string &text, SyntheticSpec &rSpec);
+bool parseSyntheticFormats(const std::string &text, SyntheticSpec &rSpec);
+
+// One line summary of rSpec for the console and the processing log.
+std::string describeSyntheticSpec(const SyntheticSpec &rSpec);
+
+// Process wide workload of the synthetic:// paths.
+void setSyntheticSpec(const SyntheticSpec &rSpec);
+const SyntheticSpec &syntheticSpec();
+
+// Parameters and file name ("image_00000042.tiff") of image index.
+SyntheticImage describeSyntheticImage(const SyntheticSpec &rSpec, size_t index);
+std::string syntheticFileName(const SyntheticSpec &rSpec, size_t index);
+
+// Renders and encodes image index.  Throws npp::Exception if the encoder
+// fails.
+void generateSyntheticImage(const SyntheticSpec &rSpec, size_t index, std::vector<unsigned char> &rEncoded);
+
+// Writes images 0 .. count-1 into directory on nThreads threads.  Returns
+// the number of files that could not be written.
+size_t writeSyntheticImages(const SyntheticSpec &rSpec, size_t count, const std::string &directory,
+                            unsigned int nThreads);
+
+// The virtual paths of images 0 .. count-1 of the process wide workload.
+std::vector<std::string> syntheticImagePaths(size_t count);
+
+// True for "synthetic://..." paths; the others are files.
+bool isSyntheticPath(const std::string &path);
+
+// Parameters and contents behind a synthetic:// path, from the process
+// wide workload.  Return false if path does not name a synthetic image.
+bool describeSyntheticPath(const std::string &path, SyntheticImage &rImage);
+bool loadSyntheticImage(const std::string &path, std::vector<unsigned char> &rEncoded);
+
+#endif // SYNTHETIC_IMAGES_H
@@ -0,0 +1,335 @@
+#include "tiffPyramid.h"
+
+#include <Exceptions.h>
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+
+std::atomic<int> g_overviewLevels(0);
+
+// Strips of about this many bytes; each level fills its own.
+const size_t kStripBytes = 256 << 10;
+
+// Classic TIFF offsets are 32 bit; leave room for the directories.
+const uint64_t kClassicLimit = 0xFFFFFFFFull - (16u << 20);
+
+enum TIFFType
+{
+    TIFF_SHORT = 3,
+    TIFF_LONG = 4,
+    TIFF_IFD = 13,
+    TIFF_LONG8 = 16,
+    TIFF_IFD8 = 18
+};
+
+size_t typeSize(uint16_t type)
+{
+    switch (type) {
+    case TIFF_SHORT:
+        return 2;
+    case TIFF_LONG8:
+    case TIFF_IFD8:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+// Appends the nBytes low bytes of value, little endian.
+void putLE(std::vector<unsigned char> &rBytes, uint64_t value, size_t nBytes)
+{
+    for (size_t i = 0; i < nBytes; ++i) {
+        rBytes.push_back((unsigned char)(value >> (8 * i)));
+    }
+}
+
+} // namespace
+
+void setOverviewLevels(int nLevels)
+{
+    g_overviewLevels = std::min(std::max(nLevels, 0), 16);
+}
+
+int overviewLevels()
+{
+    return g_overviewLevels.load();
+}
+
+bool isTIFFFileName(const std::string &rFileName)
+{
+    size_t nDot = rFileName.find_last_of('.');
+    if (nDot == std::string::npos) {
+        return false;
+    }
+    std::string extension = rFileName.substr(nDot);
+    for (char &c : extension) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return extension == ".tif" || extension == ".tiff";
+}
+
+TIFFPyramidWriter::TIFFPyramidWriter(const std::string &rFileName, int width, int height, int nOverviews)
+    : fileName_(rFileName), pFile_(0), pEncoded_(0), offset_(0), bBig_(false)
+{
+    pFile_ = fopen(rFileName.c_str(), "wb");
+    NPP_ASSERT_MSG(pFile_ != 0, "Unable to create " + rFileName);
+    init(width, height, nOverviews);
+}
+
+TIFFPyramidWriter::TIFFPyramidWriter(std::vector<unsigned char> &rEncoded, int width, int height, int nOverviews)
+    : fileName_("TIFF in memory"), pFile_(0), pEncoded_(&rEncoded), offset_(0), bBig_(false)
+{
+    rEncoded.clear();
+    init(width, height, nOverviews);
+}
+
+TIFFPyramidWriter::~TIFFPyramidWriter()
+{
+    if (pFile_) {
+        fclose(pFile_);
+    }
+}
+
+void TIFFPyramidWriter::init(int width, int height, int nOverviews)
+{
+    NPP_ASSERT(width > 0 && height > 0);
+
+    uint64_t nPixels = 0;
+    for (int i = 0; i <= nOverviews; ++i) {
+        Level oLevel;
+        oLevel.width = i == 0 ? width : (aLevels_.back().width + 1) / 2;
+        oLevel.height = i == 0 ? height : (aLevels_.back().height + 1) / 2;
+        oLevel.rowsWritten = 0;
+        oLevel.stripRows = (int)std::min<size_t>(std::max<size_t>(kStripBytes / oLevel.width, 1), oLevel.height);
+        oLevel.bPending = false;
+        oLevel.aStrip.reserve((size_t)oLevel.stripRows * oLevel.width);
+        oLevel.aPending.resize(oLevel.width);
+        oLevel.aReduced.resize(oLevel.width);
+        nPixels += (uint64_t)oLevel.width * oLevel.height;
+        aLevels_.push_back(std::move(oLevel));
+    }
+    if (pEncoded_) {
+        pEncoded_->reserve(nPixels + 4096);
+    }
+
+    bBig_ = nPixels > kClassicLimit;
+    std::vector<unsigned char> aHeader;
+    putLE(aHeader, 'I' | ('I' << 8), 2);
+    if (bBig_) {
+        putLE(aHeader, 43, 2);
+        putLE(aHeader, 8, 2);       // offset size
+        putLE(aHeader, 0, 2);
+        putLE(aHeader, 0, 8);       // first directory, patched by close()
+    } else {
+        putLE(aHeader, 42, 2);
+        putLE(aHeader, 0, 4);
+    }
+    emit(aHeader.data(), aHeader.size());
+}
+
+void TIFFPyramidWriter::writeRows(const npp::ImageCPU_8u_C1 &rRows, int nRows)
+{
+    NPP_ASSERT((int)rRows.width() == aLevels_[0].width);
+    for (int y = 0; y < nRows; ++y) {
+        writeRow(rRows.data(0, y));
+    }
+}
+
+void TIFFPyramidWriter::writeRow(const Npp8u *pRow)
+{
+    NPP_ASSERT(aLevels_[0].rowsWritten < aLevels_[0].height);
+    push(0, pRow);
+}
+
+// Adds a row to level, and to the next level once it has a pair.
+void TIFFPyramidWriter::push(size_t level, const Npp8u *pRow)
+{
+    Level &rLevel = aLevels_[level];
+    rLevel.aStrip.insert(rLevel.aStrip.end(), pRow, pRow + rLevel.width);
+    ++rLevel.rowsWritten;
+    const bool bLast = rLevel.rowsWritten == rLevel.height;
+
+    if (level + 1 < aLevels_.size()) {
+        if (rLevel.bPending) {
+            rLevel.bPending = false;
+            reduceInto(level + 1, rLevel.aPending.data(), pRow);
+        } else if (bLast) {
+            reduceInto(level + 1, pRow, pRow);
+        } else {
+            memcpy(rLevel.aPending.data(), pRow, rLevel.width);
+            rLevel.bPending = true;
+        }
+    }
+
+    if (bLast || rLevel.aStrip.size() == (size_t)rLevel.stripRows * rLevel.width) {
+        flushStrip(rLevel);
+    }
+}
+
+// 2x2 box filter of two rows of the level above into a row of level.
+void TIFFPyramidWriter::reduceInto(size_t level, const Npp8u *pRow0, const Npp8u *pRow1)
+{
+    Level &rLevel = aLevels_[level];
+    const int srcWidth = aLevels_[level - 1].width;
+    Npp8u *pOut = rLevel.aReduced.data();
+    for (int x = 0; x < rLevel.width; ++x) {
+        const int x0 = 2 * x;
+        const int x1 = std::min(x0 + 1, srcWidth - 1);
+        pOut[x] = (Npp8u)((pRow0[x0] + pRow0[x1] + pRow1[x0] + pRow1[x1] + 2) / 4);
+    }
+    push(level, pOut);
+}
+
+void TIFFPyramidWriter::flushStrip(Level &rLevel)
+{
+    if (rLevel.aStrip.empty()) {
+        return;
+    }
+    rLevel.aOffsets.push_back(offset_);
+    rLevel.aByteCounts.push_back(rLevel.aStrip.size());
+    emit(rLevel.aStrip.data(), rLevel.aStrip.size());
+    rLevel.aStrip.clear();
+}
+
+void TIFFPyramidWriter::emit(const void *pData, size_t nBytes)
+{
+    if (pFile_) {
+        NPP_ASSERT_MSG(fwrite(pData, 1, nBytes, pFile_) == nBytes, "Write failed on " + fileName_);
+    } else {
+        const unsigned char *pBytes = (const unsigned char *)pData;
+        pEncoded_->insert(pEncoded_->end(), pBytes, pBytes + nBytes);
+    }
+    offset_ += nBytes;
+}
+
+// Directories and their values start on a word boundary.
+void TIFFPyramidWriter::align()
+{
+    if (offset_ & 1) {
+        const unsigned char kZero = 0;
+        emit(&kZero, 1);
+    }
+}
+
+// Writes the values that do not fit in their entries, then the directory
+// itself, and returns the directory's offset.
+uint64_t TIFFPyramidWriter::writeDirectory(std::vector<Entry> &aEntries)
+{
+    const size_t nInline = bBig_ ? 8 : 4;
+    const size_t nOffset = bBig_ ? 8 : 4;
+
+    std::vector<uint64_t> aValueOffsets(aEntries.size(), 0);
+    for (size_t i = 0; i < aEntries.size(); ++i) {
+        const Entry &rEntry = aEntries[i];
+        const size_t nSize = typeSize(rEntry.type);
+        if (nSize * rEntry.aValues.size() > nInline) {
+            align();
+            aValueOffsets[i] = offset_;
+            std::vector<unsigned char> aBytes;
+            aBytes.reserve(nSize * rEntry.aValues.size());
+            for (uint64_t value : rEntry.aValues) {
+                putLE(aBytes, value, nSize);
+            }
+            emit(aBytes.data(), aBytes.size());
+        }
+    }
+
+    align();
+    const uint64_t directory = offset_;
+    std::vector<unsigned char> aBytes;
+    putLE(aBytes, aEntries.size(), bBig_ ? 8 : 2);
+    for (size_t i = 0; i < aEntries.size(); ++i) {
+        const Entry &rEntry = aEntries[i];
+        const size_t nSize = typeSize(rEntry.type);
+        putLE(aBytes, rEntry.tag, 2);
+        putLE(aBytes, rEntry.type, 2);
+        putLE(aBytes, rEntry.aValues.size(), nOffset);
+        if (nSize * rEntry.aValues.size() > nInline) {
+            putLE(aBytes, aValueOffsets[i], nOffset);
+        } else {
+            size_t nUsed = 0;
+            for (uint64_t value : rEntry.aValues) {
+                putLE(aBytes, value, nSize);
+                nUsed += nSize;
+            }
+            putLE(aBytes, 0, nInline - nUsed);
+        }
+    }
+    putLE(aBytes, 0, nOffset);      // no next directory
+    emit(aBytes.data(), aBytes.size());
+    return directory;
+}
+
+void TIFFPyramidWriter::patchHeader(uint64_t firstDirectory)
+{
+    std::vector<unsigned char> aBytes;
+    putLE(aBytes, firstDirectory, bBig_ ? 8 : 4);
+    const size_t nPosition = bBig_ ? 8 : 4;
+
+    if (pFile_) {
+        NPP_ASSERT_MSG(fseeko(pFile_, (off_t)nPosition, SEEK_SET) == 0
+                       && fwrite(aBytes.data(), 1, aBytes.size(), pFile_) == aBytes.size(),
+                       "Write failed on " + fileName_);
+    } else {
+        memcpy(pEncoded_->data() + nPosition, aBytes.data(), aBytes.size());
+    }
+}
+
+void TIFFPyramidWriter::close()
+{
+    NPP_ASSERT_MSG(aLevels_[0].rowsWritten == aLevels_[0].height, "Incomplete image written to " + fileName_);
+
+    const uint16_t kOffsetType = bBig_ ? TIFF_LONG8 : TIFF_LONG;
+    std::vector<uint64_t> aSubDirectories;
+    uint64_t main = 0;
+
+    // Overviews first, so the full resolution directory can point at them
+    for (size_t i = aLevels_.size(); i-- > 0;) {
+        const Level &rLevel = aLevels_[i];
+        std::vector<Entry> aEntries;
+        if (i > 0) {
+            aEntries.push_back(Entry{254, TIFF_LONG, {1}});     // NewSubfileType: reduced image
+        }
+        aEntries.push_back(Entry{256, TIFF_LONG, {(uint64_t)rLevel.width}});
+        aEntries.push_back(Entry{257, TIFF_LONG, {(uint64_t)rLevel.height}});
+        aEntries.push_back(Entry{258, TIFF_SHORT, {8}});        // BitsPerSample
+        aEntries.push_back(Entry{259, TIFF_SHORT, {1}});        // no compression
+        aEntries.push_back(Entry{262, TIFF_SHORT, {1}});        // BlackIsZero
+        aEntries.push_back(Entry{273, kOffsetType, rLevel.aOffsets});
+        aEntries.push_back(Entry{277, TIFF_SHORT, {1}});        // SamplesPerPixel
+        aEntries.push_back(Entry{278, TIFF_LONG, {(uint64_t)rLevel.stripRows}});
+        aEntries.push_back(Entry{279, kOffsetType, rLevel.aByteCounts});
+        aEntries.push_back(Entry{284, TIFF_SHORT, {1}});        // PlanarConfiguration: contiguous
+        if (i == 0 && !aSubDirectories.empty()) {
+            std::reverse(aSubDirectories.begin(), aSubDirectories.end());
+            aEntries.push_back(Entry{330, (uint16_t)(bBig_ ? TIFF_IFD8 : TIFF_IFD), aSubDirectories});
+        }
+
+        uint64_t directory = writeDirectory(aEntries);
+        if (i > 0) {
+            aSubDirectories.push_back(directory);
+        } else {
+            main = directory;
+        }
+    }
+    patchHeader(main);
+
+    if (pFile_) {
+        int nResult = fclose(pFile_);
+        pFile_ = 0;
+        NPP_ASSERT_MSG(nResult == 0, "Write failed on " + fileName_);
+    }
+}
+
+void encodeTIFFPyramid(const npp::ImageCPU_8u_C1 &rImage, std::vector<unsigned char> &rEncoded)
+{
+    TIFFPyramidWriter oWriter(rEncoded, rImage.width(), rImage.height(), overviewLevels());
+    oWriter.writeRows(rImage, rImage.height());
+    oWriter.close();
+}
@@ -0,0 +1,101 @@
+/* TIFF output with overviews (reduced-resolution copies) for tiled map
+ * serving.
+ *
+ * Building 2x/4x/8x overviews after the fact rereads every output image.
+ * Here they are produced while the output is written: each row of the full
+ * resolution image is appended to the current strip and immediately 2x2
+ * box-reduced into the first overview, whose rows cascade into the next,
+ * so every row is reduced while it is still in cache.  All levels are
+ * written in the same pass, strip by strip as they fill up; the image file
+ * directories come last, the overviews as SubIFDs of the full resolution
+ * one (TIFF tag 330, with NewSubfileType = reduced image), which GDAL and
+ * libtiff readers pick up as a pyramid.  Files that would pass 4 GB are
+ * written as BigTIFF.
+ *
+ * The overview count is process wide, like the remap cache limit.  Only
+ * .tif/.tiff outputs get overviews; other formats are written as before.
+ */
+
+#ifndef TIFF_PYRAMID_H
+#define TIFF_PYRAMID_H
+
+#include <ImagesCPU.h>
+#include <npp.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// Number of overviews written with every TIFF output: levels 2x .. 2^N x.
+// 0 (the default) disables them.
+void setOverviewLevels(int nLevels);
+int overviewLevels();
+
+// True if rFileName's extension is .tif or .tiff.
+bool isTIFFFileName(const std::string &rFileName);
+
+// Writes an 8-bit grayscale TIFF top to bottom, a band of rows at a time,
+// together with nOverviews reduced levels.  Writes go to a file, or to
+// rEncoded with the in-memory constructor.
+class TIFFPyramidWriter
+{
+public:
+    TIFFPyramidWriter(const std::string &rFileName, int width, int height, int nOverviews);
+    TIFFPyramidWriter(std::vector<unsigned char> &rEncoded, int width, int height, int nOverviews);
+    ~TIFFPyramidWriter();
+
+    // Appends the first nRows rows of rRows.
+    void writeRows(const npp::ImageCPU_8u_C1 &rRows, int nRows);
+    void writeRow(const Npp8u *pRow);
+
+    // Writes the directories; throws if anything went wrong.
+    void close();
+
+private:
+    TIFFPyramidWriter(const TIFFPyramidWriter &);
+    TIFFPyramidWriter &operator=(const TIFFPyramidWriter &);
+
+    struct Level
+    {
+        int width;
+        int height;
+        int rowsWritten;
+        std::vector<Npp8u> aStrip;          // rows of the strip being filled
+        int stripRows;
+        std::vector<Npp8u> aPending;        // even row waiting for its partner
+        std::vector<Npp8u> aReduced;        // row being reduced into this level
+        bool bPending;
+        std::vector<uint64_t> aOffsets;
+        std::vector<uint64_t> aByteCounts;
+    };
+
+    struct Entry
+    {
+        uint16_t tag;
+        uint16_t type;
+        std::vector<uint64_t> aValues;
+    };
+
+    void init(int width, int height, int nOverviews);
+    void push(size_t level, const Npp8u *pRow);
+    void reduceInto(size_t level, const Npp8u *pRow0, const Npp8u *pRow1);
+    void flushStrip(Level &rLevel);
+    void emit(const void *pData, size_t nBytes);
+    void align();
+    uint64_t writeDirectory(std::vector<Entry> &aEntries);
+    void patchHeader(uint64_t firstDirectory);
+
+    std::string fileName_;
+    FILE *pFile_;
+    std::vector<unsigned char> *pEncoded_;
+    uint64_t offset_;
+    bool bBig_;
+    std::vector<Level> aLevels_;
+};
+
+// In-memory counterpart: rImage and overviewLevels() overviews as a TIFF.
+void encodeTIFFPyramid(const npp::ImageCPU_8u_C1 &rImage, std::vector<unsigned char> &rEncoded);
+
+#endif // TIFF_PYRAMID_H